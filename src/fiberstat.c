@@ -27,7 +27,9 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <malloc.h>
 #include <assert.h>
@@ -38,19 +40,31 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <net/if.h>
 #include <locale.h>
+#include <poll.h>
 #include <math.h>
 #include <dirent.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <spawn.h>
 
 #include <ncurses.h>
 
 /* natsort */
 #include <strnatcmp.h>
 
+#include <libfiberstat-private.h>
+
 /******************************************************************************/
 
 #define PROGRAM_NAME    "fiberstat"
@@ -86,21 +100,6 @@
 static FILE *logfile;
 static bool  debug;
 
-static void
-setup_log (void)
-{
-    if (!debug)
-        return;
-    logfile = fopen (DEBUG_LOG, "w+");
-}
-
-static void
-teardown_log (void)
-{
-    if (logfile)
-        fclose (logfile);
-}
-
 static void
 log_message (const char *level,
              const char *fmt,
@@ -127,15 +126,312 @@ log_message (const char *level,
 #define log_info(...)    log_message ("[info ]", ## __VA_ARGS__ )
 #define log_debug(...)   log_message ("[debug]", ## __VA_ARGS__ )
 
+/* Messages logged by libfiberstat */
+static void
+log_library_message (FiberstatLogLevel  level,
+                     const char        *message,
+                     void              *user_data)
+{
+    switch (level) {
+    case FIBERSTAT_LOG_LEVEL_ERROR:
+        log_error ("%s", message);
+        break;
+    case FIBERSTAT_LOG_LEVEL_WARNING:
+        log_warning ("%s", message);
+        break;
+    case FIBERSTAT_LOG_LEVEL_INFO:
+        log_info ("%s", message);
+        break;
+    case FIBERSTAT_LOG_LEVEL_DEBUG:
+    default:
+        log_debug ("%s", message);
+        break;
+    }
+}
+
+static void
+setup_log (void)
+{
+    if (!debug)
+        return;
+    logfile = fopen (DEBUG_LOG, "w+");
+    if (logfile)
+        fiberstat_set_log_func (log_library_message, NULL);
+}
+
+static void
+teardown_log (void)
+{
+    fiberstat_set_log_func (NULL, NULL);
+    if (logfile)
+        fclose (logfile);
+}
+
+/******************************************************************************/
+/* Time helpers */
+
+static double
+timespec_diff_ms (const struct timespec *a,
+                  const struct timespec *b)
+{
+    return ((a->tv_sec - b->tv_sec) * 1000.0) + ((a->tv_nsec - b->tv_nsec) / 1000000.0);
+}
+
+static void
+timespec_add_ms (struct timespec *ts,
+                 int              ms)
+{
+    ts->tv_sec  += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Rounds up to the next multiple of the given period since the clock epoch,
+ * so that periodic wakeups of different timers fall at the same time */
+static void
+timespec_align_ms (struct timespec *ts,
+                   int              ms)
+{
+    uint64_t ns;
+    uint64_t period_ns;
+
+    period_ns = (uint64_t) ms * 1000000ULL;
+    ns = (uint64_t) ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+    ns = ((ns + period_ns - 1) / period_ns) * period_ns;
+    ts->tv_sec = ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
 /******************************************************************************/
 /* Context */
 
 #define DEFAULT_TIMEOUT_MS 1000
 static int timeout_ms = -1;
+static int background_timeout_ms;
+static bool table_view;
+static int sparkline_ms;
+
+/* DDM channels other than the TX/RX power ones, sampled and shown in the
+ * order given */
+static FiberstatChannel channels[FIBERSTAT_CHANNEL_LAST];
+static unsigned int     n_channels;
+
+#define DEFAULT_MAX_TIMEOUT_FACTOR 10
+/* kernel default, for threads that need precise wakeups */
+#define POWER_SAVE_DEFAULT_SLACK_NS 50000
+static bool power_save;
+static int  max_timeout_ms;
 
 static unsigned int  n_explicit_ifaces;
 static char        **explicit_ifaces;
 
+static char         *cache_path;
+
+#define DEFAULT_DISCOVERY_THREADS 1
+#define MAX_DISCOVERY_THREADS     64
+static int           discovery_threads = DEFAULT_DISCOVERY_THREADS;
+
+static unsigned int  fd_budget;
+
+#define DEFAULT_SAMPLER_THREADS 1
+#define MAX_SAMPLER_THREADS     64
+static int           sampler_threads = DEFAULT_SAMPLER_THREADS;
+static bool          coherent;
+static bool          stats;
+
+static char         *cpu_list;
+static cpu_set_t     sampling_cpus;
+static int           rt_priority;
+static bool          lock_memory;
+
+#define DEFAULT_CAPTURE_PERIOD_MS 10
+#define DEFAULT_CAPTURE_WINDOW_MS 1000
+static char  *capture_dir;
+static int    capture_period_ms = DEFAULT_CAPTURE_PERIOD_MS;
+static int    capture_window_ms = DEFAULT_CAPTURE_WINDOW_MS;
+static float  capture_drop_db;
+static int    capture_drop_ms;
+
+#define DEFAULT_ALARM_HYSTERESIS    1.0
+#define DEFAULT_ALARM_RAISE_HOLD_MS 0
+#define DEFAULT_ALARM_CLEAR_HOLD_MS 2000
+static bool   alarms;
+static float  alarm_tx_threshold = NAN;
+static float  alarm_rx_threshold = NAN;
+static float  alarm_hysteresis = DEFAULT_ALARM_HYSTERESIS;
+static int    alarm_raise_hold_ms = DEFAULT_ALARM_RAISE_HOLD_MS;
+static int    alarm_clear_hold_ms = DEFAULT_ALARM_CLEAR_HOLD_MS;
+static char  *alarm_log_path;
+static char  *alarm_hook;
+
+static char         *histogram_path;
+static char        **histogram_merge_paths;
+static unsigned int  n_histogram_merge_paths;
+
+/* See Change detection */
+typedef enum {
+    OUTPUT_RENDER,
+    OUTPUT_RECORD,
+    OUTPUT_LOG,
+    OUTPUT_ALARM,
+    OUTPUT_LAST
+} Output;
+
+static const char *output_str[] = {
+    [OUTPUT_RENDER] = "render",
+    [OUTPUT_RECORD] = "record",
+    [OUTPUT_LOG]    = "log",
+    [OUTPUT_ALARM]  = "alarm",
+};
+
+typedef struct {
+    float          deadband_db;
+    int            min_interval_ms;
+    int            max_interval_ms;
+    /* statistics */
+    unsigned long  n_changes;
+    unsigned long  n_suppressed;
+    unsigned long  n_reports;
+} Deadband;
+
+/* Values are shown with two decimals, so smaller changes aren't visible;
+ * the histograms of stable links still grow every second */
+#define DEFAULT_RENDER_DEADBAND_DB     0.01
+#define DEFAULT_RECORD_MAX_INTERVAL_MS 1000
+static Deadband deadbands[OUTPUT_LAST] = {
+    [OUTPUT_RENDER] = { .deadband_db = DEFAULT_RENDER_DEADBAND_DB },
+    [OUTPUT_RECORD] = { .max_interval_ms = DEFAULT_RECORD_MAX_INTERVAL_MS },
+};
+
+typedef enum {
+    GROUP_BY_PREFIX,
+    GROUP_BY_HWMON,
+} GroupBy;
+static GroupBy       group_by = GROUP_BY_PREFIX;
+static char         *groups_path;
+
+/* Expected TX/RX power thresholds of the default profile
+ * The GOOD/BAD thresholds are chosen so that they fall on row boundaries,
+ * so that we have "full blocks" printed with red and yellow; other profiles
+ * just get the rows crossing a threshold colored as the upper zone. */
+#define DEFAULT_POWER_MAX    0.0
+#define DEFAULT_POWER_GOOD -18.4
+#define DEFAULT_POWER_BAD  -21.7
+#define DEFAULT_POWER_MIN  -25.0
+/* Keeps the precomputed tables of each profile bounded */
+#define MAX_POWER_RANGE_DB  60.0
+static float         power_min = DEFAULT_POWER_MIN;
+static float         power_bad = DEFAULT_POWER_BAD;
+static float         power_good = DEFAULT_POWER_GOOD;
+static float         power_max = DEFAULT_POWER_MAX;
+static char         *profiles_path;
+
+static bool
+thresholds_valid (float min,
+                  float bad,
+                  float good,
+                  float max)
+{
+    return ((min < bad) && (bad <= good) && (good < max) && ((max - min) <= MAX_POWER_RANGE_DB));
+}
+
+/* Parses a comma separated list of channel names, e.g. "temp,bias" */
+static int
+parse_channel_list (const char *str)
+{
+    char *copy;
+    char *name;
+    char *saveptr = NULL;
+    int   status = 0;
+
+    copy = strdup (str);
+    if (!copy)
+        return -1;
+
+    n_channels = 0;
+    for (name = strtok_r (copy, ",", &saveptr); (status == 0) && name; name = strtok_r (NULL, ",", &saveptr)) {
+        FiberstatChannel channel;
+        unsigned int     i;
+
+        /* the TX/RX power channels are always shown */
+        channel = fiberstat_channel_from_name (name);
+        if ((channel == FIBERSTAT_CHANNEL_LAST) || FIBERSTAT_CHANNEL_IS_REQUIRED (channel))
+            status = -1;
+        for (i = 0; (status == 0) && (i < n_channels); i++) {
+            if (channels[i] == channel)
+                status = -1;
+        }
+        if (status == 0)
+            channels[n_channels++] = channel;
+    }
+
+    free (copy);
+    return status;
+}
+
+/* Parses a comma separated list of CPUs or CPU ranges, e.g. "0,2-3" */
+static int
+parse_cpu_list (const char *str,
+                cpu_set_t  *cpus)
+{
+    CPU_ZERO (cpus);
+    while (*str) {
+        char *end;
+        long  first;
+        long  last;
+
+        first = strtol (str, &end, 10);
+        if (end == str)
+            return -1;
+        last = first;
+        if (*end == '-') {
+            str = end + 1;
+            last = strtol (str, &end, 10);
+            if (end == str)
+                return -1;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return -1;
+        for (; first <= last; first++)
+            CPU_SET (first, cpus);
+
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return -1;
+        str = end;
+    }
+    return (CPU_COUNT (cpus) > 0) ? 0 : -1;
+}
+
+/* Parses the deadband of an output, e.g. "alarm:0.5" or "log:0.1,1000,60000" */
+static int
+parse_deadband (const char *str)
+{
+    char         name[16];
+    Deadband     deadband = { 0 };
+    unsigned int i;
+
+    if ((sscanf (str, "%15[^:]:%f,%d,%d", name, &deadband.deadband_db,
+                 &deadband.min_interval_ms, &deadband.max_interval_ms) < 2) ||
+        (deadband.deadband_db < 0.0) ||
+        (deadband.min_interval_ms < 0) ||
+        (deadband.max_interval_ms < 0) ||
+        (deadband.max_interval_ms && (deadband.max_interval_ms < deadband.min_interval_ms)))
+        return -1;
+
+    for (i = 0; i < OUTPUT_LAST; i++) {
+        if (strcmp (output_str[i], name) == 0) {
+            deadbands[i] = deadband;
+            return 0;
+        }
+    }
+    return -1;
+}
+
 static int
 lookup_explicit_interface (const char *iface)
 {
@@ -164,6 +460,19 @@ track_explicit_interface (const char *iface)
     return 0;
 }
 
+static int
+track_histogram_merge_path (const char *path)
+{
+    n_histogram_merge_paths++;
+    histogram_merge_paths = realloc (histogram_merge_paths, sizeof (char *) * n_histogram_merge_paths);
+    if (!histogram_merge_paths)
+        return -1;
+    histogram_merge_paths[n_histogram_merge_paths - 1] = strdup (path);
+    if (!histogram_merge_paths[n_histogram_merge_paths - 1])
+        return -2;
+    return 0;
+}
+
 static void
 print_help (void)
 {
@@ -173,13 +482,114 @@ print_help (void)
             "Common options:\n"
             "  -i, --iface=[IFACE]  Monitor the specific interface.\n"
             "  -t, --timeout        How often to reload values, in ms.\n"
+            "  -b, --background-timeout=[MS]\n"
+            "                       How often to reload values of interfaces\n"
+            "                       not currently shown, in ms.\n"
+            "  -l, --table          Start with the table view.\n"
+            "      --sparklines=[S] Show the power history of the last S seconds\n"
+            "                       under each box.\n"
+            "      --channels=[LIST]\n"
+            "                       Also read and show the given DDM channels:\n"
+            "                       temp, vcc and/or bias.\n"
+            "  -p, --power-save     Reduce wakeups while idle.\n"
+            "      --max-timeout=[MS]\n"
+            "                       Longest reload period while all values are\n"
+            "                       stable in power save mode, in ms.\n"
+            "  -C, --cache=[PATH]   Load and store interface discovery results in PATH.\n"
+            "      --discovery-threads=[N]\n"
+            "                       Number of threads discovering interfaces.\n"
+            "      --fd-budget=[N]  Maximum number of files kept open to read values.\n"
+            "      --sampler-threads=[N]\n"
+            "                       Number of threads reloading values.\n"
+            "      --coherent       Read all values of a reload cycle back to back.\n"
+            "      --stats          Print statistics on exit.\n"
+            "      --deadband=[OUTPUT:DB[,MIN,MAX]]\n"
+            "                       Power change needed to update an output, in dB.\n"
             "  -d, --debug          Verbose output in " DEBUG_LOG ".\n"
             "  -h, --help           Show help.\n"
             "  -v, --version        Show version.\n"
             "\n"
+            "Real-time options:\n"
+            "      --cpu=[LIST]         Run the sampling threads in the given CPUs.\n"
+            "      --rt-priority=[N]    Run the sampling threads with SCHED_FIFO priority N.\n"
+            "      --mlock              Lock and prefault the program memory.\n"
+            "\n"
+            "Capture options:\n"
+            "  -c, --capture=[DIR]          Save RX power drop events in DIR.\n"
+            "      --capture-period=[MS]    Capture sampling period, in ms.\n"
+            "      --capture-window=[MS]    Time saved before and after the event, in ms.\n"
+            "      --capture-drop=[DB,MS]   Also trigger on drops of DB dB within MS ms.\n"
+            "\n"
+            "Alarm options:\n"
+            "  -a, --alarms                     Enable TX/RX power alarms.\n"
+            "      --alarm-tx-threshold=[DBM]   TX power alarm threshold, in dBm.\n"
+            "      --alarm-rx-threshold=[DBM]   RX power alarm threshold, in dBm.\n"
+            "      --alarm-hysteresis=[DB]      Power above threshold to clear alarms, in dB.\n"
+            "      --alarm-raise-hold=[MS]      Time below threshold to raise alarms, in ms.\n"
+            "      --alarm-clear-hold=[MS]      Time above hysteresis to clear alarms, in ms.\n"
+            "      --alarm-log=[PATH]           Append alarm events to the given file.\n"
+            "      --alarm-hook=[CMD]           Run command on each alarm event.\n"
+            "\n"
+            "Histogram options:\n"
+            "      --histograms=[PATH]          Keep power histograms in the given file.\n"
+            "      --histogram-merge=[PATH]     Merge the given histograms file and exit.\n"
+            "\n"
+            "Threshold options:\n"
+            "      --thresholds=[MIN,BAD,GOOD,MAX]  Default scale and thresholds, in dBm.\n"
+            "      --profiles=[PATH]                Load threshold profiles from the given file.\n"
+            "\n"
+            "Group options:\n"
+            "      --group-by=[prefix|hwmon]    Group interfaces by name prefix or hwmon parent.\n"
+            "      --groups=[PATH]              Load explicit interface groups from the given file.\n"
+            "\n"
+            "Keys:\n"
+            "  left/right/up/down   Scroll one interface.\n"
+            "  pgup/pgdown          Scroll one page.\n"
+            "  home/end             Scroll to the first/last page.\n"
+            "  v                    Switch between box, table and histogram views.\n"
+            "  s                    Sort by name, RX margin or TX margin.\n"
+            "  g                    Switch between the group view and all interfaces.\n"
+            "  enter                Show the interfaces of the selected group.\n"
+            "  q                    Quit.\n"
+            "\n"
             "Notes:\n"
             "  * -i,--iface may be given multiple times to specify more than\n"
             "    one explicit interface to monitor.\n"
+            "  * -c,--capture triggers when RX power goes below the bad level\n"
+            "    threshold; the event window is saved with the full capture\n"
+            "    sampling resolution in a CSV file.\n"
+            "  * Alarm thresholds default to the bad power level of the profile\n"
+            "    of each interface. The alarm hook command is run through\n"
+            "    /bin/sh with the event details in the FIBERSTAT_TIME,\n"
+            "    FIBERSTAT_IFACE, FIBERSTAT_DIRECTION, FIBERSTAT_EVENT,\n"
+            "    FIBERSTAT_POWER and FIBERSTAT_SNAPSHOT environment variables.\n"
+            "  * --cpu takes a comma separated list of CPUs or ranges, e.g. 2,4-5;\n"
+            "    the reload loop, the sampler threads and the capture sampler\n"
+            "    thread run there, all other threads run anywhere without\n"
+            "    real-time priority. --stats prints how much the actual reload\n"
+            "    and capture periods deviate from the requested ones.\n"
+            "  * Each reload cycle is a numbered snapshot; with --coherent the\n"
+            "    power values of all interfaces are read back to back, and the\n"
+            "    operational states and parsing are left for afterwards.\n"
+            "  * The histogram view shows the time spent at each power level\n"
+            "    since start. With --histograms, the histograms are merged with\n"
+            "    the ones in the file on start, and saved every hour and on exit.\n"
+            "  * --histogram-merge may be given multiple times, to combine the\n"
+            "    histogram files of several units into the --histograms file.\n"
+            "  * Each line of the --profiles file either defines a profile, as\n"
+            "    'profile NAME MIN BAD GOOD MAX', or sets the profile of the\n"
+            "    interfaces matching a shell pattern, as 'iface PATTERN NAME'.\n"
+            "    Interfaces not matched use the default profile.\n"
+            "  * --deadband may be given once per output: render (redraws),\n"
+            "    record (histograms), log (debug log) or alarm. MIN and MAX are\n"
+            "    the shortest and longest times between updates of an output,\n"
+            "    in ms, or 0 for no limit. The render deadband defaults to\n"
+            "    0.01 dB, the others to 0 (any change); the record output is\n"
+            "    updated at least every second by default.\n"
+            "  * Interfaces are grouped by default by their name without the\n"
+            "    trailing number, e.g. eth_fc_1000 for eth_fc_1000_12. Each line\n"
+            "    of the --groups file gives a group name followed by the names of\n"
+            "    its interfaces; interfaces not listed are grouped by --group-by.\n"
             "\n");
 }
 
@@ -192,13 +602,78 @@ print_version (void)
             "\n");
 }
 
+enum {
+    OPTION_DISCOVERY_THREADS = 256,
+    OPTION_FD_BUDGET,
+    OPTION_SAMPLER_THREADS,
+    OPTION_COHERENT,
+    OPTION_STATS,
+    OPTION_CPU,
+    OPTION_RT_PRIORITY,
+    OPTION_MLOCK,
+    OPTION_MAX_TIMEOUT,
+    OPTION_SPARKLINES,
+    OPTION_CHANNELS,
+    OPTION_CAPTURE_PERIOD,
+    OPTION_CAPTURE_WINDOW,
+    OPTION_CAPTURE_DROP,
+    OPTION_ALARM_TX_THRESHOLD,
+    OPTION_ALARM_RX_THRESHOLD,
+    OPTION_ALARM_HYSTERESIS,
+    OPTION_ALARM_RAISE_HOLD,
+    OPTION_ALARM_CLEAR_HOLD,
+    OPTION_ALARM_LOG,
+    OPTION_ALARM_HOOK,
+    OPTION_HISTOGRAMS,
+    OPTION_HISTOGRAM_MERGE,
+    OPTION_GROUP_BY,
+    OPTION_GROUPS,
+    OPTION_THRESHOLDS,
+    OPTION_PROFILES,
+    OPTION_DEADBAND,
+};
+
 static const struct option longopts[] = {
-    { "iface",   required_argument, 0, 'i' },
-    { "timeout", required_argument, 0, 't' },
-    { "debug",   no_argument,       0, 'd' },
-    { "version", no_argument,       0, 'v' },
-    { "help",    no_argument,       0, 'h' },
-    { 0,         0,                 0, 0   },
+    { "iface",              required_argument, 0, 'i'                       },
+    { "timeout",            required_argument, 0, 't'                       },
+    { "background-timeout", required_argument, 0, 'b'                       },
+    { "table",              no_argument,       0, 'l'                       },
+    { "power-save",         no_argument,       0, 'p'                       },
+    { "sparklines",         required_argument, 0, OPTION_SPARKLINES         },
+    { "channels",           required_argument, 0, OPTION_CHANNELS           },
+    { "max-timeout",        required_argument, 0, OPTION_MAX_TIMEOUT        },
+    { "cache",              required_argument, 0, 'C'                       },
+    { "discovery-threads",  required_argument, 0, OPTION_DISCOVERY_THREADS  },
+    { "fd-budget",          required_argument, 0, OPTION_FD_BUDGET          },
+    { "sampler-threads",    required_argument, 0, OPTION_SAMPLER_THREADS    },
+    { "coherent",           no_argument,       0, OPTION_COHERENT           },
+    { "stats",              no_argument,       0, OPTION_STATS              },
+    { "deadband",           required_argument, 0, OPTION_DEADBAND           },
+    { "cpu",                required_argument, 0, OPTION_CPU                },
+    { "rt-priority",        required_argument, 0, OPTION_RT_PRIORITY        },
+    { "mlock",              no_argument,       0, OPTION_MLOCK              },
+    { "capture",            required_argument, 0, 'c'                       },
+    { "capture-period",     required_argument, 0, OPTION_CAPTURE_PERIOD     },
+    { "capture-window",     required_argument, 0, OPTION_CAPTURE_WINDOW     },
+    { "capture-drop",       required_argument, 0, OPTION_CAPTURE_DROP       },
+    { "alarms",             no_argument,       0, 'a'                       },
+    { "alarm-tx-threshold", required_argument, 0, OPTION_ALARM_TX_THRESHOLD },
+    { "alarm-rx-threshold", required_argument, 0, OPTION_ALARM_RX_THRESHOLD },
+    { "alarm-hysteresis",   required_argument, 0, OPTION_ALARM_HYSTERESIS   },
+    { "alarm-raise-hold",   required_argument, 0, OPTION_ALARM_RAISE_HOLD   },
+    { "alarm-clear-hold",   required_argument, 0, OPTION_ALARM_CLEAR_HOLD   },
+    { "alarm-log",          required_argument, 0, OPTION_ALARM_LOG          },
+    { "alarm-hook",         required_argument, 0, OPTION_ALARM_HOOK         },
+    { "histograms",         required_argument, 0, OPTION_HISTOGRAMS         },
+    { "histogram-merge",    required_argument, 0, OPTION_HISTOGRAM_MERGE    },
+    { "group-by",           required_argument, 0, OPTION_GROUP_BY           },
+    { "groups",             required_argument, 0, OPTION_GROUPS             },
+    { "thresholds",         required_argument, 0, OPTION_THRESHOLDS         },
+    { "profiles",           required_argument, 0, OPTION_PROFILES           },
+    { "debug",              no_argument,       0, 'd'                       },
+    { "version",            no_argument,       0, 'v'                       },
+    { "help",               no_argument,       0, 'h'                       },
+    { 0,                    0,                 0, 0                         },
 };
 
 static void
@@ -210,7 +685,7 @@ setup_context (int argc, char *const *argv)
         int idx = 0;
         int iarg = 0;
 
-        iarg = getopt_long (argc, argv, "i:t:dhv", longopts, &idx);
+        iarg = getopt_long (argc, argv, "i:t:b:lpC:c:adhv", longopts, &idx);
         if (iarg < 0)
             break;
 
@@ -228,6 +703,213 @@ setup_context (int argc, char *const *argv)
                 exit (EXIT_FAILURE);
             }
             break;
+        case 'l':
+            table_view = true;
+            break;
+        case 'p':
+            power_save = true;
+            break;
+        case OPTION_SPARKLINES:
+            if (atoi (optarg) <= 0) {
+                fprintf (stderr, "error: invalid sparkline history: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            sparkline_ms = atoi (optarg) * 1000;
+            break;
+        case OPTION_CHANNELS:
+            if (parse_channel_list (optarg) < 0) {
+                fprintf (stderr, "error: invalid channel list: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_MAX_TIMEOUT:
+            max_timeout_ms = atoi (optarg);
+            if (max_timeout_ms <= 0) {
+                fprintf (stderr, "error: invalid max timeout: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case 'C':
+            free (cache_path);
+            cache_path = strdup (optarg);
+            break;
+        case OPTION_DISCOVERY_THREADS:
+            discovery_threads = atoi (optarg);
+            if (discovery_threads <= 0 || discovery_threads > MAX_DISCOVERY_THREADS) {
+                fprintf (stderr, "error: invalid number of discovery threads: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_FD_BUDGET: {
+            int budget;
+
+            /* at least the three files of one interface */
+            budget = atoi (optarg);
+            if (budget < 3) {
+                fprintf (stderr, "error: invalid fd budget: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            fd_budget = budget;
+            break;
+        }
+        case OPTION_SAMPLER_THREADS:
+            sampler_threads = atoi (optarg);
+            if (sampler_threads <= 0 || sampler_threads > MAX_SAMPLER_THREADS) {
+                fprintf (stderr, "error: invalid number of sampler threads: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_COHERENT:
+            coherent = true;
+            break;
+        case OPTION_STATS:
+            stats = true;
+            break;
+        case OPTION_DEADBAND:
+            if (parse_deadband (optarg) < 0) {
+                fprintf (stderr, "error: invalid deadband: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_CPU:
+            if (parse_cpu_list (optarg, &sampling_cpus) < 0) {
+                fprintf (stderr, "error: invalid CPU list: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            free (cpu_list);
+            cpu_list = strdup (optarg);
+            break;
+        case OPTION_RT_PRIORITY:
+            rt_priority = atoi (optarg);
+            if (rt_priority < sched_get_priority_min (SCHED_FIFO) || rt_priority > sched_get_priority_max (SCHED_FIFO)) {
+                fprintf (stderr, "error: invalid real-time priority: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_MLOCK:
+            lock_memory = true;
+            break;
+        case 'b':
+            background_timeout_ms = atoi (optarg);
+            if (background_timeout_ms <= 0) {
+                fprintf (stderr, "error: invalid background timeout: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case 'c':
+            free (capture_dir);
+            capture_dir = strdup (optarg);
+            break;
+        case OPTION_CAPTURE_PERIOD:
+            capture_period_ms = atoi (optarg);
+            if (capture_period_ms <= 0) {
+                fprintf (stderr, "error: invalid capture period: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_CAPTURE_WINDOW:
+            capture_window_ms = atoi (optarg);
+            if (capture_window_ms <= 0) {
+                fprintf (stderr, "error: invalid capture window: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_CAPTURE_DROP:
+            if ((sscanf (optarg, "%f,%d", &capture_drop_db, &capture_drop_ms) != 2) ||
+                (capture_drop_db <= 0.0) || (capture_drop_ms <= 0)) {
+                fprintf (stderr, "error: invalid capture drop: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case 'a':
+            alarms = true;
+            break;
+        case OPTION_ALARM_TX_THRESHOLD:
+        case OPTION_ALARM_RX_THRESHOLD: {
+            char  *end = NULL;
+            float  threshold;
+
+            threshold = strtof (optarg, &end);
+            if (!end || *end != '\0' || end == optarg) {
+                fprintf (stderr, "error: invalid alarm threshold: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            if (iarg == OPTION_ALARM_TX_THRESHOLD)
+                alarm_tx_threshold = threshold;
+            else
+                alarm_rx_threshold = threshold;
+            alarms = true;
+            break;
+        }
+        case OPTION_ALARM_HYSTERESIS:
+            alarm_hysteresis = strtof (optarg, NULL);
+            if (alarm_hysteresis < 0.0) {
+                fprintf (stderr, "error: invalid alarm hysteresis: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            alarms = true;
+            break;
+        case OPTION_ALARM_RAISE_HOLD:
+        case OPTION_ALARM_CLEAR_HOLD: {
+            int hold_ms;
+
+            hold_ms = atoi (optarg);
+            if (hold_ms < 0) {
+                fprintf (stderr, "error: invalid alarm hold time: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            if (iarg == OPTION_ALARM_RAISE_HOLD)
+                alarm_raise_hold_ms = hold_ms;
+            else
+                alarm_clear_hold_ms = hold_ms;
+            alarms = true;
+            break;
+        }
+        case OPTION_ALARM_LOG:
+            free (alarm_log_path);
+            alarm_log_path = strdup (optarg);
+            alarms = true;
+            break;
+        case OPTION_ALARM_HOOK:
+            free (alarm_hook);
+            alarm_hook = strdup (optarg);
+            alarms = true;
+            break;
+        case OPTION_HISTOGRAMS:
+            free (histogram_path);
+            histogram_path = strdup (optarg);
+            break;
+        case OPTION_HISTOGRAM_MERGE:
+            if (track_histogram_merge_path (optarg) < 0) {
+                fprintf (stderr, "error: couldn't track histograms file to merge");
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_GROUP_BY:
+            if (strcmp (optarg, "prefix") == 0)
+                group_by = GROUP_BY_PREFIX;
+            else if (strcmp (optarg, "hwmon") == 0)
+                group_by = GROUP_BY_HWMON;
+            else {
+                fprintf (stderr, "error: invalid group mode: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_GROUPS:
+            free (groups_path);
+            groups_path = strdup (optarg);
+            break;
+        case OPTION_THRESHOLDS:
+            if ((sscanf (optarg, "%f,%f,%f,%f", &power_min, &power_bad, &power_good, &power_max) != 4) ||
+                !thresholds_valid (power_min, power_bad, power_good, power_max)) {
+                fprintf (stderr, "error: invalid thresholds: %s", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+        case OPTION_PROFILES:
+            free (profiles_path);
+            profiles_path = strdup (optarg);
+            break;
         case 'd':
             debug = true;
             break;
@@ -242,13 +924,51 @@ setup_context (int argc, char *const *argv)
 
     if (timeout_ms < 0)
         timeout_ms = DEFAULT_TIMEOUT_MS;
+
+    if (background_timeout_ms && background_timeout_ms < timeout_ms) {
+        fprintf (stderr, "error: background timeout must not be shorter than timeout");
+        exit (EXIT_FAILURE);
+    }
+
+    if (!max_timeout_ms)
+        max_timeout_ms = timeout_ms * DEFAULT_MAX_TIMEOUT_FACTOR;
+    else if (max_timeout_ms < timeout_ms) {
+        fprintf (stderr, "error: max timeout must not be shorter than timeout");
+        exit (EXIT_FAILURE);
+    }
+
+    if (capture_drop_ms && (capture_drop_ms < capture_period_ms || capture_drop_ms > capture_window_ms)) {
+        fprintf (stderr, "error: capture drop time must be between the capture period and window");
+        exit (EXIT_FAILURE);
+    }
+
+    if (n_histogram_merge_paths && !histogram_path) {
+        fprintf (stderr, "error: histograms file needed to merge histograms");
+        exit (EXIT_FAILURE);
+    }
 }
 
 /******************************************************************************/
 /* Application context */
 
-typedef struct _InterfaceInfo InterfaceInfo;
-typedef struct _HwmonInfo     HwmonInfo;
+typedef struct _InterfaceInfo  InterfaceInfo;
+typedef struct _PowerHistogram PowerHistogram;
+typedef struct _Sparkline      Sparkline;
+typedef struct _Group          Group;
+
+typedef enum {
+    VIEW_BOXES,
+    VIEW_TABLE,
+    VIEW_HISTOGRAM,
+    VIEW_LAST
+} View;
+
+typedef enum {
+    SORT_MODE_NAME,
+    SORT_MODE_RX_MARGIN,
+    SORT_MODE_TX_MARGIN,
+    SORT_MODE_LAST
+} SortMode;
 
 typedef struct {
     bool    stop;
@@ -260,19 +980,39 @@ typedef struct {
     int     max_x;
     WINDOW *header_win;
     WINDOW *content_win;
+    WINDOW *log_win;
+    char    alarm_event[128];
     bool    left_scroll_arrow;
     bool    right_scroll_arrow;
 
     InterfaceInfo **ifaces;
     unsigned int    n_ifaces;
     unsigned int    first_iface_index;
+    unsigned int    n_ifaces_per_window;
+
+    unsigned int    reload_id;
+
+    View            view;
+    SortMode        sort_mode;
+    unsigned int    name_width;
 
-    HwmonInfo    **hwmon;
-    unsigned int   n_hwmon;
+    /* group view, and group drilled down into, if any */
+    bool            groups_view;
+    unsigned int    selected_group;
+    unsigned int    first_group_index;
+    unsigned int    n_groups_per_window;
+    Group          *group;
+
+    struct timespec start_time;
+    bool            discovering;
+    char            discovery_progress[64];
+
+    FiberstatHwmonList hwmon_list;
 } Context;
 
 static Context context = {
     .resize = true,
+    .hwmon_list = { .mutex = PTHREAD_MUTEX_INITIALIZER },
 };
 
 static void
@@ -345,6 +1085,8 @@ typedef enum {
     COLOR_PAIR_BOX_TEXT_WHITE,
 } ColorPair;
 
+#define LOG_HEIGHT (alarms ? 1 : 0)
+
 static void
 setup_windows (void)
 {
@@ -381,286 +1123,632 @@ setup_windows (void)
     /* content window */
     if (context.content_win)
         delwin (context.content_win);
-    context.content_win = newwin (context.max_y - 1, context.max_x, 1, 0);
+    context.content_win = newwin (context.max_y - 1 - LOG_HEIGHT, context.max_x, 1, 0);
     wbkgd (context.content_win, COLOR_PAIR (COLOR_PAIR_MAIN));
 
-    context.refresh_title    = true;
-    context.refresh_contents = true;
-}
-
-/******************************************************************************/
+    /* log window, only needed to show alarm events */
+    if (context.log_win)
+        delwin (context.log_win);
+    context.log_win = NULL;
+    if (LOG_HEIGHT) {
+        context.log_win = newwin (LOG_HEIGHT, context.max_x, context.max_y - LOG_HEIGHT, 0);
+        wbkgd (context.log_win, COLOR_PAIR (COLOR_PAIR_MAIN));
+    }
 
-/* Expected TX/RX power threshold
- * The GOOD/BAD thresholds are chosen so that the 'ignored partial' values
- * computed while on high res are 0, so that we have "full blocks" printed
- * with red and yellow. */
-#define POWER_MAX    0.0
-#define POWER_GOOD -18.4
-#define POWER_BAD  -21.7
-#define POWER_MIN  -25.0
-#define POWER_UNK  -40.0
+    /* the amount of visible interfaces is unknown until the next layout,
+     * so make sure all get reloaded before that */
+    context.n_ifaces_per_window = 0;
 
-static float
-power_to_percentage (float power)
-{
-    if (power >= POWER_MAX)
-        return 100.0;
-    if (power <= POWER_MIN)
-        return 0.0;
-    return 100.0 * (power - POWER_MIN) / (POWER_MAX - POWER_MIN);
+    context.refresh_title    = true;
+    context.refresh_contents = true;
+    context.refresh_log      = true;
 }
 
 /******************************************************************************/
-/* List of hwmon entries */
-
-#define PHANDLE_SIZE_BYTES 4
+/* Threshold profiles
+ *
+ * The scale of the level bars and the bad/good thresholds are given by a
+ * profile per interface, e.g. so that long range and short range optics may
+ * use different power budgets. The default profile is given with the
+ * --thresholds option, and more profiles, with the shell patterns of the
+ * interfaces using them, may be loaded from a file.
+ *
+ * Everything needed to draw the bars of each profile is precomputed in
+ * tables once the profiles are loaded (see Profile tables).
+ */
 
-#define HWMON_SYSFS_DIR              SYSFS_PREFIX "/sys/class/hwmon"
-#define HWMON_POWER1_INPUT_FILE      "power1_input"
-#define HWMON_POWER2_INPUT_FILE      "power2_input"
-#define HWMON_POWER1_LABEL_FILE      "power1_label"
-#define HWMON_POWER2_LABEL_FILE      "power2_label"
-#define HWMON_TX_POWER_LABEL_CONTENT "TX_power"
-#define HWMON_RX_POWER_LABEL_CONTENT "RX_power"
-#define HWMON_PHANDLE_FILE           "of_node/phandle"
+#define POWER_UNK FIBERSTAT_POWER_UNKNOWN
 
-typedef struct _HwmonInfo {
-    char    *name;
-    char    *tx_power_path;
-    char    *rx_power_path;
-    uint8_t  sfp_phandle[PHANDLE_SIZE_BYTES];
-} HwmonInfo;
+typedef struct _ProfileTables ProfileTables;
 
-static void
-hwmon_info_free (HwmonInfo *info)
-{
-    free (info->tx_power_path);
-    free (info->rx_power_path);
-    free (info->name);
-    free (info);
-}
+typedef struct {
+    char          *name;
+    float          min;
+    float          bad;
+    float          good;
+    float          max;
+    ProfileTables *tables;
+} ThresholdProfile;
 
-static void
-teardown_hwmon_list (void)
+typedef struct {
+    char             *pattern;
+    ThresholdProfile *profile;
+} ProfileMatch;
+
+static struct {
+    /* the first one is the default one */
+    ThresholdProfile **profiles;
+    unsigned int       n_profiles;
+    /* in the order given, the first match wins */
+    ProfileMatch      *matches;
+    unsigned int       n_matches;
+} profiles;
+
+static ThresholdProfile *
+lookup_profile (const char *name)
 {
     unsigned int i;
 
-    for (i = 0; i < context.n_hwmon; i++)
-        hwmon_info_free (context.hwmon[i]);
-    free (context.hwmon);
+    for (i = 0; i < profiles.n_profiles; i++) {
+        if (strcmp (profiles.profiles[i]->name, name) == 0)
+            return profiles.profiles[i];
+    }
+    return NULL;
 }
 
-static HwmonInfo *
-lookup_hwmon (const uint8_t *phandle)
+/* Profiles are never modified once loaded, so this is safe to use from the
+ * discovery threads */
+static ThresholdProfile *
+lookup_interface_profile (const char *iface)
 {
     unsigned int i;
 
-    for (i = 0; i < context.n_hwmon; i++) {
-        if (memcmp (context.hwmon[i]->sfp_phandle, phandle, PHANDLE_SIZE_BYTES) == 0)
-            return context.hwmon[i];
+    for (i = 0; i < profiles.n_matches; i++) {
+        if (fnmatch (profiles.matches[i].pattern, iface, 0) == 0)
+            return profiles.matches[i].profile;
     }
-    return NULL;
+    return profiles.profiles[0];
 }
 
-static bool
-check_file_contents (const char *path,
-                     const char *contents)
+static int
+add_profile (const char *name,
+             float       min,
+             float       bad,
+             float       good,
+             float       max)
 {
-    int    fd;
-    bool   result;
-    int    n_read;
-    char   aux[255];
-    size_t contents_size;
-
-    fd = open (path, O_RDONLY);
-    if (fd < 0)
-        return false;
+    ThresholdProfile  *profile;
+    ThresholdProfile **array;
 
-    if (!contents) {
-        result = true;
-        goto out;
+    if (lookup_profile (name)) {
+        log_error ("duplicate threshold profile: %s", name);
+        return -1;
+    }
+    if (!thresholds_valid (min, bad, good, max)) {
+        log_error ("invalid thresholds in profile %s", name);
+        return -1;
     }
 
-    contents_size = strlen (contents);
-    n_read = read (fd, aux, contents_size);
-    result = ((n_read == contents_size) && strncmp (aux, contents, n_read) == 0);
-
-out:
-    close (fd);
-    return result;
+    profile = calloc (1, sizeof (ThresholdProfile));
+    if (!profile)
+        return -1;
+    profile->name = strdup (name);
+    array = realloc (profiles.profiles, sizeof (ThresholdProfile *) * (profiles.n_profiles + 1));
+    if (!profile->name || !array) {
+        free (profile->name);
+        free (profile);
+        return -1;
+    }
+    profile->min = min;
+    profile->bad = bad;
+    profile->good = good;
+    profile->max = max;
+    profiles.profiles = array;
+    profiles.profiles[profiles.n_profiles++] = profile;
+    return 0;
 }
 
-static bool
-check_file_exists (const char *path)
+static int
+add_profile_match (const char *pattern,
+                   const char *name)
 {
-    return check_file_contents (path, NULL);
+    ThresholdProfile *profile;
+    ProfileMatch     *array;
+
+    profile = lookup_profile (name);
+    if (!profile) {
+        log_error ("unknown threshold profile: %s", name);
+        return -1;
+    }
+
+    array = realloc (profiles.matches, sizeof (ProfileMatch) * (profiles.n_matches + 1));
+    if (!array)
+        return -1;
+    profiles.matches = array;
+    profiles.matches[profiles.n_matches].pattern = strdup (pattern);
+    profiles.matches[profiles.n_matches].profile = profile;
+    if (!profiles.matches[profiles.n_matches].pattern)
+        return -1;
+    profiles.n_matches++;
+    return 0;
 }
 
-static bool
-load_power_input_file_paths (const char  *hwmon,
-                             char       **out_tx_file_path,
-                             char       **out_rx_file_path)
+static int
+load_profiles_line (char *line)
 {
-    char  path[PATH_MAX];
-    char *tx_file_path = NULL;
-    char *rx_file_path = NULL;
+    char *saveptr = NULL;
+    char *keyword;
+    char *args[5];
+    int   n_args = 0;
+
+    line[strcspn (line, "#\n")] = '\0';
+    keyword = strtok_r (line, " \t", &saveptr);
+    if (!keyword)
+        return 0;
 
-    snprintf (path, sizeof (path), HWMON_SYSFS_DIR "/%s/" HWMON_POWER1_LABEL_FILE, hwmon);
-    if (!check_file_contents (path, HWMON_TX_POWER_LABEL_CONTENT)) {
-        log_debug ("hwmon '%s' doesn't have expected tx power label file", hwmon);
-        goto out;
-    }
+    while (n_args < 5 && (args[n_args] = strtok_r (NULL, " \t", &saveptr)) != NULL)
+        n_args++;
+    if (strtok_r (NULL, " \t", &saveptr))
+        return -1;
 
-    snprintf (path, sizeof (path), HWMON_SYSFS_DIR "/%s/" HWMON_POWER2_LABEL_FILE, hwmon);
-    if (!check_file_contents (path, HWMON_RX_POWER_LABEL_CONTENT)) {
-        log_debug ("hwmon '%s' doesn't have expected rx power label file", hwmon);
-        goto out;
-    }
+    if ((strcmp (keyword, "profile") == 0) && (n_args == 5))
+        return add_profile (args[0], atof (args[1]), atof (args[2]), atof (args[3]), atof (args[4]));
+    if ((strcmp (keyword, "iface") == 0) && (n_args == 2))
+        return add_profile_match (args[0], args[1]);
+    return -1;
+}
 
-    snprintf (path, sizeof (path), HWMON_SYSFS_DIR "/%s/" HWMON_POWER1_INPUT_FILE, hwmon);
-    if (!check_file_exists (path)) {
-        log_debug ("hwmon '%s' doesn't have tx power input file", hwmon);
-        goto out;
-    }
-    tx_file_path = strdup (path);
+static int
+load_profiles (void)
+{
+    char   *line = NULL;
+    size_t  line_size = 0;
+    FILE   *f;
+    int     status = 0;
+
+    if (add_profile ("default", power_min, power_bad, power_good, power_max) < 0)
+        return -1;
 
-    snprintf (path, sizeof (path), HWMON_SYSFS_DIR "/%s/" HWMON_POWER2_INPUT_FILE, hwmon);
-    if (!check_file_exists (path)) {
-        log_debug ("hwmon '%s' doesn't have rx power input file", hwmon);
-        goto out;
+    if (!profiles_path)
+        return 0;
+
+    f = fopen (profiles_path, "r");
+    if (!f) {
+        log_error ("couldn't open profiles file %s: %s", profiles_path, strerror (errno));
+        return -1;
     }
-    rx_file_path = strdup (path);
 
-out:
-    if (tx_file_path && rx_file_path) {
-        *out_tx_file_path = tx_file_path;
-        *out_rx_file_path = rx_file_path;
-        return true;
+    while ((status == 0) && (getline (&line, &line_size, f) > 0))
+        status = load_profiles_line (line);
+
+    free (line);
+    fclose (f);
+
+    if (status < 0) {
+        log_error ("invalid profiles file %s", profiles_path);
+        return status;
     }
 
-    free (tx_file_path);
-    free (rx_file_path);
-    return false;
+    log_info ("profiles loaded from %s: %u profiles, %u interface patterns",
+              profiles_path, profiles.n_profiles - 1, profiles.n_matches);
+    return 0;
 }
 
+/* Zones shown in red, yellow and green */
+typedef enum {
+    POWER_ZONE_BAD,
+    POWER_ZONE_LOW,
+    POWER_ZONE_GOOD,
+    POWER_N_ZONES
+} PowerZone;
+
+static const int power_zone_color[] = {
+    [POWER_ZONE_BAD]  = COLOR_PAIR_BOX_TEXT_RED,
+    [POWER_ZONE_LOW]  = COLOR_PAIR_BOX_TEXT_YELLOW,
+    [POWER_ZONE_GOOD] = COLOR_PAIR_BOX_TEXT_GREEN,
+};
+
+static PowerZone
+power_zone (const ThresholdProfile *profile,
+            float                   power)
+{
+    if (power < profile->bad)
+        return POWER_ZONE_BAD;
+    if (power < profile->good)
+        return POWER_ZONE_LOW;
+    return POWER_ZONE_GOOD;
+}
+
+/* Alarm thresholds not given default to the bad level of the profile */
+static float
+alarm_threshold (float                   threshold,
+                 const ThresholdProfile *profile)
+{
+    return isnan (threshold) ? profile->bad : threshold;
+}
+
+/******************************************************************************/
+/* Alarms
+ *
+ * Each interface has one alarm state machine per direction, evaluated with
+ * every new sample:
+ *
+ *   CLEAR ----(power < threshold)----> RAISING ---(raise hold elapsed)--> RAISED
+ *     ^                                                                     |
+ *     |                                                (power >= threshold + hysteresis)
+ *     |                                                                     v
+ *     +-----------------------(clear hold elapsed)------------------- CLEARING
+ *
+ * Going back to the previous condition while RAISING or CLEARING cancels the
+ * transition, so that values oscillating around the threshold don't generate
+ * alarm events.
+ */
+
+typedef enum {
+    ALARM_STATE_CLEAR,
+    ALARM_STATE_RAISING,
+    ALARM_STATE_RAISED,
+    ALARM_STATE_CLEARING,
+} AlarmState;
+
+typedef struct {
+    AlarmState      state;
+    struct timespec since;
+    unsigned int    n_raised;
+} Alarm;
+
+static FILE *alarm_log;
+
 static bool
-load_hwmon_phandle (const char *hwmon,
-                    uint8_t    *phandle)
+alarm_is_raised (const Alarm *alarm)
 {
-    char path[PATH_MAX];
-    int  fd;
-    int  n_read;
+    return (alarm->state == ALARM_STATE_RAISED || alarm->state == ALARM_STATE_CLEARING);
+}
 
-    snprintf (path, sizeof (path), HWMON_SYSFS_DIR "/%s/" HWMON_PHANDLE_FILE, hwmon);
-    fd = open (path, O_RDONLY);
-    if (fd < 0) {
-        log_debug ("hwmon '%s' doesn't have sfp phandle file", hwmon);
-        return false;
-    }
+/* Environment variables given to the hook, besides the inherited ones */
+static const char *alarm_hook_vars[] = {
+    "FIBERSTAT_TIME",
+    "FIBERSTAT_IFACE",
+    "FIBERSTAT_DIRECTION",
+    "FIBERSTAT_EVENT",
+    "FIBERSTAT_POWER",
+    "FIBERSTAT_SNAPSHOT",
+};
 
-    n_read = read (fd, phandle, PHANDLE_SIZE_BYTES);
-    close (fd);
+#define N_ALARM_HOOK_VARS (sizeof (alarm_hook_vars) / sizeof (alarm_hook_vars[0]))
 
-    if (n_read < PHANDLE_SIZE_BYTES) {
-        log_warning ("couldn't read hwmon '%s' sfp phandle file", hwmon);
-        return false;
-    }
+static bool
+alarm_hook_var_is_overridden (const char *entry)
+{
+    unsigned int i;
+
+    for (i = 0; i < N_ALARM_HOOK_VARS; i++) {
+        size_t len = strlen (alarm_hook_vars[i]);
 
-    return true;
+        if ((strncmp (entry, alarm_hook_vars[i], len) == 0) && (entry[len] == '='))
+            return true;
+    }
+    return false;
 }
 
-static int
-setup_hwmon_list (void)
+/* The arguments and the environment of the hook are built before spawning
+ * it, so that the child only execs, with its output going to /dev/null */
+static void
+alarm_run_hook (const char    *time_str,
+                const char    *iface,
+                const char    *direction,
+                const char    *event,
+                float          power,
+                unsigned long  snapshot_id)
 {
-    DIR           *d;
-    struct dirent *dir;
+    posix_spawn_file_actions_t   actions;
+    char                        *argv[4];
+    char                       **envp;
+    char                         vars[N_ALARM_HOOK_VARS][128];
+    char                         power_str[16];
+    char                         snapshot_str[24];
+    const char                  *values[N_ALARM_HOOK_VARS];
+    unsigned int                 n_environ;
+    unsigned int                 n_envp = 0;
+    unsigned int                 i;
+    pid_t                        pid;
+    int                          status;
+
+    snprintf (power_str, sizeof (power_str), "%.2f", power);
+    snprintf (snapshot_str, sizeof (snapshot_str), "%lu", snapshot_id);
+    values[0] = time_str;
+    values[1] = iface;
+    values[2] = direction;
+    values[3] = event;
+    values[4] = power_str;
+    values[5] = snapshot_str;
+
+    for (n_environ = 0; environ && environ[n_environ]; n_environ++);
+    envp = malloc (sizeof (char *) * (n_environ + N_ALARM_HOOK_VARS + 1));
+    if (!envp) {
+        log_warning ("couldn't run alarm hook: %s", strerror (ENOMEM));
+        return;
+    }
+    for (i = 0; i < n_environ; i++) {
+        if (!alarm_hook_var_is_overridden (environ[i]))
+            envp[n_envp++] = environ[i];
+    }
+    for (i = 0; i < N_ALARM_HOOK_VARS; i++) {
+        snprintf (vars[i], sizeof (vars[i]), "%s=%s", alarm_hook_vars[i], values[i]);
+        envp[n_envp++] = vars[i];
+    }
+    envp[n_envp] = NULL;
+
+    argv[0] = (char *) "sh";
+    argv[1] = (char *) "-c";
+    argv[2] = alarm_hook;
+    argv[3] = NULL;
+
+    /* keep the hook output out of the terminal */
+    status = posix_spawn_file_actions_init (&actions);
+    if (status == 0) {
+        if (((status = posix_spawn_file_actions_addopen (&actions, STDIN_FILENO, "/dev/null", O_RDWR, 0)) == 0) &&
+            ((status = posix_spawn_file_actions_adddup2 (&actions, STDIN_FILENO, STDOUT_FILENO)) == 0) &&
+            ((status = posix_spawn_file_actions_adddup2 (&actions, STDIN_FILENO, STDERR_FILENO)) == 0))
+            status = posix_spawn (&pid, "/bin/sh", &actions, NULL, argv, envp);
+        posix_spawn_file_actions_destroy (&actions);
+    }
+    if (status != 0)
+        log_warning ("couldn't run alarm hook: %s", strerror (status));
 
-    d = opendir (HWMON_SYSFS_DIR);
-    if (!d)
-        return -1;
+    free (envp);
+}
 
-    while ((dir = readdir(d)) != NULL) {
-        char      *tx_file_path = NULL;
-        char      *rx_file_path = NULL;
-        uint8_t    phandle[PHANDLE_SIZE_BYTES];
-        HwmonInfo *info;
+static void
+alarm_emit_event (const char    *iface,
+                  const char    *direction,
+                  const char    *event,
+                  float          power,
+                  float          threshold,
+                  unsigned long  snapshot_id)
+{
+    struct timespec now;
+    struct tm       tm;
+    char            stamp[32];
+    char            time_str[64];
+
+    clock_gettime (CLOCK_REALTIME, &now);
+    localtime_r (&now.tv_sec, &tm);
+    strftime (stamp, sizeof (stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf (time_str, sizeof (time_str), "%s.%03ld", stamp, now.tv_nsec / 1000000L);
+
+    snprintf (context.alarm_event, sizeof (context.alarm_event),
+              "%s %s %s alarm %s: %.2f dBm (threshold %.2f dBm, snapshot %lu)",
+              time_str, iface, direction, event, power, threshold, snapshot_id);
+    context.refresh_log = true;
+    context.refresh_contents = true;
+    log_info ("%s", context.alarm_event);
 
-        if ((strcmp (dir->d_name, ".") == 0) || (strcmp (dir->d_name, "..") == 0))
-            continue;
+    if (alarm_log) {
+        fprintf (alarm_log, "%s\n", context.alarm_event);
+        fflush (alarm_log);
+    }
 
-        if (!load_power_input_file_paths (dir->d_name, &tx_file_path, &rx_file_path))
-            continue;
+    if (alarm_hook)
+        alarm_run_hook (time_str, iface, direction, event, power, snapshot_id);
+}
 
-        if (!load_hwmon_phandle (dir->d_name, phandle)) {
-            free (tx_file_path);
-            free (rx_file_path);
-            continue;
+/* Hold times are measured with the time the power value was read */
+static void
+alarm_update (Alarm                 *alarm,
+              const char            *iface,
+              const char            *direction,
+              float                  power,
+              float                  threshold,
+              const struct timespec *now,
+              unsigned long          snapshot_id)
+{
+    switch (alarm->state) {
+    case ALARM_STATE_CLEAR:
+        if (power >= threshold)
+            break;
+        alarm->state = ALARM_STATE_RAISING;
+        alarm->since = *now;
+        /* fall through */
+    case ALARM_STATE_RAISING:
+        if (power >= threshold)
+            alarm->state = ALARM_STATE_CLEAR;
+        else if (timespec_diff_ms (now, &alarm->since) >= alarm_raise_hold_ms) {
+            alarm->state = ALARM_STATE_RAISED;
+            alarm->n_raised++;
+            alarm_emit_event (iface, direction, "raised", power, threshold, snapshot_id);
+        }
+        break;
+    case ALARM_STATE_RAISED:
+        if (power < threshold + alarm_hysteresis)
+            break;
+        alarm->state = ALARM_STATE_CLEARING;
+        alarm->since = *now;
+        /* fall through */
+    case ALARM_STATE_CLEARING:
+        if (power < threshold + alarm_hysteresis)
+            alarm->state = ALARM_STATE_RAISED;
+        else if (timespec_diff_ms (now, &alarm->since) >= alarm_clear_hold_ms) {
+            alarm->state = ALARM_STATE_CLEAR;
+            alarm_emit_event (iface, direction, "cleared", power, threshold, snapshot_id);
         }
+        break;
+    default:
+        assert (0);
+    }
+}
 
-        /* valid hwmon entry */
+static bool
+alarm_is_holding (const Alarm *alarm)
+{
+    return ((alarm->state == ALARM_STATE_RAISING) || (alarm->state == ALARM_STATE_CLEARING));
+}
 
-        info = calloc (sizeof (HwmonInfo), 1);
-        if (info)
-            info->name = strdup (dir->d_name);
-        if (!info || !info->name) {
-            free (tx_file_path);
-            free (rx_file_path);
-            return -2;
-        }
+static void
+teardown_alarms (void)
+{
+    if (alarm_log)
+        fclose (alarm_log);
+}
 
-        info->tx_power_path = tx_file_path;
-        info->rx_power_path = rx_file_path;
-        memcpy (info->sfp_phandle, phandle, sizeof (phandle));
+static int
+setup_alarms (void)
+{
+    struct sigaction actchld;
 
-        context.n_hwmon++;
-        context.hwmon = realloc (context.hwmon, sizeof (HwmonInfo *) * context.n_hwmon);
-        if (!context.hwmon)
-            return -3;
-        context.hwmon[context.n_hwmon - 1] = info;
+    if (!alarms)
+        return 0;
 
-        log_info ("hwmon '%s' is a valid monitor with sfp handle %02x:%02x:%02x:%02x",
-                  dir->d_name, phandle[0], phandle[1], phandle[2], phandle[3]);
+    if (alarm_log_path) {
+        alarm_log = fopen (alarm_log_path, "a");
+        if (!alarm_log) {
+            log_error ("couldn't open alarm log %s: %s", alarm_log_path, strerror (errno));
+            return -1;
+        }
     }
 
-    if (context.n_hwmon > 0)
-        log_info ("hwmon entries found: %u", context.n_hwmon);
-    else
-        log_error ("no hwmon entries found");
+    /* hooks are never waited for, let the kernel reap them */
+    if (alarm_hook) {
+        sigemptyset (&actchld.sa_mask);
+        actchld.sa_flags = SA_NOCLDWAIT;
+        actchld.sa_handler = SIG_IGN;
+        if (sigaction (SIGCHLD, &actchld, NULL) < 0)
+            return -2;
+    }
 
-    closedir (d);
+    log_info ("alarms enabled: TX threshold %.2f dBm, RX threshold %.2f dBm, hysteresis %.2f dB, hold %d/%d ms",
+              alarm_tx_threshold, alarm_rx_threshold, alarm_hysteresis,
+              alarm_raise_hold_ms, alarm_clear_hold_ms);
+    if (isnan (alarm_tx_threshold) || isnan (alarm_rx_threshold))
+        log_info ("alarm thresholds not given use the bad level of the profile of each interface");
     return 0;
 }
 
+/******************************************************************************/
+/* List of hwmon entries
+ *
+ * The sysfs access and the hwmon entry list are provided by libfiberstat;
+ * files are only kept open after discovery when there's no fd budget.
+ */
+
+static int
+discover_hwmon (const char *name,
+                int         hwmon_fd)
+{
+    /* with a fd budget, files are opened when needed */
+    return fiberstat_hwmon_discover (&context.hwmon_list, name, hwmon_fd, !fd_budget);
+}
+
 /******************************************************************************/
 /* List of interfaces */
 
-#define NET_SYSFS_DIR      SYSFS_PREFIX "/sys/class/net"
-#define NET_PHANDLE_FILE   "of_node/sfp"
-#define NET_OPERSTATE_FILE "operstate"
+/* See Interface ordering */
+typedef struct _OrderNode OrderNode;
+struct _OrderNode {
+    OrderNode    *left;
+    OrderNode    *right;
+    uint32_t      priority;
+    unsigned int  size;
+    float         margin;
+};
+
+/* Values updated in the last reload cycle */
+#define SAMPLE_UPDATE_TX_POWER  (1 << 0)
+#define SAMPLE_UPDATE_RX_POWER  (1 << 1)
+#define SAMPLE_UPDATE_OPERSTATE (1 << 2)
+#define SAMPLE_UPDATE_CHANNELS  (1 << 3)
+#define SAMPLE_UPDATE_ERROR     (1 << 4)
+#define SAMPLE_UPDATE_POWER     (SAMPLE_UPDATE_TX_POWER | SAMPLE_UPDATE_RX_POWER)
+
+/* Values last given to an output, see Change detection */
+typedef struct {
+    float            tx_power;
+    float            rx_power;
+    struct timespec  time;
+    unsigned int     pending;
+    bool             started;
+} Report;
 
 typedef struct _InterfaceInfo {
-    char      *name;
-    HwmonInfo *hwmon;
-    char      *operstate_path;
-    int        tx_power_fd;
-    int        rx_power_fd;
-    int        operstate_fd;
-    float      tx_power;
-    float      rx_power;
-    char      *operstate;
+    char              *name;
+    FiberstatHwmon    *hwmon;
+    ThresholdProfile  *profile;
+    char              *operstate_path;
+    FiberstatFile      tx_power_file;
+    FiberstatFile      rx_power_file;
+    FiberstatFile      operstate_file;
+    float              tx_power;
+    float              rx_power;
+    FiberstatOperstate operstate;
+    /* one per channel given with --channels, if any */
+    FiberstatFile     *channel_files;
+    float             *channel_values;
+    Alarm              tx_alarm;
+    Alarm              rx_alarm;
+    struct timespec    last_reload;
+    unsigned int       visible_reload_id;
+    bool               files_open;
+    InterfaceInfo     *lru_prev;
+    InterfaceInfo     *lru_next;
+    unsigned int       sample_updates;
+    const char        *sample_error;
+    Report             reports[OUTPUT_LAST];
+    unsigned long      snapshot_id;
+    PowerHistogram    *histograms;
+    Sparkline         *sparklines;
+    Group             *group;
+    float              group_rx_power;
+    bool               health_tracked;
+    bool               health_stale;
+    uint8_t            health_zone;
+    uint8_t            health_operstate;
+    OrderNode          order_node;
+    uint8_t           *sort_key;
+    size_t             sort_key_len;
 } InterfaceInfo;
 
+static void
+interface_close_files (InterfaceInfo *iface)
+{
+    unsigned int i;
+
+    fiberstat_file_close (&iface->tx_power_file);
+    fiberstat_file_close (&iface->rx_power_file);
+    fiberstat_file_close (&iface->operstate_file);
+    for (i = 0; iface->channel_files && (i < n_channels); i++)
+        fiberstat_file_close (&iface->channel_files[i]);
+}
+
+/* Short description of the files failing, if any */
+static const char *
+interface_error (const InterfaceInfo *iface)
+{
+    bool tx_failed;
+    bool rx_failed;
+
+    tx_failed = fiberstat_file_is_failed (&iface->tx_power_file);
+    rx_failed = fiberstat_file_is_failed (&iface->rx_power_file);
+    if (tx_failed && rx_failed)
+        return "tx/rx error";
+    if (tx_failed)
+        return "tx error";
+    if (rx_failed)
+        return "rx error";
+    if (fiberstat_file_is_failed (&iface->operstate_file))
+        return "state error";
+    return NULL;
+}
+
 static void
 interface_info_free (InterfaceInfo *iface)
 {
-    if (!(iface->tx_power_fd < 0))
-        close (iface->tx_power_fd);
-    if (!(iface->rx_power_fd < 0))
-        close (iface->rx_power_fd);
-    if (!(iface->operstate_fd < 0))
-        close (iface->operstate_fd);
+    interface_close_files (iface);
+    free (iface->channel_files);
+    free (iface->channel_values);
     free (iface->operstate_path);
-    free (iface->operstate);
+    free (iface->histograms);
+    free (iface->sparklines);
+    free (iface->sort_key);
     free (iface->name);
     free (iface);
 }
@@ -668,113 +1756,247 @@ interface_info_free (InterfaceInfo *iface)
 static void
 teardown_interfaces (void)
 {
-    unsigned int i;
+    unsigned int        i;
+    FiberstatSysfsStats sysfs_stats;
 
     for (i = 0; i < context.n_ifaces; i++)
         interface_info_free (context.ifaces[i]);
     free (context.ifaces);
+    context.ifaces = NULL;
+    context.n_ifaces = 0;
+
+    fiberstat_get_sysfs_stats (&sysfs_stats);
+    if (sysfs_stats.n_reopens)
+        log_info ("%u attempts to open failing files again", sysfs_stats.n_reopens);
 }
 
-static bool
-load_interface_phandle (const char *iface,
-                        uint8_t    *phandle)
+/*
+ * Interface names are converted once into a binary natural sort key, so that
+ * comparisons are just a memcmp() instead of tokenizing both names again with
+ * strnatcmp() on every comparison, giving the same order as strnatcmp() (as
+ * used by the library). Non-digit characters are copied as they are, and
+ * every run of digits is replaced by:
+ *   - a marker byte, sorting where digits sort among the other characters,
+ *   - the number of digits,
+ *   - the digits themselves.
+ * E.g. "eth_fc_1000_12" becomes "eth_fc_" '0' 4 "1000" '_' '0' 2 "12", so that
+ * a longer number always sorts after a shorter one.
+ *
+ * Leading zeros are significant: strnatcmp() compares runs of digits starting
+ * with a zero digit by digit, as fractional parts, and before any number not
+ * starting with a zero, e.g. "a05" < "a1" and "a0" < "a00". Those runs are
+ * given with a zero number of digits instead, followed by the digits and a
+ * zero terminator, e.g. "a05" becomes "a" '0' 0 "05" 0.
+ */
+
+#define SORT_KEY_NUMBER_MARKER '0'
+
+static uint8_t *
+sort_key_new (const char *str,
+              size_t     *out_len)
 {
-    char path[PATH_MAX];
-    int  fd;
-    int  n_read;
+    uint8_t *key;
+    size_t   len = 0;
 
-    snprintf (path, sizeof (path), NET_SYSFS_DIR "/%s/" NET_PHANDLE_FILE, iface);
-    fd = open (path, O_RDONLY);
-    if (fd < 0) {
-        log_debug ("iface '%s' doesn't have sfp phandle file", iface);
-        return false;
-    }
+    /* worst case is a single zero digit between non-digits, taking 4 bytes */
+    key = malloc ((strlen (str) * 4) + 1);
+    if (!key)
+        return NULL;
 
-    n_read = read (fd, phandle, PHANDLE_SIZE_BYTES);
-    close (fd);
+    while (*str) {
+        const char *start;
+        size_t      n_digits;
 
-    if (n_read < PHANDLE_SIZE_BYTES) {
-        log_warning ("couldn't read iface '%s' sfp phandle file", iface);
-        return false;
+        if (!isdigit ((unsigned char) *str)) {
+            key[len++] = *str++;
+            continue;
+        }
+
+        start = str;
+        while (isdigit ((unsigned char) *str))
+            str++;
+        n_digits = str - start;
+
+        key[len++] = SORT_KEY_NUMBER_MARKER;
+        if (*start == '0') {
+            key[len++] = 0;
+            memcpy (&key[len], start, n_digits);
+            len += n_digits;
+            key[len++] = 0;
+            continue;
+        }
+
+        if (n_digits > UINT8_MAX)
+            n_digits = UINT8_MAX;
+        key[len++] = (uint8_t) n_digits;
+        memcpy (&key[len], start, n_digits);
+        len += n_digits;
     }
 
-    return true;
+    *out_len = len;
+    return key;
 }
 
 static int
 compare_interface (const void *a, const void *b)
 {
-    return strnatcmp ((*((InterfaceInfo **)a))->name, (*((InterfaceInfo **)b))->name);
+    const InterfaceInfo *iface_a = *((InterfaceInfo **)a);
+    const InterfaceInfo *iface_b = *((InterfaceInfo **)b);
+    int                  result;
+
+    result = memcmp (iface_a->sort_key, iface_b->sort_key,
+                     (iface_a->sort_key_len < iface_b->sort_key_len) ? iface_a->sort_key_len : iface_b->sort_key_len);
+    if (result)
+        return result;
+    if (iface_a->sort_key_len != iface_b->sort_key_len)
+        return (iface_a->sort_key_len < iface_b->sort_key_len) ? -1 : 1;
+    return 0;
+}
+
+/* Opens the files not open yet; the operstate file relative to the given net
+ * entry directory, if any. Failing files are opened again within the limit
+ * of the given reload cycle, if any. Returns the number of files not open,
+ * not counting the ones of channels the module doesn't have. */
+static unsigned int
+interface_open_files (InterfaceInfo      *iface,
+                      FiberstatFileCycle *cycle,
+                      int                 iface_fd)
+{
+    FiberstatHwmon *hwmon = iface->hwmon;
+    unsigned int    n_failed = 0;
+    unsigned int    i;
+
+    /* the power input files may have been opened already during discovery */
+    if (iface->tx_power_file.fd < 0)
+        iface->tx_power_file.fd = __atomic_exchange_n (&hwmon->tx_power_fd, -1, __ATOMIC_ACQ_REL);
+    if (iface->rx_power_file.fd < 0)
+        iface->rx_power_file.fd = __atomic_exchange_n (&hwmon->rx_power_fd, -1, __ATOMIC_ACQ_REL);
+
+    fiberstat_file_open (&iface->tx_power_file, cycle, -1, NULL);
+    fiberstat_file_open (&iface->rx_power_file, cycle, -1, NULL);
+    fiberstat_file_open (&iface->operstate_file, cycle, iface_fd, FIBERSTAT_OPERSTATE_FILE);
+
+    for (i = 0; iface->channel_files && (i < n_channels); i++) {
+        if (!iface->channel_files[i].path)
+            continue;
+        fiberstat_file_open (&iface->channel_files[i], cycle, -1, NULL);
+        n_failed += (iface->channel_files[i].fd < 0);
+    }
+
+    return n_failed + (iface->tx_power_file.fd < 0) + (iface->rx_power_file.fd < 0) + (iface->operstate_file.fd < 0);
 }
 
+/* The files of the channels given with --channels, unknown until read */
 static int
-setup_interfaces (void)
+interface_setup_channels (InterfaceInfo *iface)
 {
-    DIR           *d;
-    struct dirent *dir;
+    unsigned int i;
 
-    d = opendir (NET_SYSFS_DIR);
-    if (!d)
+    if (!n_channels)
+        return 0;
+
+    iface->channel_files = calloc (n_channels, sizeof (FiberstatFile));
+    iface->channel_values = calloc (n_channels, sizeof (float));
+    if (!iface->channel_files || !iface->channel_values)
         return -1;
 
-    while ((dir = readdir(d)) != NULL) {
-        InterfaceInfo *iface;
-        char           path[PATH_MAX];
-        HwmonInfo     *hwmon = NULL;
-        uint8_t        phandle[PHANDLE_SIZE_BYTES];
+    for (i = 0; i < n_channels; i++) {
+        /* interfaces without hwmon (e.g. test ones) have no files */
+        fiberstat_file_init (&iface->channel_files[i], iface->hwmon ? iface->hwmon->paths[channels[i]] : NULL);
+        iface->channel_values[i] = fiberstat_channel_get_info (channels[i])->unknown;
+    }
+    return 0;
+}
 
-        if ((strcmp (dir->d_name, ".") == 0) || (strcmp (dir->d_name, "..") == 0))
-            continue;
+/* Whether all the files of the interface exist, even if not kept open */
+static bool
+interface_files_available (const InterfaceInfo *iface)
+{
+    if (!fd_budget)
+        return (!(iface->tx_power_file.fd < 0) && !(iface->rx_power_file.fd < 0) && !(iface->operstate_file.fd < 0));
 
-        if (n_explicit_ifaces && lookup_explicit_interface (dir->d_name) < 0)
-            continue;
+    return ((access (iface->hwmon->paths[FIBERSTAT_CHANNEL_TX_POWER], R_OK) == 0) &&
+            (access (iface->hwmon->paths[FIBERSTAT_CHANNEL_RX_POWER], R_OK) == 0) &&
+            (access (iface->operstate_path, R_OK) == 0));
+}
 
-        if (!load_interface_phandle (dir->d_name, phandle))
-            continue;
+static InterfaceInfo *
+interface_info_new (const char *name,
+                    int         iface_fd,
+                    FiberstatHwmon  *hwmon)
+{
+    InterfaceInfo *iface;
+    char           path[PATH_MAX];
 
-        hwmon = lookup_hwmon (phandle);
-        if (!hwmon) {
-            log_warning ("couldn't match hwmon entry for net iface '%s'", dir->d_name);
-            continue;
+    iface = calloc (1, sizeof (InterfaceInfo));
+    if (iface) {
+        iface->name = strdup (name);
+        iface->sort_key = sort_key_new (name, &iface->sort_key_len);
+    }
+    if (!iface || !iface->name || !iface->sort_key) {
+        if (iface) {
+            free (iface->name);
+            free (iface->sort_key);
+            free (iface);
         }
+        return NULL;
+    }
 
-        iface = calloc (1, sizeof (InterfaceInfo));
-        if (iface)
-            iface->name = strdup (dir->d_name);
-        if (!iface || !iface->name)
-            return -2;
+    log_info ("tracking interface '%s'...", iface->name);
+
+    snprintf (path, sizeof (path), "%s/%s/" FIBERSTAT_OPERSTATE_FILE, fiberstat_get_net_dir (), iface->name);
+    iface->operstate_path = strdup (path);
+
+    iface->hwmon = hwmon;
+    iface->profile = lookup_interface_profile (iface->name);
+    iface->tx_power = iface->profile->min;
+    iface->rx_power = iface->profile->min;
+    fiberstat_file_init (&iface->tx_power_file, hwmon->paths[FIBERSTAT_CHANNEL_TX_POWER]);
+    fiberstat_file_init (&iface->rx_power_file, hwmon->paths[FIBERSTAT_CHANNEL_RX_POWER]);
+    fiberstat_file_init (&iface->operstate_file, iface->operstate_path);
+    if (interface_setup_channels (iface) < 0) {
+        interface_info_free (iface);
+        return NULL;
+    }
 
-        log_info ("tracking interface '%s'...", iface->name);
+    /* with a fd budget, files are opened when needed */
+    if (fd_budget)
+        return iface;
 
-        iface->hwmon = hwmon;
-        iface->tx_power = POWER_MIN;
-        iface->rx_power = POWER_MIN;
-        iface->tx_power_fd = -1;
-        iface->rx_power_fd = -1;
-        iface->operstate_fd = -1;
+    interface_open_files (iface, NULL, iface_fd);
+    if (iface->tx_power_file.fd < 0)
+        log_warning ("couldn't open TX power file for interface '%s' at %s", iface->name, iface->tx_power_file.path);
+    if (iface->rx_power_file.fd < 0)
+        log_warning ("couldn't open RX power file for interface '%s' at %s", iface->name, iface->rx_power_file.path);
+    if (iface->operstate_file.fd < 0)
+        log_warning ("couldn't open operstate file for interface '%s' at %s", iface->name, iface->operstate_path);
 
-        iface->tx_power_fd = open (hwmon->tx_power_path, O_RDONLY);
-        iface->rx_power_fd = open (hwmon->rx_power_path, O_RDONLY);
-        if (iface->tx_power_fd < 0)
-            log_warning ("couldn't open TX power file for interface '%s' at %s", iface->name, hwmon->tx_power_path);
-        if (iface->rx_power_fd < 0)
-            log_warning ("couldn't open RX power file for interface '%s' at %s", iface->name, hwmon->rx_power_path);
+    return iface;
+}
 
-        snprintf (path, sizeof (path), NET_SYSFS_DIR "/%s/" NET_OPERSTATE_FILE, iface->name);
-        iface->operstate_path = strdup (path);
-        iface->operstate_fd = open (iface->operstate_path, O_RDONLY);
-        if (iface->operstate_fd < 0)
-            log_warning ("couldn't open operstate file for interface '%s' at %s", iface->name, iface->operstate_path);
+static int
+track_interface (const char *name,
+                 FiberstatHwmon  *hwmon)
+{
+    InterfaceInfo *iface;
 
-        context.n_ifaces++;
-        context.ifaces = realloc (context.ifaces, sizeof (InterfaceInfo *) * context.n_ifaces);
-        if (!context.ifaces)
-            return -3;
-        context.ifaces[context.n_ifaces - 1] = iface;
-    }
+    iface = interface_info_new (name, -1, hwmon);
+    if (!iface)
+        return -2;
 
-    closedir (d);
+    context.n_ifaces++;
+    context.ifaces = realloc (context.ifaces, sizeof (InterfaceInfo *) * context.n_ifaces);
+    if (!context.ifaces)
+        return -3;
+    context.ifaces[context.n_ifaces - 1] = iface;
+    return 0;
+}
 
+/* Common steps once all interfaces have been tracked, either after scanning
+ * sysfs or after loading the discovery cache */
+static int
+finish_interfaces (void)
+{
     /* error if some of the explicit interfaces were not found */
     if (n_explicit_ifaces && (n_explicit_ifaces != context.n_ifaces)) {
         unsigned int i;
@@ -808,11 +2030,15 @@ setup_interfaces (void)
                 if (!iface)
                     return -2;
                 iface->name = strdup (context.ifaces[i]->name);
-                iface->tx_power = POWER_MIN;
-                iface->rx_power = POWER_MIN;
-                iface->tx_power_fd = -1;
-                iface->rx_power_fd = -1;
-                iface->operstate_fd = -1;
+                iface->sort_key = sort_key_new (iface->name, &iface->sort_key_len);
+                iface->profile = lookup_interface_profile (iface->name);
+                iface->tx_power = iface->profile->min;
+                iface->rx_power = iface->profile->min;
+                fiberstat_file_init (&iface->tx_power_file, NULL);
+                fiberstat_file_init (&iface->rx_power_file, NULL);
+                fiberstat_file_init (&iface->operstate_file, NULL);
+                if (interface_setup_channels (iface) < 0)
+                    return -2;
 
                 context.n_ifaces++;
                 context.ifaces = realloc (context.ifaces, sizeof (InterfaceInfo *) * context.n_ifaces);
@@ -831,543 +2057,4844 @@ setup_interfaces (void)
     return 0;
 }
 
-/******************************************************************************/
+/* Sets the output interface to NULL if the net entry isn't a valid one */
+static int
+discover_interface (const char     *name,
+                    int             iface_fd,
+                    InterfaceInfo **out_iface)
+{
+    FiberstatHwmon *hwmon;
 
-typedef enum {
-    BOX_CHARSET_ASCII,
-    BOX_CHARSET_UTF8,
-} BoxCharset;
+    *out_iface = NULL;
 
-static const char *VRT[] = { [BOX_CHARSET_ASCII] = "|", [BOX_CHARSET_UTF8] = "│" };
-static const char *HRZ[] = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "─" };
-static const char *TL[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "┌" };
-static const char *TR[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "┐" };
-static const char *BL[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "└" };
-static const char *BR[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "┘" };
+    if (n_explicit_ifaces && lookup_explicit_interface (name) < 0)
+        return 0;
 
-/* When using UTF-8, we can use a block fill from 1/8 to 8/8 */
-static const int   RESOLUTION[] = { [BOX_CHARSET_ASCII] = 1, [BOX_CHARSET_UTF8] = 8 };
-static const char *BLK[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+    hwmon = fiberstat_net_lookup_hwmon (&context.hwmon_list, name, iface_fd);
+    if (!hwmon)
+        return 0;
 
-static BoxCharset current_box_charset = BOX_CHARSET_ASCII;
+    *out_iface = interface_info_new (name, iface_fd, hwmon);
+    return (*out_iface ? 0 : -2);
+}
 
-/*
- * The information for one single interface is exposed as follows:
- *   ┌────┐ ┌────┐
- *   │    │ │    │
- *   │    │ │    │
- *   │    │ │    │
- *   │    │ │    │   The height of the interface info section is 21:
- *   │    │ │    │      box:        17 chars (15 content, 2 border)
- *   │    │ │    │      box info:    2 chars
- *   │    │ │    │      iface info:  2 chars
- *   │    │ │    │
- *   │    │ │    │   The minimum width of the interface info section is 13:
- *   │    │ │    │      TX box:         6 chars (4 content, 2 border)
- *   │    │ │    │      box separation: 1 char
- *   │    │ │    │      RX box:         6 chars (4 content, 2 border)
- *   │    │ │    │
- *   │    │ │    │
- *   └────┘ └────┘
- *   -20,00 -17,50     ----> TX/RX values in dBm   (box info)
- *   TX dBm RX dBm     ----> Box info              (box info)
- *        lo           ----> Interface name        (iface info)
- *   link unknown      ----> Link state            (iface info)
+
+/******************************************************************************/
+/* Discovery cache
  *
- * The height of the bar is defined so that the whole interface takes
- * a maximum of 21 chars, because on serial terminals a window height
- * of 23 chars max is assumed as default and we don't want to take more
- * than that:
- *     1 char for app title
- *     21 chars for interface
- *     1 empty line to avoid cursor rewriting the last printed line
+ * Resolving which hwmon entry belongs to which network interface requires
+ * opening and reading several files per hwmon and net entry, which is slow
+ * on some embedded targets. The result of the discovery may be stored in a
+ * cache file, which is considered valid as long as the system hasn't been
+ * rebooted (same boot id), no hwmon or net entry has been added or removed
+ * and the same explicit interfaces are requested. The modification times of
+ * the sysfs directories aren't enough to detect hot-plugged entries (kernfs
+ * doesn't always update them), so the sorted names of the entries are part
+ * of the key as well:
+ *
+ *   fiberstat-discovery-cache 3
+ *   boot_id 2f0a4c6e-...
+ *   hwmon_mtime 1571234567.123456789
+ *   net_mtime 1571234567.123456789
+ *   hwmon_entries hwmon0,hwmon1,hwmon3
+ *   net_entries eth0,eth1,lo
+ *   explicit eth0,eth1
+ *   hwmon hwmon3 00000012 /sys/class/hwmon/hwmon3/power1_input /sys/class/hwmon/hwmon3/power2_input temp=/sys/class/hwmon/hwmon3/temp1_input
+ *   iface eth0 hwmon3
+ *
+ * The optional channels found in each hwmon entry follow the power input
+ * files, as NAME=PATH.
  */
 
-#define BOX_CONTENT_WIDTH   4
-#define BOX_BORDER_WIDTH    2
-#define BOX_WIDTH           (BOX_CONTENT_WIDTH + BOX_BORDER_WIDTH)
-#define BOX_CONTENT_HEIGHT  15
-#define BOX_BORDER_HEIGHT   2
-#define BOX_INFO_HEIGHT     2
-#define BOX_HEIGHT          (BOX_CONTENT_HEIGHT + BOX_BORDER_HEIGHT + BOX_INFO_HEIGHT)
-#define BOX_SEPARATION      1
+#define DISCOVERY_CACHE_MAGIC "fiberstat-discovery-cache 3"
+#define BOOT_ID_FILE          "/proc/sys/kernel/random/boot_id"
 
-#define IFACE_INFO_HEIGHT   2
+static int
+filter_dir_entry (const struct dirent *dir)
+{
+    return ((strcmp (dir->d_name, ".") != 0) && (strcmp (dir->d_name, "..") != 0));
+}
 
-#define INTERFACE_WIDTH  (BOX_WIDTH + BOX_SEPARATION + BOX_WIDTH)
-#define INTERFACE_HEIGHT (BOX_HEIGHT + IFACE_INFO_HEIGHT)
-
-static void
-print_box (int         x,
-           int         y,
-           float       power,
-           bool        apply_thresholds,
-           const char *label)
-{
-    static unsigned int resolution = 0;
-    static int          max_level_fill_height = 0;
-    static int          max_level_fill_height_n = 0;
-    static int          good_level_fill_height = 0;
-    static int          good_level_fill_height_n = 0;
-    static int          bad_level_fill_height = 0;
-    static int          bad_level_fill_height_n = 0;
-    static int          row_color_green = 0;
-    static int          row_color_yellow = 0;
-    static int          row_color_red = 0;
-    static int          row_color_white = 0;
-    char                buf[32];
-    unsigned int        i;
-    unsigned int        j;
-    float               fill_percent;
-    float               fill_scaled;
-    unsigned int        fill_height;
-    unsigned int        fill_height_n;
-    unsigned int        fill_height_partial = 0; /* 0-7 */
-    unsigned int        x_center;
-
-    /* initialize resolution info, only the first time we run */
-    if (resolution == 0) {
-        resolution = RESOLUTION[current_box_charset];
-        /* when using low res, we change the background color and we use a
-         * space as character. */
-        if (resolution == 1) {
-            row_color_green  = COLOR_PAIR (COLOR_PAIR_BOX_BACKGROUND_GREEN);
-            row_color_yellow = COLOR_PAIR (COLOR_PAIR_BOX_BACKGROUND_YELLOW);
-            row_color_red    = COLOR_PAIR (COLOR_PAIR_BOX_BACKGROUND_RED);
-            row_color_white  = COLOR_PAIR (COLOR_PAIR_BOX_BACKGROUND_WHITE);
-        }
-        /* when using high res, we change foreground color and we use partial
-         * block characters */
-        else {
-            row_color_green  = COLOR_PAIR (COLOR_PAIR_BOX_TEXT_GREEN);
-            row_color_yellow = COLOR_PAIR (COLOR_PAIR_BOX_TEXT_YELLOW);
-            row_color_red    = COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED);
-            row_color_white  = COLOR_PAIR (COLOR_PAIR_BOX_TEXT_WHITE);
-        }
+/* Byte order, not depending on the locale */
+static int
+compare_dir_entry (const struct dirent **a, const struct dirent **b)
+{
+    return strcmp ((*a)->d_name, (*b)->d_name);
+}
 
-        /* setup max level info */
-        fill_percent = power_to_percentage (POWER_MAX);
-        fill_scaled = ((float) fill_percent * BOX_CONTENT_HEIGHT * resolution) / 100.0;
-        fill_height = floor (fill_scaled + 0.5);
-        fill_height_n = fill_height / resolution;
-        fill_height_partial = fill_height % resolution;
-        max_level_fill_height = fill_height;
-        max_level_fill_height_n = fill_height_n;
-        log_debug ("max level fill percent: %.1f, fill height: %u (res: %u, N %u, partial ignored %u), per-step power: %.2f dBm",
-                   fill_percent, max_level_fill_height, resolution, max_level_fill_height_n, fill_height_partial,
-                   (POWER_MAX - POWER_MIN) / fill_height);
-        assert (fill_height_partial == 0);
-
-        /* setup good level info */
-        fill_percent = power_to_percentage (POWER_GOOD);
-        fill_scaled = ((float) fill_percent * BOX_CONTENT_HEIGHT * resolution) / 100.0;
-        fill_height = floor (fill_scaled + 0.5);
-        fill_height_n = fill_height / resolution;
-        fill_height_partial = fill_height % resolution;
-        good_level_fill_height = fill_height;
-        good_level_fill_height_n = fill_height_n;
-        log_debug ("good level fill percent: %.1f, fill height: %u (res: %u, N %u, partial ignored %u), power: %.2f dBm",
-                   fill_percent, good_level_fill_height, resolution, good_level_fill_height_n, fill_height_partial, POWER_GOOD);
-        assert (fill_height_partial == 0);
-
-        /* setup bad level info */
-        fill_percent = power_to_percentage (POWER_BAD);
-        fill_scaled = ((float) fill_percent * BOX_CONTENT_HEIGHT * resolution) / 100.0;
-        fill_height = floor (fill_scaled + 0.5);
-        fill_height_n = fill_height / resolution;
-        fill_height_partial = fill_height % resolution;
-        bad_level_fill_height = fill_height;
-        bad_level_fill_height_n = fill_height_n;
-        log_debug ("bad level fill percent: %.1f, fill height: %u (res: %u, N %u, partial ignored %u), power: %.2f dBm",
-                   fill_percent, bad_level_fill_height, resolution, bad_level_fill_height_n, fill_height_partial, POWER_BAD);
-        assert (fill_height_partial == 0);
-    }
-
-    fill_percent = power_to_percentage (power);
-    fill_scaled = ((float) fill_percent * BOX_CONTENT_HEIGHT * resolution) / 100.0;
-    fill_height = floor (fill_scaled + 0.5);
-    fill_height_n = fill_height / resolution;
-    fill_height_partial = fill_height % resolution;
-    log_debug ("fill percent: %.1f, fill height: %u (res: %u, N %u, partial %u), power: %.2f dBm",
-               fill_percent, fill_height, resolution, fill_height_n, fill_height_partial, power);
+static int
+print_dir_entries (FILE       *f,
+                   const char *type,
+                   const char *dir_path)
+{
+    struct dirent **entries;
+    int             n_entries;
+    int             i;
 
-    /* box */
-    mvwprintw (context.content_win, y, x, "%s", TL[current_box_charset]);
-    for (i = 0; i < BOX_CONTENT_WIDTH; i++)
-        mvwprintw (context.content_win, y, x+1+i, "%s", HRZ[current_box_charset]);
-    mvwprintw (context.content_win, y, x+1+BOX_CONTENT_WIDTH, "%s", TR[current_box_charset]);
-    for (i = 0; i < BOX_CONTENT_HEIGHT; i++) {
+    n_entries = scandir (dir_path, &entries, filter_dir_entry, compare_dir_entry);
+    if (n_entries < 0)
+        return -1;
+
+    fprintf (f, "%s_entries ", type);
+    for (i = 0; i < n_entries; i++) {
+        fprintf (f, "%s%s", i ? "," : "", entries[i]->d_name);
+        free (entries[i]);
+    }
+    fputc ('\n', f);
+    free (entries);
+    return 0;
+}
+
+/* The key is allocated, and must be freed by the caller */
+static int
+load_discovery_cache_key (char **out_key)
+{
+    char         boot_id[64] = { 0 };
+    struct stat  hwmon_st;
+    struct stat  net_st;
+    int          fd;
+    ssize_t      n_read;
+    FILE        *f;
+    char        *key = NULL;
+    size_t       key_size = 0;
+    int          status = 0;
+    unsigned int i;
+
+    fd = open (BOOT_ID_FILE, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    n_read = read (fd, boot_id, sizeof (boot_id) - 1);
+    close (fd);
+    if (n_read <= 0)
+        return -1;
+    boot_id[strcspn (boot_id, "\n")] = '\0';
+
+    if ((fstatat (AT_FDCWD, fiberstat_get_hwmon_dir (), &hwmon_st, 0) < 0) ||
+        (fstatat (AT_FDCWD, fiberstat_get_net_dir (), &net_st, 0) < 0))
+        return -1;
+
+    f = open_memstream (&key, &key_size);
+    if (!f)
+        return -1;
+
+    fprintf (f,
+             DISCOVERY_CACHE_MAGIC "\n"
+             "boot_id %s\n"
+             "hwmon_mtime %lld.%09ld\n"
+             "net_mtime %lld.%09ld\n",
+             boot_id,
+             (long long) hwmon_st.st_mtim.tv_sec, hwmon_st.st_mtim.tv_nsec,
+             (long long) net_st.st_mtim.tv_sec, net_st.st_mtim.tv_nsec);
+    if ((print_dir_entries (f, "hwmon", fiberstat_get_hwmon_dir ()) < 0) ||
+        (print_dir_entries (f, "net", fiberstat_get_net_dir ()) < 0))
+        status = -1;
+    fputs ("explicit ", f);
+    for (i = 0; i < n_explicit_ifaces; i++)
+        fprintf (f, "%s%s", i ? "," : "", explicit_ifaces[i]);
+    fputc ('\n', f);
+
+    if ((fclose (f) != 0) || (status < 0)) {
+        free (key);
+        return -1;
+    }
+
+    *out_key = key;
+    return 0;
+}
+
+static int
+load_discovery_cache_line (char *line)
+{
+    char    *saveptr = NULL;
+    char    *type;
+    char    *name;
+    char    *phandle_str;
+    char    *tx_path;
+    char    *rx_path;
+    char    *channel_str;
+    char    *paths[FIBERSTAT_CHANNEL_LAST] = { NULL };
+    uint8_t  phandle[FIBERSTAT_PHANDLE_SIZE];
+    uint32_t phandle_value;
+    unsigned int i;
+
+    line[strcspn (line, "\n")] = '\0';
+    type = strtok_r (line, " ", &saveptr);
+    name = strtok_r (NULL, " ", &saveptr);
+    if (!type || !name)
+        return -1;
+
+    if (strcmp (type, "hwmon") == 0) {
+        phandle_str = strtok_r (NULL, " ", &saveptr);
+        tx_path = strtok_r (NULL, " ", &saveptr);
+        rx_path = strtok_r (NULL, " ", &saveptr);
+        if (!phandle_str || !tx_path || !rx_path)
+            return -1;
+        phandle_value = strtoul (phandle_str, NULL, 16);
+        for (i = 0; i < FIBERSTAT_PHANDLE_SIZE; i++)
+            phandle[i] = (phandle_value >> (8 * (FIBERSTAT_PHANDLE_SIZE - 1 - i))) & 0xff;
+        paths[FIBERSTAT_CHANNEL_TX_POWER] = strdup (tx_path);
+        paths[FIBERSTAT_CHANNEL_RX_POWER] = strdup (rx_path);
+        while ((channel_str = strtok_r (NULL, " ", &saveptr)) != NULL) {
+            FiberstatChannel  channel;
+            char             *path;
+
+            path = strchr (channel_str, '=');
+            if (path)
+                *path++ = '\0';
+            channel = path ? fiberstat_channel_from_name (channel_str) : FIBERSTAT_CHANNEL_LAST;
+            if ((channel == FIBERSTAT_CHANNEL_LAST) || paths[channel]) {
+                for (i = 0; i < FIBERSTAT_CHANNEL_LAST; i++)
+                    free (paths[i]);
+                return -1;
+            }
+            paths[channel] = strdup (path);
+        }
+        return fiberstat_hwmon_list_add (&context.hwmon_list, name, paths, -1, -1, phandle);
+    }
+
+    if (strcmp (type, "iface") == 0) {
+        char *hwmon_name;
+
+        hwmon_name = strtok_r (NULL, " ", &saveptr);
+        if (!hwmon_name)
+            return -1;
+        for (i = 0; i < context.hwmon_list.n_hwmon; i++) {
+            if (strcmp (context.hwmon_list.hwmon[i]->name, hwmon_name) == 0)
+                return track_interface (name, context.hwmon_list.hwmon[i]);
+        }
+        return -1;
+    }
+
+    return -1;
+}
+
+static int
+load_discovery_cache (void)
+{
+    char        *key = NULL;
+    char        *line = NULL;
+    size_t       line_size = 0;
+    size_t       key_len;
+    FILE        *f;
+    int          status = 0;
+    unsigned int i;
+
+    if (load_discovery_cache_key (&key) < 0) {
+        log_warning ("couldn't load discovery cache key");
+        return -1;
+    }
+
+    f = fopen (cache_path, "r");
+    if (!f) {
+        log_info ("no discovery cache available at %s", cache_path);
+        free (key);
+        return -1;
+    }
+
+    /* the key is given as the first lines of the file */
+    key_len = strlen (key);
+    for (i = 0; (status == 0) && (i < key_len); ) {
+        ssize_t n_read;
+
+        n_read = getline (&line, &line_size, f);
+        if ((n_read <= 0) || (i + n_read > key_len) || (strncmp (&key[i], line, n_read) != 0))
+            status = -1;
+        else
+            i += n_read;
+    }
+
+    if (status < 0)
+        log_info ("discovery cache at %s is outdated", cache_path);
+    else {
+        while ((status == 0) && (getline (&line, &line_size, f) > 0))
+            status = load_discovery_cache_line (line);
+        if (status < 0)
+            log_warning ("discovery cache at %s is invalid", cache_path);
+    }
+
+    free (line);
+    free (key);
+    fclose (f);
+
+    /* the cache is no longer valid if some of the files went away */
+    for (i = 0; (status == 0) && (i < context.n_ifaces); i++) {
+        if (!interface_files_available (context.ifaces[i]))
+            status = -1;
+    }
+
+    if (status == 0)
+        status = finish_interfaces ();
+
+    if (status < 0) {
+        teardown_interfaces ();
+        fiberstat_hwmon_list_clear (&context.hwmon_list);
+        return -1;
+    }
+
+    log_info ("discovery loaded from cache at %s", cache_path);
+    return 0;
+}
+
+static void
+save_discovery_cache (void)
+{
+    char        *key = NULL;
+    char         tmp_path[PATH_MAX];
+    FILE        *f;
+    unsigned int i;
+
+    if (load_discovery_cache_key (&key) < 0) {
+        log_warning ("couldn't load discovery cache key");
+        return;
+    }
+
+    /* write to a temporary file first, so that the cache is replaced
+     * atomically */
+    snprintf (tmp_path, sizeof (tmp_path), "%s.tmp", cache_path);
+    f = fopen (tmp_path, "w");
+    if (!f) {
+        log_warning ("couldn't create discovery cache at %s: %s", tmp_path, strerror (errno));
+        free (key);
+        return;
+    }
+
+    fputs (key, f);
+    free (key);
+    for (i = 0; i < context.hwmon_list.n_hwmon; i++) {
+        const FiberstatHwmon *hwmon = context.hwmon_list.hwmon[i];
+        unsigned int          j;
+
+        fprintf (f, "hwmon %s %02x%02x%02x%02x %s %s",
+                 hwmon->name,
+                 hwmon->sfp_phandle[0], hwmon->sfp_phandle[1], hwmon->sfp_phandle[2], hwmon->sfp_phandle[3],
+                 hwmon->paths[FIBERSTAT_CHANNEL_TX_POWER], hwmon->paths[FIBERSTAT_CHANNEL_RX_POWER]);
+        for (j = 0; j < FIBERSTAT_CHANNEL_LAST; j++) {
+            if (!FIBERSTAT_CHANNEL_IS_REQUIRED (j) && hwmon->paths[j])
+                fprintf (f, " %s=%s", fiberstat_channel_get_info ((FiberstatChannel) j)->name, hwmon->paths[j]);
+        }
+        fputc ('\n', f);
+    }
+    for (i = 0; i < context.n_ifaces; i++) {
+        /* test interfaces have no hwmon */
+        if (context.ifaces[i]->hwmon)
+            fprintf (f, "iface %s %s\n", context.ifaces[i]->name, context.ifaces[i]->hwmon->name);
+    }
+
+    if ((fclose (f) != 0) || (rename (tmp_path, cache_path) < 0)) {
+        log_warning ("couldn't save discovery cache at %s: %s", cache_path, strerror (errno));
+        unlink (tmp_path);
+        return;
+    }
+
+    log_info ("discovery saved in cache at %s", cache_path);
+}
+
+/******************************************************************************/
+/* Power histograms
+ *
+ * In order to know how much time each link spent at each power level over
+ * long runs, a fixed size histogram is kept for each interface and direction,
+ * with the time spent at each level instead of the raw history. Power levels
+ * are already logarithmic in dBm, so fixed size buckets in dBm give the same
+ * relative precision at all levels, as in HDR histograms: 0.25 dB buckets are
+ * within 6% of the value in mW. Time with unknown power (e.g. read errors or
+ * no light at all) is kept apart.
+ *
+ * Each reload adds the time since the previous one to the bucket of the
+ * previous value, so updates are O(1) and interfaces reloaded less often
+ * still give the right distribution.
+ *
+ * Histograms may be saved to a file, where they're given as plain text lines
+ * with the non-empty buckets, e.g.:
+ *   eth_fc_1000_1 rx 3600000000 0 84:1800000000 85:1800000000
+ * Histograms of the same interface and direction are merged just by adding
+ * up the times of each bucket, so files from several runs or several units
+ * may be combined. Entries for interfaces not currently monitored are kept
+ * as they are.
+ */
+
+#define HISTOGRAM_MIN_DBM        -40
+#define HISTOGRAM_MAX_DBM          8
+#define HISTOGRAM_BUCKETS_PER_DB   4
+#define HISTOGRAM_N_BUCKETS      ((HISTOGRAM_MAX_DBM - HISTOGRAM_MIN_DBM) * HISTOGRAM_BUCKETS_PER_DB)
+
+#define HISTOGRAM_FILE_MAGIC     "fiberstat-histograms 1"
+#define HISTOGRAM_SAVE_PERIOD_MS (60 * 60 * 1000)
+
+typedef enum {
+    HISTOGRAM_TX,
+    HISTOGRAM_RX,
+    HISTOGRAM_N_DIRECTIONS
+} HistogramDirection;
+
+static const char *histogram_direction_str[] = {
+    [HISTOGRAM_TX] = "tx",
+    [HISTOGRAM_RX] = "rx",
+};
+
+/* Times in us */
+struct _PowerHistogram {
+    uint64_t        buckets[HISTOGRAM_N_BUCKETS];
+    uint64_t        unknown;
+    uint64_t        total;
+    bool            started;
+    float           last_power;
+    struct timespec last_time;
+};
+
+/* Histograms loaded for interfaces not currently monitored */
+typedef struct {
+    char           *name;
+    PowerHistogram  histograms[HISTOGRAM_N_DIRECTIONS];
+} HistogramEntry;
+
+static struct {
+    bool             loaded;
+    HistogramEntry  *orphans;
+    unsigned int     n_orphans;
+    struct timespec  last_save;
+} histogram;
+
+static unsigned int
+histogram_bucket (float power)
+{
+    int i;
+
+    i = (int) floor ((power - HISTOGRAM_MIN_DBM) * HISTOGRAM_BUCKETS_PER_DB);
+    if (i < 0)
+        return 0;
+    if (i >= HISTOGRAM_N_BUCKETS)
+        return HISTOGRAM_N_BUCKETS - 1;
+    return (unsigned int) i;
+}
+
+static float
+histogram_bucket_power (unsigned int i)
+{
+    return HISTOGRAM_MIN_DBM + ((i + 0.5) / HISTOGRAM_BUCKETS_PER_DB);
+}
+
+static void
+histogram_update (PowerHistogram        *hist,
+                  float                  power,
+                  const struct timespec *time)
+{
+    if (hist->started) {
+        double elapsed_ms;
+
+        elapsed_ms = timespec_diff_ms (time, &hist->last_time);
+        if (elapsed_ms > 0) {
+            uint64_t elapsed_us;
+
+            elapsed_us = (uint64_t) (elapsed_ms * 1000.0 + 0.5);
+            if (hist->last_power <= POWER_UNK)
+                hist->unknown += elapsed_us;
+            else
+                hist->buckets[histogram_bucket (hist->last_power)] += elapsed_us;
+            hist->total += elapsed_us;
+        }
+    }
+
+    hist->started = true;
+    hist->last_power = power;
+    hist->last_time = *time;
+}
+
+static void
+histogram_merge (PowerHistogram       *hist,
+                 const PowerHistogram *other)
+{
+    unsigned int i;
+
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+        hist->buckets[i] += other->buckets[i];
+    hist->unknown += other->unknown;
+    hist->total += other->total;
+}
+
+/* Power below which the given percentage of the time was spent; unknown
+ * power counts as the lowest level */
+static float
+histogram_percentile (const PowerHistogram *hist,
+                      double                percentile)
+{
+    uint64_t     target;
+    uint64_t     accumulated;
+    unsigned int i;
+
+    if (!hist || !hist->total)
+        return NAN;
+
+    target = (uint64_t) ceil (hist->total * percentile / 100.0);
+    if (!target)
+        target = 1;
+
+    accumulated = hist->unknown;
+    if (accumulated >= target)
+        return POWER_UNK;
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        accumulated += hist->buckets[i];
+        if (accumulated >= target)
+            return histogram_bucket_power (i);
+    }
+    return histogram_bucket_power (HISTOGRAM_N_BUCKETS - 1);
+}
+
+/* The power holds between updates, so only the power values reported to the
+ * record output are needed. Failing files still count, as unknown power read
+ * at the start of the cycle. */
+static void
+interface_update_histograms (InterfaceInfo         *iface,
+                             unsigned int           updates,
+                             const struct timespec *cycle_start)
+{
+    if (!iface->histograms) {
+        iface->histograms = calloc (HISTOGRAM_N_DIRECTIONS, sizeof (PowerHistogram));
+        if (!iface->histograms)
+            return;
+    }
+
+    if (updates & SAMPLE_UPDATE_TX_POWER)
+        histogram_update (&iface->histograms[HISTOGRAM_TX], iface->tx_power,
+                          (iface->tx_power_file.n_read < 0) ? cycle_start : &iface->tx_power_file.read_time);
+    if (updates & SAMPLE_UPDATE_RX_POWER)
+        histogram_update (&iface->histograms[HISTOGRAM_RX], iface->rx_power,
+                          (iface->rx_power_file.n_read < 0) ? cycle_start : &iface->rx_power_file.read_time);
+}
+
+/* Accounts the time the last power values have held until now */
+static void
+flush_histograms (const struct timespec *now)
+{
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < context.n_ifaces; i++) {
+        PowerHistogram *hists = context.ifaces[i]->histograms;
+
+        for (j = 0; hists && (j < HISTOGRAM_N_DIRECTIONS); j++) {
+            if (hists[j].started)
+                histogram_update (&hists[j], hists[j].last_power, now);
+        }
+    }
+}
+
+/* Histograms of the given interface name, either monitored or not */
+static PowerHistogram *
+lookup_histograms (const char *name)
+{
+    HistogramEntry *orphans;
+    unsigned int    i;
+
+    for (i = 0; i < context.n_ifaces; i++) {
+        InterfaceInfo *iface = context.ifaces[i];
+
+        if (strcmp (iface->name, name) != 0)
+            continue;
+        if (!iface->histograms)
+            iface->histograms = calloc (HISTOGRAM_N_DIRECTIONS, sizeof (PowerHistogram));
+        return iface->histograms;
+    }
+
+    for (i = 0; i < histogram.n_orphans; i++) {
+        if (strcmp (histogram.orphans[i].name, name) == 0)
+            return histogram.orphans[i].histograms;
+    }
+
+    orphans = realloc (histogram.orphans, sizeof (HistogramEntry) * (histogram.n_orphans + 1));
+    if (!orphans)
+        return NULL;
+    histogram.orphans = orphans;
+    memset (&orphans[histogram.n_orphans], 0, sizeof (HistogramEntry));
+    orphans[histogram.n_orphans].name = strdup (name);
+    if (!orphans[histogram.n_orphans].name)
+        return NULL;
+    return orphans[histogram.n_orphans++].histograms;
+}
+
+static int
+load_histogram_line (char *line)
+{
+    char           *saveptr = NULL;
+    char           *name;
+    char           *direction;
+    char           *total;
+    char           *unknown;
+    char           *bucket;
+    PowerHistogram  loaded;
+    PowerHistogram *hists;
+    unsigned int    i;
+
+    line[strcspn (line, "\n")] = '\0';
+    name = strtok_r (line, " ", &saveptr);
+    direction = strtok_r (NULL, " ", &saveptr);
+    total = strtok_r (NULL, " ", &saveptr);
+    unknown = strtok_r (NULL, " ", &saveptr);
+    if (!name || !direction || !total || !unknown)
+        return -1;
+
+    for (i = 0; i < HISTOGRAM_N_DIRECTIONS; i++) {
+        if (strcmp (direction, histogram_direction_str[i]) == 0)
+            break;
+    }
+    if (i == HISTOGRAM_N_DIRECTIONS)
+        return -1;
+
+    memset (&loaded, 0, sizeof (loaded));
+    loaded.total = strtoull (total, NULL, 10);
+    loaded.unknown = strtoull (unknown, NULL, 10);
+    while ((bucket = strtok_r (NULL, " ", &saveptr)) != NULL) {
+        char          *end;
+        unsigned long  index;
+
+        index = strtoul (bucket, &end, 10);
+        if ((*end != ':') || (index >= HISTOGRAM_N_BUCKETS))
+            return -1;
+        loaded.buckets[index] = strtoull (end + 1, NULL, 10);
+    }
+
+    hists = lookup_histograms (name);
+    if (!hists)
+        return -2;
+    histogram_merge (&hists[i], &loaded);
+    return 0;
+}
+
+/* Histograms in the file are merged into the ones kept; a missing file is
+ * only an error if it's not optional */
+static int
+load_histogram_file (const char *path,
+                     bool        optional)
+{
+    char   header[64];
+    char  *line = NULL;
+    size_t line_size = 0;
+    FILE  *f;
+    int    status = 0;
+
+    f = fopen (path, "r");
+    if (!f)
+        return (optional && errno == ENOENT) ? 0 : -1;
+
+    /* the bucket layout must be the same to merge them */
+    snprintf (header, sizeof (header), HISTOGRAM_FILE_MAGIC " %d %d %d\n",
+              HISTOGRAM_MIN_DBM, HISTOGRAM_MAX_DBM, HISTOGRAM_BUCKETS_PER_DB);
+    if ((getline (&line, &line_size, f) <= 0) || (strcmp (line, header) != 0))
+        status = -1;
+
+    while ((status == 0) && (getline (&line, &line_size, f) > 0))
+        status = load_histogram_line (line);
+
+    free (line);
+    fclose (f);
+    return status;
+}
+
+static void
+save_histograms_line (FILE                 *f,
+                      const char           *name,
+                      const PowerHistogram *hists)
+{
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < HISTOGRAM_N_DIRECTIONS; i++) {
+        if (!hists[i].total)
+            continue;
+        fprintf (f, "%s %s %" PRIu64 " %" PRIu64,
+                 name, histogram_direction_str[i], hists[i].total, hists[i].unknown);
+        for (j = 0; j < HISTOGRAM_N_BUCKETS; j++) {
+            if (hists[i].buckets[j])
+                fprintf (f, " %u:%" PRIu64, j, hists[i].buckets[j]);
+        }
+        fprintf (f, "\n");
+    }
+}
+
+static int
+save_histogram_file (const char *path)
+{
+    char         tmp_path[PATH_MAX];
+    FILE        *f;
+    unsigned int i;
+
+    /* write to a temporary file first, so that the histograms are replaced
+     * atomically */
+    snprintf (tmp_path, sizeof (tmp_path), "%s.tmp", path);
+    f = fopen (tmp_path, "w");
+    if (!f) {
+        log_warning ("couldn't create histograms at %s: %s", tmp_path, strerror (errno));
+        return -1;
+    }
+
+    fprintf (f, HISTOGRAM_FILE_MAGIC " %d %d %d\n",
+             HISTOGRAM_MIN_DBM, HISTOGRAM_MAX_DBM, HISTOGRAM_BUCKETS_PER_DB);
+    for (i = 0; i < context.n_ifaces; i++) {
+        if (context.ifaces[i]->histograms)
+            save_histograms_line (f, context.ifaces[i]->name, context.ifaces[i]->histograms);
+    }
+    for (i = 0; i < histogram.n_orphans; i++)
+        save_histograms_line (f, histogram.orphans[i].name, histogram.orphans[i].histograms);
+
+    if ((fclose (f) != 0) || (rename (tmp_path, path) < 0)) {
+        log_warning ("couldn't save histograms at %s: %s", path, strerror (errno));
+        unlink (tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Once all interfaces are known, so that the histograms loaded are merged
+ * into the ones of the interfaces monitored */
+static void
+setup_histograms (void)
+{
+    if (!histogram_path)
+        return;
+
+    if (load_histogram_file (histogram_path, true) < 0) {
+        /* don't overwrite what we couldn't load */
+        log_warning ("couldn't load histograms at %s: not saving them", histogram_path);
+        return;
+    }
+
+    log_info ("histograms loaded from %s: %u interfaces not monitored", histogram_path, histogram.n_orphans);
+    histogram.loaded = true;
+    clock_gettime (CLOCK_MONOTONIC, &histogram.last_save);
+}
+
+static void
+save_histograms (const struct timespec *now)
+{
+    struct timespec flush_time;
+
+    if (!histogram.loaded)
+        return;
+
+    if (now && (timespec_diff_ms (now, &histogram.last_save) < HISTOGRAM_SAVE_PERIOD_MS))
+        return;
+
+    if (now)
+        flush_time = *now;
+    else
+        clock_gettime (CLOCK_MONOTONIC, &flush_time);
+    flush_histograms (&flush_time);
+
+    if (save_histogram_file (histogram_path) == 0)
+        log_debug ("histograms saved at %s", histogram_path);
+    if (now)
+        histogram.last_save = *now;
+}
+
+static void
+teardown_histograms (void)
+{
+    unsigned int i;
+
+    save_histograms (NULL);
+
+    for (i = 0; i < histogram.n_orphans; i++)
+        free (histogram.orphans[i].name);
+    free (histogram.orphans);
+    histogram.orphans = NULL;
+    histogram.n_orphans = 0;
+    histogram.loaded = false;
+}
+
+/* Offline merge of histogram files into the main one, e.g. from several
+ * units, without monitoring anything */
+static int
+merge_histogram_files (void)
+{
+    unsigned int i;
+    int          status = 0;
+
+    if (load_histogram_file (histogram_path, true) < 0) {
+        fprintf (stderr, "error: couldn't load histograms at %s\n", histogram_path);
+        return -1;
+    }
+
+    for (i = 0; (status == 0) && (i < n_histogram_merge_paths); i++) {
+        if (load_histogram_file (histogram_merge_paths[i], false) < 0) {
+            fprintf (stderr, "error: couldn't load histograms at %s\n", histogram_merge_paths[i]);
+            status = -1;
+        }
+    }
+
+    if (status == 0 && save_histogram_file (histogram_path) < 0) {
+        fprintf (stderr, "error: couldn't save histograms at %s\n", histogram_path);
+        status = -1;
+    }
+
+    if (status == 0)
+        printf ("%u histogram files merged into %s: %u interfaces\n",
+                n_histogram_merge_paths, histogram_path, histogram.n_orphans);
+
+    for (i = 0; i < histogram.n_orphans; i++)
+        free (histogram.orphans[i].name);
+    free (histogram.orphans);
+    return status;
+}
+
+/******************************************************************************/
+/* Interface ordering
+ *
+ * The interface list itself is always kept sorted by name. When sorting by
+ * TX or RX margin (i.e. how far the power is above the alarm threshold, or
+ * above the bad level if alarms aren't enabled), the interfaces are kept in
+ * an order-statistic treap: a randomized binary search tree where each node
+ * also stores the size of its subtree. When the power of an interface
+ * changes, only that node is removed and inserted back, and the N-th
+ * interface to show is looked up by subtree size, both in O(log n), so
+ * keeping the order up to date never requires a full re-sort.
+ */
+
+static float
+interface_margin (const InterfaceInfo *iface,
+                  SortMode             sort_mode)
+{
+    if (sort_mode == SORT_MODE_TX_MARGIN)
+        return iface->tx_power - alarm_threshold (alarm_tx_threshold, iface->profile);
+    return iface->rx_power - alarm_threshold (alarm_rx_threshold, iface->profile);
+}
+
+#define ORDER_NODE_IFACE(node) ((InterfaceInfo *)((char *)(node) - offsetof (InterfaceInfo, order_node)))
+
+static OrderNode *order_root;
+
+static int
+order_node_compare (const OrderNode *a,
+                    const OrderNode *b)
+{
+    InterfaceInfo *iface_a;
+    InterfaceInfo *iface_b;
+
+    if (a->margin < b->margin)
+        return -1;
+    if (a->margin > b->margin)
+        return 1;
+
+    /* same margin, keep them sorted by name; not by position in the
+     * interface list, as that changes while discovering interfaces */
+    iface_a = ORDER_NODE_IFACE (a);
+    iface_b = ORDER_NODE_IFACE (b);
+    return compare_interface (&iface_a, &iface_b);
+}
+
+static unsigned int
+order_node_size (const OrderNode *node)
+{
+    return node ? node->size : 0;
+}
+
+static void
+order_node_update_size (OrderNode *node)
+{
+    node->size = 1 + order_node_size (node->left) + order_node_size (node->right);
+}
+
+static OrderNode *
+order_merge (OrderNode *a,
+             OrderNode *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (a->priority > b->priority) {
+        a->right = order_merge (a->right, b);
+        order_node_update_size (a);
+        return a;
+    }
+
+    b->left = order_merge (a, b->left);
+    order_node_update_size (b);
+    return b;
+}
+
+/* split in nodes lower than the given one and the rest */
+static void
+order_split (OrderNode        *root,
+             const OrderNode  *node,
+             OrderNode       **lower,
+             OrderNode       **rest)
+{
+    if (!root) {
+        *lower = *rest = NULL;
+        return;
+    }
+
+    if (order_node_compare (root, node) < 0) {
+        order_split (root->right, node, &root->right, rest);
+        *lower = root;
+    } else {
+        order_split (root->left, node, lower, &root->left);
+        *rest = root;
+    }
+    order_node_update_size (root);
+}
+
+static void
+order_insert (InterfaceInfo *iface)
+{
+    OrderNode *node = &iface->order_node;
+    OrderNode *lower;
+    OrderNode *rest;
+
+    node->left = NULL;
+    node->right = NULL;
+    node->size = 1;
+    node->margin = interface_margin (iface, context.sort_mode);
+
+    order_split (order_root, node, &lower, &rest);
+    order_root = order_merge (order_merge (lower, node), rest);
+}
+
+static OrderNode *
+order_remove_node (OrderNode *root,
+                   OrderNode *node)
+{
+    assert (root);
+
+    if (root == node)
+        return order_merge (node->left, node->right);
+
+    if (order_node_compare (node, root) < 0)
+        root->left = order_remove_node (root->left, node);
+    else
+        root->right = order_remove_node (root->right, node);
+    order_node_update_size (root);
+    return root;
+}
+
+static void
+order_remove (InterfaceInfo *iface)
+{
+    order_root = order_remove_node (order_root, &iface->order_node);
+}
+
+/* Get the interface to show in the given position */
+static InterfaceInfo *
+order_nth (unsigned int n)
+{
+    OrderNode *node;
+
+    if (context.sort_mode == SORT_MODE_NAME)
+        return context.ifaces[n];
+
+    node = order_root;
+    while (node) {
+        unsigned int left_size;
+
+        left_size = order_node_size (node->left);
+        if (n < left_size)
+            node = node->left;
+        else if (n == left_size)
+            return ORDER_NODE_IFACE (node);
+        else {
+            n -= left_size + 1;
+            node = node->right;
+        }
+    }
+    assert (0);
+    return NULL;
+}
+
+/* Update the position of an interface after a power change */
+static void
+order_update (InterfaceInfo *iface)
+{
+    order_remove (iface);
+    order_insert (iface);
+}
+
+static void
+set_sort_mode (SortMode sort_mode)
+{
+    unsigned int i;
+
+    context.sort_mode = sort_mode;
+    order_root = NULL;
+    if (sort_mode == SORT_MODE_NAME)
+        return;
+
+    for (i = 0; i < context.n_ifaces; i++)
+        order_insert (context.ifaces[i]);
+}
+
+#define MAX_NAME_WIDTH 24
+
+static uint32_t order_seed = 2463534242U;
+
+/* Setup ordering of an interface just added to the list */
+static void
+order_add_interface (InterfaceInfo *iface)
+{
+    size_t len;
+
+    /* xorshift is enough to keep the treap balanced */
+    order_seed ^= order_seed << 13;
+    order_seed ^= order_seed >> 17;
+    order_seed ^= order_seed << 5;
+    iface->order_node.priority = order_seed;
+
+    len = strlen (iface->name);
+    if (len > context.name_width)
+        context.name_width = (len > MAX_NAME_WIDTH) ? MAX_NAME_WIDTH : len;
+
+    if (context.sort_mode != SORT_MODE_NAME)
+        order_insert (iface);
+}
+
+static void
+setup_order (void)
+{
+    unsigned int i;
+
+    context.name_width = strlen ("INTERFACE");
+    order_root = NULL;
+    for (i = 0; i < context.n_ifaces; i++)
+        order_add_interface (context.ifaces[i]);
+}
+
+/******************************************************************************/
+/* Interface groups
+ *
+ * Interfaces are grouped by name prefix (the name without the trailing
+ * number), by the parent device of their hwmon entry, or as given in an
+ * explicit groups file. Each group keeps how many members are in each RX
+ * power zone and in each histogram bucket, adjusted whenever the RX power of
+ * a member changes; the worst and median RX power are then found walking the
+ * fixed number of buckets, regardless of how many members the group has.
+ */
+
+struct _Group {
+    char           *name;
+    /* sorted by name */
+    InterfaceInfo **members;
+    unsigned int    n_members;
+    unsigned int    n_zone[POWER_N_ZONES];
+    unsigned int    n_rx_unknown;
+    unsigned int    rx_buckets[HISTOGRAM_N_BUCKETS];
+    /* scale of the bars; the default one if members use different profiles */
+    ThresholdProfile *profile;
+};
+
+/* Explicit groups file entry */
+typedef struct {
+    char *iface;
+    char *group;
+} GroupFileEntry;
+
+static struct {
+    /* sorted by name */
+    Group          **groups;
+    unsigned int     n_groups;
+    unsigned int     name_width;
+    /* sorted by interface name */
+    GroupFileEntry  *entries;
+    unsigned int     n_entries;
+} grouping;
+
+/* Zones are given by the profile of each member */
+static void
+group_add_rx_power (Group                  *group,
+                    const ThresholdProfile *profile,
+                    float                   power,
+                    int                     delta)
+{
+    group->n_zone[power_zone (profile, power)] += delta;
+    if (power <= POWER_UNK)
+        group->n_rx_unknown += delta;
+    else
+        group->rx_buckets[histogram_bucket (power)] += delta;
+}
+
+/* Unknown power counts as the lowest level */
+static float
+group_rx_percentile (const Group *group,
+                     double       percentile)
+{
+    unsigned int target;
+    unsigned int accumulated;
+    unsigned int i;
+
+    if (!group->n_members)
+        return NAN;
+
+    target = (unsigned int) ceil (group->n_members * percentile / 100.0);
+    if (!target)
+        target = 1;
+
+    accumulated = group->n_rx_unknown;
+    if (accumulated >= target)
+        return POWER_UNK;
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        accumulated += group->rx_buckets[i];
+        if (accumulated >= target)
+            return histogram_bucket_power (i);
+    }
+    return histogram_bucket_power (HISTOGRAM_N_BUCKETS - 1);
+}
+
+/* Only called when the RX power of an interface changes */
+static void
+group_update_interface (InterfaceInfo *iface)
+{
+    if (!iface->group)
+        return;
+
+    group_add_rx_power (iface->group, iface->profile, iface->group_rx_power, -1);
+    group_add_rx_power (iface->group, iface->profile, iface->rx_power, 1);
+    iface->group_rx_power = iface->rx_power;
+}
+
+static int
+compare_group_file_entry (const void *a, const void *b)
+{
+    return strcmp (((const GroupFileEntry *)a)->iface, ((const GroupFileEntry *)b)->iface);
+}
+
+static const char *
+lookup_group_file_entry (const char *iface)
+{
+    GroupFileEntry  key;
+    GroupFileEntry *entry;
+
+    if (!grouping.n_entries)
+        return NULL;
+
+    key.iface = (char *) iface;
+    entry = bsearch (&key, grouping.entries, grouping.n_entries, sizeof (GroupFileEntry), compare_group_file_entry);
+    return entry ? entry->group : NULL;
+}
+
+/* Name without the trailing number and separators, e.g. eth_fc_1000 for
+ * eth_fc_1000_12; the whole name if nothing's left */
+static void
+group_name_from_prefix (const char *name,
+                        char       *group_name,
+                        size_t      group_name_size)
+{
+    size_t len;
+
+    len = strlen (name);
+    while (len > 0 && isdigit ((unsigned char) name[len - 1]))
+        len--;
+    while (len > 0 && strchr ("_-.:", name[len - 1]))
+        len--;
+    if (!len)
+        len = strlen (name);
+    if (len >= group_name_size)
+        len = group_name_size - 1;
+    memcpy (group_name, name, len);
+    group_name[len] = '\0';
+}
+
+/* Name of the device the hwmon entry belongs to, e.g. the i2c bus or the
+ * line card of a SFP cage */
+static int
+group_name_from_hwmon (const InterfaceInfo *iface,
+                       char                *group_name,
+                       size_t               group_name_size)
+{
+    char  path[PATH_MAX];
+    char *parent;
+    char *base;
+
+    if (!iface->hwmon)
+        return -1;
+
+    if (snprintf (path, sizeof (path), "%s/%s/device/..",
+                  fiberstat_get_hwmon_dir (), iface->hwmon->name) >= (int) sizeof (path))
+        return -1;
+
+    parent = realpath (path, NULL);
+    if (!parent)
+        return -1;
+
+    base = strrchr (parent, '/');
+    snprintf (group_name, group_name_size, "%s", base ? base + 1 : parent);
+    free (parent);
+    return 0;
+}
+
+static Group *
+lookup_group (const char *name)
+{
+    Group      **groups;
+    Group       *group;
+    unsigned int low = 0;
+    unsigned int high = grouping.n_groups;
+    size_t       len;
+
+    while (low < high) {
+        unsigned int middle = low + ((high - low) / 2);
+        int          result;
+
+        result = strnatcmp (grouping.groups[middle]->name, name);
+        if (result == 0)
+            return grouping.groups[middle];
+        if (result < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    group = calloc (1, sizeof (Group));
+    if (!group)
+        return NULL;
+    group->name = strdup (name);
+    groups = realloc (grouping.groups, sizeof (Group *) * (grouping.n_groups + 1));
+    if (!group->name || !groups) {
+        free (group->name);
+        free (group);
+        return NULL;
+    }
+    grouping.groups = groups;
+    memmove (&grouping.groups[low + 1], &grouping.groups[low], sizeof (Group *) * (grouping.n_groups - low));
+    grouping.groups[low] = group;
+    grouping.n_groups++;
+
+    /* keep the same group selected while discovering */
+    if (context.groups_view && grouping.n_groups > 1 && low <= context.selected_group)
+        context.selected_group++;
+
+    len = strlen (name);
+    if (len > grouping.name_width)
+        grouping.name_width = (len > MAX_NAME_WIDTH) ? MAX_NAME_WIDTH : len;
+    return group;
+}
+
+/* Setup the group of an interface just added to the list */
+static int
+group_add_interface (InterfaceInfo *iface)
+{
+    InterfaceInfo **members;
+    Group          *group;
+    const char     *name;
+    char            buffer[64];
+    unsigned int    low = 0;
+    unsigned int    high;
+
+    if (iface->group)
+        return 0;
+
+    name = lookup_group_file_entry (iface->name);
+    if (!name) {
+        if ((group_by != GROUP_BY_HWMON) || (group_name_from_hwmon (iface, buffer, sizeof (buffer)) < 0))
+            group_name_from_prefix (iface->name, buffer, sizeof (buffer));
+        name = buffer;
+    }
+
+    group = lookup_group (name);
+    if (!group)
+        return -1;
+
+    high = group->n_members;
+    while (low < high) {
+        unsigned int middle = low + ((high - low) / 2);
+
+        if (compare_interface (&group->members[middle], &iface) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    members = realloc (group->members, sizeof (InterfaceInfo *) * (group->n_members + 1));
+    if (!members)
+        return -1;
+    group->members = members;
+    memmove (&group->members[low + 1], &group->members[low], sizeof (InterfaceInfo *) * (group->n_members - low));
+    group->members[low] = iface;
+    group->n_members++;
+
+    if (!group->profile)
+        group->profile = iface->profile;
+    else if (group->profile != iface->profile)
+        group->profile = profiles.profiles[0];
+
+    iface->group = group;
+    iface->group_rx_power = iface->rx_power;
+    group_add_rx_power (group, iface->profile, iface->rx_power, 1);
+    return 0;
+}
+
+static int
+load_groups_file_line (char *line)
+{
+    char *saveptr = NULL;
+    char *group;
+    char *iface;
+
+    line[strcspn (line, "#\n")] = '\0';
+    group = strtok_r (line, " \t", &saveptr);
+    if (!group)
+        return 0;
+
+    while ((iface = strtok_r (NULL, " \t", &saveptr)) != NULL) {
+        GroupFileEntry *entries;
+
+        entries = realloc (grouping.entries, sizeof (GroupFileEntry) * (grouping.n_entries + 1));
+        if (!entries)
+            return -1;
+        grouping.entries = entries;
+        grouping.entries[grouping.n_entries].iface = strdup (iface);
+        grouping.entries[grouping.n_entries].group = strdup (group);
+        grouping.n_entries++;
+        if (!grouping.entries[grouping.n_entries - 1].iface || !grouping.entries[grouping.n_entries - 1].group)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+load_groups_file (void)
+{
+    char   *line = NULL;
+    size_t  line_size = 0;
+    FILE   *f;
+    int     status = 0;
+
+    grouping.name_width = strlen ("GROUP");
+
+    if (!groups_path)
+        return 0;
+
+    f = fopen (groups_path, "r");
+    if (!f) {
+        log_error ("couldn't open groups file %s: %s", groups_path, strerror (errno));
+        return -1;
+    }
+
+    while ((status == 0) && (getline (&line, &line_size, f) > 0))
+        status = load_groups_file_line (line);
+
+    free (line);
+    fclose (f);
+
+    if (status < 0)
+        return status;
+
+    qsort (grouping.entries, grouping.n_entries, sizeof (GroupFileEntry), compare_group_file_entry);
+    log_info ("groups loaded from %s: %u interfaces", groups_path, grouping.n_entries);
+    return 0;
+}
+
+static void
+setup_groups (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < context.n_ifaces; i++) {
+        if (group_add_interface (context.ifaces[i]) < 0)
+            log_warning ("couldn't group interface '%s'", context.ifaces[i]->name);
+    }
+}
+
+static void
+teardown_groups (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < grouping.n_groups; i++) {
+        free (grouping.groups[i]->members);
+        free (grouping.groups[i]->name);
+        free (grouping.groups[i]);
+    }
+    free (grouping.groups);
+
+    for (i = 0; i < grouping.n_entries; i++) {
+        free (grouping.entries[i].iface);
+        free (grouping.entries[i].group);
+    }
+    free (grouping.entries);
+}
+
+/* Interfaces shown in the per-interface views: the members of the group
+ * drilled down into, if any, sorted by name */
+static unsigned int
+shown_n_ifaces (void)
+{
+    return context.group ? context.group->n_members : context.n_ifaces;
+}
+
+static InterfaceInfo *
+shown_nth (unsigned int n)
+{
+    return context.group ? context.group->members[n] : order_nth (n);
+}
+
+/******************************************************************************/
+/* Health summary
+ *
+ * The header shows how many interfaces are in each power zone (the worst of
+ * TX and RX), how many links are up, and how many interfaces have stale
+ * values because their files are failing. The counters are adjusted only
+ * when an interface reloads with changes, so the header never needs to go
+ * over all interfaces.
+ */
+
+static struct {
+    unsigned int n_ifaces;
+    unsigned int n_zone[POWER_N_ZONES];
+    unsigned int n_operstate[FIBERSTAT_OPERSTATE_LAST];
+    unsigned int n_stale;
+} health;
+
+static PowerZone
+interface_zone (const InterfaceInfo *iface)
+{
+    PowerZone tx_zone;
+    PowerZone rx_zone;
+
+    tx_zone = power_zone (iface->profile, iface->tx_power);
+    rx_zone = power_zone (iface->profile, iface->rx_power);
+    return (tx_zone < rx_zone) ? tx_zone : rx_zone;
+}
+
+static FiberstatOperstate
+interface_operstate (const InterfaceInfo *iface)
+{
+    return (iface->operstate < FIBERSTAT_OPERSTATE_LAST) ? iface->operstate : FIBERSTAT_OPERSTATE_UNKNOWN;
+}
+
+static void
+health_add_interface (InterfaceInfo *iface)
+{
+    if (iface->health_tracked)
+        return;
+
+    iface->health_tracked = true;
+    iface->health_zone = interface_zone (iface);
+    iface->health_operstate = interface_operstate (iface);
+    iface->health_stale = (interface_error (iface) != NULL);
+
+    health.n_ifaces++;
+    health.n_zone[iface->health_zone]++;
+    health.n_operstate[iface->health_operstate]++;
+    if (iface->health_stale)
+        health.n_stale++;
+}
+
+/* Returns true if any of the counters changed */
+static bool
+health_update_interface (InterfaceInfo *iface)
+{
+    PowerZone          zone;
+    FiberstatOperstate operstate;
+    bool               stale;
+    bool               changed = false;
+
+    if (!iface->health_tracked)
+        return false;
+
+    zone = interface_zone (iface);
+    if (zone != iface->health_zone) {
+        health.n_zone[iface->health_zone]--;
+        health.n_zone[zone]++;
+        iface->health_zone = zone;
+        changed = true;
+    }
+
+    operstate = interface_operstate (iface);
+    if (operstate != iface->health_operstate) {
+        health.n_operstate[iface->health_operstate]--;
+        health.n_operstate[operstate]++;
+        iface->health_operstate = operstate;
+        changed = true;
+    }
+
+    stale = (interface_error (iface) != NULL);
+    if (stale != iface->health_stale) {
+        if (stale)
+            health.n_stale++;
+        else
+            health.n_stale--;
+        iface->health_stale = stale;
+        changed = true;
+    }
+
+    return changed;
+}
+
+static void
+setup_health (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < context.n_ifaces; i++)
+        health_add_interface (context.ifaces[i]);
+}
+
+/******************************************************************************/
+
+typedef enum {
+    BOX_CHARSET_ASCII,
+    BOX_CHARSET_UTF8,
+} BoxCharset;
+
+static const char *VRT[] = { [BOX_CHARSET_ASCII] = "|", [BOX_CHARSET_UTF8] = "│" };
+static const char *HRZ[] = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "─" };
+static const char *TL[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "┌" };
+static const char *TR[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "┐" };
+static const char *BL[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "└" };
+static const char *BR[]  = { [BOX_CHARSET_ASCII] = "-", [BOX_CHARSET_UTF8] = "┘" };
+
+/* When using UTF-8, we can use a block fill from 1/8 to 8/8 */
+static const int   RESOLUTION[] = { [BOX_CHARSET_ASCII] = 1, [BOX_CHARSET_UTF8] = 8 };
+static const char *BLK[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+static const char *HBLK[] = { "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█" };
+/* Levels shown with characters instead of block heights when using ASCII */
+static const char *ASCII_LEVELS[] = { ".", ":", "*", "#" };
+
+static BoxCharset current_box_charset = BOX_CHARSET_ASCII;
+
+/*
+ * The information for one single interface is exposed as follows:
+ *   ┌────┐ ┌────┐
+ *   │    │ │    │
+ *   │    │ │    │
+ *   │    │ │    │
+ *   │    │ │    │   The height of the interface info section is 21:
+ *   │    │ │    │      box:        17 chars (15 content, 2 border)
+ *   │    │ │    │      box info:    2 chars
+ *   │    │ │    │      iface info:  2 chars
+ *   │    │ │    │
+ *   │    │ │    │   The minimum width of the interface info section is 13:
+ *   │    │ │    │      TX box:         6 chars (4 content, 2 border)
+ *   │    │ │    │      box separation: 1 char
+ *   │    │ │    │      RX box:         6 chars (4 content, 2 border)
+ *   │    │ │    │
+ *   │    │ │    │
+ *   └────┘ └────┘
+ *   -20,00 -17,50     ----> TX/RX values in dBm   (box info)
+ *   TX dBm RX dBm     ----> Box info              (box info)
+ *   ▇▇▆▇▇▇ ▅▅▁▅▅▅     ----> TX/RX power history   (sparkline, optional)
+ *        lo           ----> Interface name        (iface info)
+ *   link unknown      ----> Link state            (iface info)
+ *    temp 41.2C       ----> One line per channel  (channel info, optional)
+ *    A:0    A:2       ----> TX/RX alarm counters  (alarm info, optional)
+ *
+ * The height of the bar is defined so that the whole interface takes
+ * a maximum of 21 chars, because on serial terminals a window height
+ * of 23 chars max is assumed as default and we don't want to take more
+ * than that:
+ *     1 char for app title
+ *     21 chars for interface
+ *     1 empty line to avoid cursor rewriting the last printed line
+ *
+ * When alarms are enabled, one additional line with the alarm counters is
+ * shown for each interface, plus the last alarm event line at the bottom.
+ * The sparklines also take one additional line when enabled, and so does
+ * each channel given with --channels.
+ */
+
+#define BOX_CONTENT_WIDTH   4
+#define BOX_BORDER_WIDTH    2
+#define BOX_WIDTH           (BOX_CONTENT_WIDTH + BOX_BORDER_WIDTH)
+#define BOX_CONTENT_HEIGHT  15
+#define BOX_BORDER_HEIGHT   2
+#define BOX_INFO_HEIGHT     2
+#define BOX_HEIGHT          (BOX_CONTENT_HEIGHT + BOX_BORDER_HEIGHT + BOX_INFO_HEIGHT)
+#define BOX_SEPARATION      1
+
+#define SPARKLINE_HEIGHT    (sparkline_ms ? 1 : 0)
+#define IFACE_INFO_HEIGHT   2
+#define CHANNEL_INFO_HEIGHT n_channels
+#define ALARM_INFO_HEIGHT   (alarms ? 1 : 0)
+
+#define INTERFACE_WIDTH  (BOX_WIDTH + BOX_SEPARATION + BOX_WIDTH)
+#define INTERFACE_HEIGHT (BOX_HEIGHT + SPARKLINE_HEIGHT + IFACE_INFO_HEIGHT + CHANNEL_INFO_HEIGHT + ALARM_INFO_HEIGHT)
+
+/******************************************************************************/
+/* Profile tables
+ *
+ * Drawing a bar is just a lookup in the tables of the threshold profile of
+ * the interface, computed once the profiles are loaded and the box charset is
+ * known:
+ *
+ *   - fill: the fill height, in units of the charset resolution, for each
+ *     PROFILE_STEPS_PER_DB step between the min and max levels.
+ *   - level: the same, in sparkline levels.
+ *   - row_zone: the zone of each row of the boxes, which are also the cells
+ *     of the table bars, given by the fill heights of the bad and good levels
+ *     in full rows.
+ *   - bucket_cell: the cell of the histogram bars of each histogram bucket;
+ *     levels out of the scale go to the first and last cells.
+ */
+
+#define PROFILE_STEPS_PER_DB 100
+
+struct _ProfileTables {
+    unsigned int  resolution;
+    unsigned int  n_steps;
+    uint8_t      *fill;
+    uint8_t      *level;
+    uint8_t       row_zone[BOX_CONTENT_HEIGHT];
+    uint8_t       bucket_cell[HISTOGRAM_N_BUCKETS];
+};
+
+static unsigned int
+profile_n_levels (void)
+{
+    return (current_box_charset == BOX_CHARSET_UTF8) ?
+        (sizeof (BLK) / sizeof (BLK[0])) : (sizeof (ASCII_LEVELS) / sizeof (ASCII_LEVELS[0]));
+}
+
+static unsigned int
+profile_step (const ThresholdProfile *profile,
+              float                   power)
+{
+    if (power <= profile->min)
+        return 0;
+    if (power >= profile->max)
+        return profile->tables->n_steps;
+    return (unsigned int) ((power - profile->min) * PROFILE_STEPS_PER_DB + 0.5);
+}
+
+/* Fill height in units of the charset resolution */
+static unsigned int
+profile_fill (const ThresholdProfile *profile,
+              float                   power)
+{
+    return profile->tables->fill[profile_step (profile, power)];
+}
+
+static unsigned int
+profile_level (const ThresholdProfile *profile,
+               float                   power)
+{
+    return profile->tables->level[profile_step (profile, power)];
+}
+
+static int
+setup_profile_tables_one (ThresholdProfile *profile)
+{
+    ProfileTables *tables;
+    unsigned int   n_levels;
+    unsigned int   bad_level_fill_height_n;
+    unsigned int   good_level_fill_height_n;
+    unsigned int   i;
+
+    tables = calloc (1, sizeof (ProfileTables));
+    if (!tables)
+        return -1;
+    tables->resolution = RESOLUTION[current_box_charset];
+    tables->n_steps = (unsigned int) ((profile->max - profile->min) * PROFILE_STEPS_PER_DB + 0.5);
+    tables->fill = calloc (tables->n_steps + 1, sizeof (uint8_t));
+    tables->level = calloc (tables->n_steps + 1, sizeof (uint8_t));
+    profile->tables = tables;
+    if (!tables->fill || !tables->level)
+        return -1;
+
+    n_levels = profile_n_levels ();
+    for (i = 0; i <= tables->n_steps; i++) {
+        double fraction;
+
+        fraction = (double) i / tables->n_steps;
+        tables->fill[i] = (uint8_t) floor (fraction * BOX_CONTENT_HEIGHT * tables->resolution + 0.5);
+        tables->level[i] = (uint8_t) floor (fraction * (n_levels - 1) + 0.5);
+    }
+
+    bad_level_fill_height_n = profile_fill (profile, profile->bad) / tables->resolution;
+    good_level_fill_height_n = profile_fill (profile, profile->good) / tables->resolution;
+    for (i = 0; i < BOX_CONTENT_HEIGHT; i++) {
+        if (i < bad_level_fill_height_n)
+            tables->row_zone[i] = POWER_ZONE_BAD;
+        else if (i < good_level_fill_height_n)
+            tables->row_zone[i] = POWER_ZONE_LOW;
+        else
+            tables->row_zone[i] = POWER_ZONE_GOOD;
+    }
+
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        int cell;
+
+        cell = (int) floor ((histogram_bucket_power (i) - profile->min) * BOX_CONTENT_HEIGHT / (profile->max - profile->min));
+        if (cell < 0)
+            cell = 0;
+        else if (cell >= BOX_CONTENT_HEIGHT)
+            cell = BOX_CONTENT_HEIGHT - 1;
+        tables->bucket_cell[i] = (uint8_t) cell;
+    }
+
+    log_debug ("profile %s: %u steps (res: %u), bad level fill height N %u (partial ignored %u), good level fill height N %u (partial ignored %u), per-step power: %.2f dBm",
+               profile->name, tables->n_steps, tables->resolution,
+               bad_level_fill_height_n, profile_fill (profile, profile->bad) % tables->resolution,
+               good_level_fill_height_n, profile_fill (profile, profile->good) % tables->resolution,
+               (profile->max - profile->min) / (BOX_CONTENT_HEIGHT * tables->resolution));
+    return 0;
+}
+
+static int
+setup_profile_tables (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < profiles.n_profiles; i++) {
+        if (setup_profile_tables_one (profiles.profiles[i]) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void
+teardown_profiles (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < profiles.n_profiles; i++) {
+        ThresholdProfile *profile;
+
+        profile = profiles.profiles[i];
+        if (profile->tables) {
+            free (profile->tables->fill);
+            free (profile->tables->level);
+            free (profile->tables);
+        }
+        free (profile->name);
+        free (profile);
+    }
+    free (profiles.profiles);
+    for (i = 0; i < profiles.n_matches; i++)
+        free (profiles.matches[i].pattern);
+    free (profiles.matches);
+    memset (&profiles, 0, sizeof (profiles));
+}
+
+static void
+print_box (int                     x,
+           int                     y,
+           const ThresholdProfile *profile,
+           float                   power,
+           const char             *label)
+{
+    static const int    row_color_background[] = {
+        [POWER_ZONE_BAD]  = COLOR_PAIR_BOX_BACKGROUND_RED,
+        [POWER_ZONE_LOW]  = COLOR_PAIR_BOX_BACKGROUND_YELLOW,
+        [POWER_ZONE_GOOD] = COLOR_PAIR_BOX_BACKGROUND_GREEN,
+    };
+    const ProfileTables *tables;
+    char                 buf[32];
+    unsigned int         i;
+    unsigned int         j;
+    unsigned int         resolution;
+    unsigned int         fill_height;
+    unsigned int         fill_height_n;
+    unsigned int         fill_height_partial; /* 0-7 */
+    unsigned int         x_center;
+
+    tables = profile->tables;
+    resolution = tables->resolution;
+    fill_height = profile_fill (profile, power);
+    fill_height_n = fill_height / resolution;
+    fill_height_partial = fill_height % resolution;
+    log_debug ("fill height: %u (res: %u, N %u, partial %u), power: %.2f dBm",
+               fill_height, resolution, fill_height_n, fill_height_partial, power);
+
+    /* box */
+    mvwprintw (context.content_win, y, x, "%s", TL[current_box_charset]);
+    for (i = 0; i < BOX_CONTENT_WIDTH; i++)
+        mvwprintw (context.content_win, y, x+1+i, "%s", HRZ[current_box_charset]);
+    mvwprintw (context.content_win, y, x+1+BOX_CONTENT_WIDTH, "%s", TR[current_box_charset]);
+    for (i = 0; i < BOX_CONTENT_HEIGHT; i++) {
         const char  *fill;
         bool         print = false;
         unsigned int row_height;
 
-        row_height = BOX_CONTENT_HEIGHT - 1 - i;
+        row_height = BOX_CONTENT_HEIGHT - 1 - i;
+
+        /*
+         * The fill_height_n value specifies how many FULL blocks need to be printed.
+         * The fill_height_partial value specifies the partial height (0-7) of the top block, if any
+         */
+        mvwprintw (context.content_win, y+1+i, x, "%s", VRT[current_box_charset]);
+
+        if ((row_height == fill_height_n) && (fill_height_partial > 0)) {
+            /* can't have partial on low resolution */
+            assert (resolution > 1);
+            print = true;
+            fill = BLK[fill_height_partial - 1];
+        } else if (row_height < fill_height_n) {
+            print = true;
+            if (resolution == 1)
+                fill = " ";
+            else
+                fill= BLK[7];
+        }
+
+        if (print) {
+            int row_color;
+
+            /* when using low res, we change the background color and we use
+             * a space as character; when using high res, we change foreground
+             * color and we use partial block characters */
+            if (resolution == 1)
+                row_color = COLOR_PAIR (row_color_background[tables->row_zone[row_height]]);
+            else
+                row_color = COLOR_PAIR (power_zone_color[tables->row_zone[row_height]]);
+
+            wattron (context.content_win, row_color);
+            for (j = 0; j < BOX_CONTENT_WIDTH; j++)
+                mvwprintw (context.content_win, y+1+i, x+1+j, fill);
+            wattroff (context.content_win, row_color);
+        }
+        mvwprintw (context.content_win, y+1+i, x+1+BOX_CONTENT_WIDTH, "%s", VRT[current_box_charset]);
+    }
+    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT, x, "%s", BL[current_box_charset]);
+    for (i = 0; i < BOX_CONTENT_WIDTH; i++)
+        mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT, x+1+i, "%s", HRZ[current_box_charset]);
+    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT, x+1+BOX_CONTENT_WIDTH, "%s", BR[current_box_charset]);
+
+    /* box info */
+
+    x_center = x + (BOX_WIDTH / 2) - (strlen (label) / 2);
+    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT+2, x_center, "%s", label);
+
+    snprintf (buf, sizeof (buf), "%.2f", power);
+    x_center = x + (BOX_WIDTH / 2) - (strlen (buf) / 2);
+    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT+1, x_center, "%s", buf);
+}
+
+/* Same order as FiberstatOperstate; lowerlayerdown is too long and messes up
+ * the UI, so limit it a bit */
+static const char *operstate_box_labels[] = {
+    "link unknown",
+    "link notpresent",
+    "link down",
+    "link lowerdown",
+    "link testing",
+    "link dormant",
+    "link up",
+};
+
+static void
+print_iface_info (int                 x,
+                  int                 y,
+                  const char         *name,
+                  FiberstatOperstate  operstate,
+                  const char         *error)
+{
+    const char *label;
+    int         x_center;
+
+    x_center = x + (INTERFACE_WIDTH / 2) - (strlen (name) / 2);
+    mvwprintw (context.content_win, y, x_center, "%s", name);
+
+    if (error) {
+        x_center = x + (INTERFACE_WIDTH / 2) - (strlen (error) / 2);
+        wattron (context.content_win, COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED));
+        mvwprintw (context.content_win, y + 1, x_center, "%s", error);
+        wattroff (context.content_win, COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED));
+        return;
+    }
+
+    label = operstate_box_labels[(operstate < FIBERSTAT_OPERSTATE_LAST) ? operstate : FIBERSTAT_OPERSTATE_UNKNOWN];
+    x_center = x + (INTERFACE_WIDTH / 2) - (strlen (label) / 2);
+    mvwprintw (context.content_win, y + 1, x_center, "%s", label);
+}
+
+/* Value of the channel with its unit, or "-" if unknown */
+static void
+format_channel_value (char             *buffer,
+                      size_t            buffer_size,
+                      FiberstatChannel  channel,
+                      float             value,
+                      bool              with_unit)
+{
+    const FiberstatChannelInfo *info;
+
+    info = fiberstat_channel_get_info (channel);
+    if (isnan (value))
+        snprintf (buffer, buffer_size, "-");
+    else
+        snprintf (buffer, buffer_size, "%.*f%s", (int) info->precision, value, with_unit ? info->unit : "");
+}
+
+static void
+print_channel_info (int                  x,
+                    int                  y,
+                    const InterfaceInfo *iface)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_channels; i++) {
+        char value[16];
+        char buffer[32];
+
+        format_channel_value (value, sizeof (value), channels[i], iface->channel_values[i], true);
+        snprintf (buffer, sizeof (buffer), "%s %s", fiberstat_channel_get_info (channels[i])->name, value);
+        mvwprintw (context.content_win, y + i, x + (INTERFACE_WIDTH / 2) - (strlen (buffer) / 2), "%s", buffer);
+    }
+}
+
+static void
+print_alarm_info (int          x,
+                  int          y,
+                  const Alarm *alarm)
+{
+    char buffer[16];
+    int  attrs = 0;
+
+    snprintf (buffer, sizeof (buffer), "A:%u", alarm->n_raised);
+    if (alarm_is_raised (alarm))
+        attrs = A_BOLD | COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED);
+
+    wattron (context.content_win, attrs);
+    mvwprintw (context.content_win, y, x + (BOX_WIDTH / 2) - (strlen (buffer) / 2), "%s", buffer);
+    wattroff (context.content_win, attrs);
+}
+
+/*
+ * The sparklines show the recent TX/RX power history under each box, with
+ * one column per slice of the history time, e.g. 10s per column when showing
+ * the last 60s. Each interface keeps a preallocated ring of columns per
+ * direction with the min and max power seen in each one; new values only
+ * update the newest column, and once its time is over the ring just moves
+ * forward, so the sparkline scrolls without going over the older columns.
+ *
+ * Each column shows the lowest power seen in it, so that short drops are
+ * never hidden by slow reloads, in bold if the power moved more than
+ * SPARKLINE_SPREAD_DB within it.
+ */
+
+#define SPARKLINE_WIDTH     BOX_WIDTH
+#define SPARKLINE_SPREAD_DB 1.0
+
+typedef enum {
+    SPARKLINE_TX,
+    SPARKLINE_RX,
+    SPARKLINE_N_DIRECTIONS
+} SparklineDirection;
+
+typedef struct {
+    float min;
+    float max;
+    bool  valid;
+} SparklineColumn;
+
+struct _Sparkline {
+    SparklineColumn columns[SPARKLINE_WIDTH];
+    /* newest column, and when it started */
+    unsigned int    head;
+    struct timespec head_start;
+    float           last_power;
+    bool            started;
+};
+
+/* Returns true if the sparkline scrolled */
+static bool
+sparkline_update (Sparkline             *sparkline,
+                  float                  power,
+                  const struct timespec *time)
+{
+    SparklineColumn *column;
+    int              column_ms;
+    bool             scrolled = false;
+
+    column_ms = sparkline_ms / SPARKLINE_WIDTH;
+
+    if (!sparkline->started) {
+        sparkline->started = true;
+        sparkline->head_start = *time;
+    } else {
+        double elapsed_ms;
+
+        elapsed_ms = timespec_diff_ms (time, &sparkline->head_start);
+        if (elapsed_ms >= column_ms) {
+            int          n_columns;
+            unsigned int i;
+
+            /* the power holds between reads, so the new columns start with
+             * the last value; no need to go over the ring more than once */
+            n_columns = (int) (elapsed_ms / column_ms);
+            for (i = 0; i < (unsigned int) n_columns && i < SPARKLINE_WIDTH; i++) {
+                sparkline->head = (sparkline->head + 1) % SPARKLINE_WIDTH;
+                column = &sparkline->columns[sparkline->head];
+                column->min = sparkline->last_power;
+                column->max = sparkline->last_power;
+                column->valid = true;
+            }
+            timespec_add_ms (&sparkline->head_start, n_columns * column_ms);
+            scrolled = true;
+        }
+    }
+
+    column = &sparkline->columns[sparkline->head];
+    if (!column->valid) {
+        column->min = power;
+        column->max = power;
+        column->valid = true;
+    } else if (power < column->min)
+        column->min = power;
+    else if (power > column->max)
+        column->max = power;
+    sparkline->last_power = power;
+
+    return scrolled;
+}
+
+/* Failing files still count, as unknown power read at the start of the
+ * cycle. Returns true if any of the sparklines scrolled. */
+static bool
+interface_update_sparklines (InterfaceInfo         *iface,
+                             const struct timespec *cycle_start)
+{
+    bool scrolled = false;
+
+    if (!iface->sparklines) {
+        iface->sparklines = calloc (SPARKLINE_N_DIRECTIONS, sizeof (Sparkline));
+        if (!iface->sparklines)
+            return false;
+    }
+
+    if (!(iface->tx_power_file.fd < 0) || fiberstat_file_is_failed (&iface->tx_power_file))
+        scrolled |= sparkline_update (&iface->sparklines[SPARKLINE_TX], iface->tx_power,
+                                      (iface->tx_power_file.n_read < 0) ? cycle_start : &iface->tx_power_file.read_time);
+    if (!(iface->rx_power_file.fd < 0) || fiberstat_file_is_failed (&iface->rx_power_file))
+        scrolled |= sparkline_update (&iface->sparklines[SPARKLINE_RX], iface->rx_power,
+                                      (iface->rx_power_file.n_read < 0) ? cycle_start : &iface->rx_power_file.read_time);
+    return scrolled;
+}
+
+static void
+print_sparkline (int                     x,
+                 int                     y,
+                 const ThresholdProfile *profile,
+                 const Sparkline        *sparkline)
+{
+    unsigned int i;
+
+    /* oldest column first */
+    for (i = 0; i < SPARKLINE_WIDTH; i++) {
+        const SparklineColumn *column;
+        unsigned int           level;
+        int                    attrs;
+
+        column = &sparkline->columns[(sparkline->head + 1 + i) % SPARKLINE_WIDTH];
+        if (!column->valid)
+            continue;
+
+        level = profile_level (profile, column->min);
+        attrs = COLOR_PAIR (power_zone_color[power_zone (profile, column->min)]);
+        if (column->max - column->min > SPARKLINE_SPREAD_DB)
+            attrs |= A_BOLD;
+
+        wattron (context.content_win, attrs);
+        mvwprintw (context.content_win, y, x + i, "%s",
+                   (current_box_charset == BOX_CHARSET_UTF8) ? BLK[level] : ASCII_LEVELS[level]);
+        wattroff (context.content_win, attrs);
+    }
+}
+
+static void
+print_interface (InterfaceInfo *iface, int x, int y)
+{
+    float tx_power;
+    float rx_power;
+
+    tx_power = iface->tx_power;
+    rx_power = iface->rx_power;
+
+#if defined FORCE_TEST_LEVELS
+    {
+        static float fill = DEFAULT_POWER_MIN;
+        float extra = (current_box_charset == BOX_CHARSET_ASCII) ? 1 : 0.2;
+
+        if ((fill < iface->profile->min) || (fill > iface->profile->max))
+            fill = iface->profile->min;
+
+        tx_power = fill;
+        fill += extra;
+        if (fill > iface->profile->max)
+            fill = iface->profile->min;
+
+        rx_power = fill;
+        fill += extra;
+        if (fill > iface->profile->max)
+            fill = iface->profile->min;
+
+        log_debug ("forced test levels: TX %.2f dBm, RX %.2f dBm", tx_power, rx_power);
+    }
+#endif /* FORCE_TEST_LEVELS */
+
+    /* Print TX/RX boxes and common interface info */
+    print_box (x, y, iface->profile, tx_power, "TX dBm");
+    print_box (x + BOX_WIDTH + BOX_SEPARATION, y, iface->profile, rx_power, "RX dBm");
+    if (sparkline_ms && iface->sparklines) {
+        print_sparkline (x, y + BOX_HEIGHT, iface->profile, &iface->sparklines[SPARKLINE_TX]);
+        print_sparkline (x + BOX_WIDTH + BOX_SEPARATION, y + BOX_HEIGHT, iface->profile, &iface->sparklines[SPARKLINE_RX]);
+    }
+    print_iface_info (x, y + BOX_HEIGHT + SPARKLINE_HEIGHT, iface->name, iface->operstate, interface_error (iface));
+    if (n_channels)
+        print_channel_info (x, y + BOX_HEIGHT + SPARKLINE_HEIGHT + IFACE_INFO_HEIGHT, iface);
+    if (alarms) {
+        int alarm_y = y + BOX_HEIGHT + SPARKLINE_HEIGHT + IFACE_INFO_HEIGHT + CHANNEL_INFO_HEIGHT;
+
+        print_alarm_info (x, alarm_y, &iface->tx_alarm);
+        print_alarm_info (x + BOX_WIDTH + BOX_SEPARATION, alarm_y, &iface->rx_alarm);
+    }
+
+    /* force moving cursor to next line to make app running through minicom happy */
+    mvwprintw (context.content_win, y + INTERFACE_HEIGHT, 0, "");
+}
+
+/*
+ * The table view shows one interface per row, as follows:
+ *
+ *   INTERFACE      LINK            TX dBm TX level         RX dBm RX level
+ *   eth_fc_1000_1  up               -8.63 ████████▉         -12.01 ██████▊
+ *
+ * The level bars use the same scale as the boxes, just horizontally, with
+ * BOX_CONTENT_HEIGHT cells. The channels given with --channels follow, one
+ * column each.
+ */
+
+#define TABLE_HEADER_HEIGHT 1
+#define TABLE_LINK_WIDTH    14
+#define TABLE_POWER_WIDTH   7
+#define TABLE_BAR_WIDTH     BOX_CONTENT_HEIGHT
+#define TABLE_CHANNEL_WIDTH 9
+
+static void
+print_table_bar (int                     x,
+                 int                     y,
+                 const ThresholdProfile *profile,
+                 float                   power)
+{
+    static const int cell_color_background[] = {
+        [POWER_ZONE_BAD]  = COLOR_PAIR_BOX_BACKGROUND_RED,
+        [POWER_ZONE_LOW]  = COLOR_PAIR_BOX_BACKGROUND_YELLOW,
+        [POWER_ZONE_GOOD] = COLOR_PAIR_BOX_BACKGROUND_GREEN,
+    };
+    unsigned int     resolution;
+    unsigned int     fill_height;
+    unsigned int     fill_height_n;
+    unsigned int     fill_height_partial;
+    unsigned int     i;
+
+    resolution = profile->tables->resolution;
+    fill_height = profile_fill (profile, power);
+    fill_height_n = fill_height / resolution;
+    fill_height_partial = fill_height % resolution;
+
+    for (i = 0; i < TABLE_BAR_WIDTH; i++) {
+        const char *fill;
+        int         cell_color;
+
+        if (i < fill_height_n)
+            fill = (resolution == 1) ? " " : HBLK[7];
+        else if ((i == fill_height_n) && (fill_height_partial > 0))
+            fill = HBLK[fill_height_partial - 1];
+        else
+            break;
+
+        if (resolution == 1)
+            cell_color = cell_color_background[profile->tables->row_zone[i]];
+        else
+            cell_color = power_zone_color[profile->tables->row_zone[i]];
+
+        wattron (context.content_win, COLOR_PAIR (cell_color));
+        mvwprintw (context.content_win, y, x + i, "%s", fill);
+        wattroff (context.content_win, COLOR_PAIR (cell_color));
+    }
+}
+
+static void
+print_table_power (int          x,
+                   int          y,
+                   float        power,
+                   const Alarm *alarm)
+{
+    int attrs = 0;
+
+    if (alarms && alarm_is_raised (alarm))
+        attrs = A_BOLD | COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED);
+
+    wattron (context.content_win, attrs);
+    mvwprintw (context.content_win, y, x, "%*.2f", TABLE_POWER_WIDTH - 1, power);
+    wattroff (context.content_win, attrs);
+}
+
+static void
+print_table_header (bool show_bars)
+{
+    unsigned int i;
+    int          x;
+
+    x = 1;
+    mvwprintw (context.content_win, 0, x, "%-*s", context.name_width, "INTERFACE");
+    x += context.name_width + 2;
+    mvwprintw (context.content_win, 0, x, "LINK");
+    x += TABLE_LINK_WIDTH + 2;
+    mvwprintw (context.content_win, 0, x, "%*s", TABLE_POWER_WIDTH - 1, "TX dBm");
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars) {
+        mvwprintw (context.content_win, 0, x, "TX level");
+        x += TABLE_BAR_WIDTH + 2;
+    }
+    mvwprintw (context.content_win, 0, x, "%*s", TABLE_POWER_WIDTH - 1, "RX dBm");
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars) {
+        mvwprintw (context.content_win, 0, x, "RX level");
+        x += TABLE_BAR_WIDTH + 2;
+    }
+    for (i = 0; i < n_channels; i++) {
+        const FiberstatChannelInfo *info;
+        char                        buffer[32];
+
+        info = fiberstat_channel_get_info (channels[i]);
+        snprintf (buffer, sizeof (buffer), "%s %s", info->name, info->unit);
+        mvwprintw (context.content_win, 0, x, "%*s", TABLE_CHANNEL_WIDTH - 1, buffer);
+        x += TABLE_CHANNEL_WIDTH;
+    }
+}
+
+static void
+print_table_row (InterfaceInfo *iface,
+                 int            y,
+                 bool           show_bars)
+{
+    const char   *error;
+    unsigned int  i;
+    int           x;
+
+    x = 1;
+    mvwprintw (context.content_win, y, x, "%-*.*s", context.name_width, context.name_width, iface->name);
+    x += context.name_width + 2;
+
+    error = interface_error (iface);
+    if (error) {
+        wattron (context.content_win, COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED));
+        mvwprintw (context.content_win, y, x, "%-*.*s", TABLE_LINK_WIDTH, TABLE_LINK_WIDTH, error);
+        wattroff (context.content_win, COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED));
+    } else {
+        mvwprintw (context.content_win, y, x, "%-*.*s", TABLE_LINK_WIDTH, TABLE_LINK_WIDTH,
+                   fiberstat_operstate_to_string (iface->operstate));
+    }
+    x += TABLE_LINK_WIDTH + 2;
+
+    print_table_power (x, y, iface->tx_power, &iface->tx_alarm);
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars) {
+        print_table_bar (x, y, iface->profile, iface->tx_power);
+        x += TABLE_BAR_WIDTH + 2;
+    }
+
+    print_table_power (x, y, iface->rx_power, &iface->rx_alarm);
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars) {
+        print_table_bar (x, y, iface->profile, iface->rx_power);
+        x += TABLE_BAR_WIDTH + 2;
+    }
+
+    for (i = 0; i < n_channels; i++) {
+        char buffer[16];
+
+        format_channel_value (buffer, sizeof (buffer), channels[i], iface->channel_values[i], false);
+        mvwprintw (context.content_win, y, x, "%*s", TABLE_CHANNEL_WIDTH - 1, buffer);
+        x += TABLE_CHANNEL_WIDTH;
+    }
+}
+
+/*
+ * The histogram view also shows one interface per row, with the power levels
+ * below which 1%, 50% and 99% of the time was spent, how much time was spent
+ * at each level and the total time tracked:
+ *
+ *   INTERFACE       TX p1   p50   p99 TX time at level  RX p1 ...     TIME
+ *   eth_fc_1000_1   -8.88 -8.63 -8.38         █▁         -12.38 ...    3.2h
+ *
+ * The time at level bars use the same scale as the level bars, with the
+ * height of each cell given by the time spent in its range, relative to the
+ * cell with the most time.
+ */
+
+#define HISTOGRAM_TIME_WIDTH 8
+
+static const double histogram_percentiles[] = { 1.0, 50.0, 99.0 };
+#define HISTOGRAM_N_PERCENTILES (sizeof (histogram_percentiles) / sizeof (histogram_percentiles[0]))
+
+static void
+print_histogram_bar (int                     x,
+                     int                     y,
+                     const ThresholdProfile *profile,
+                     const PowerHistogram   *hist)
+{
+    uint64_t     cells[TABLE_BAR_WIDTH] = { 0 };
+    uint64_t     max = 0;
+    unsigned int n_levels;
+    unsigned int i;
+
+    if (!hist || !hist->total)
+        return;
+
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+        cells[profile->tables->bucket_cell[i]] += hist->buckets[i];
+    for (i = 0; i < TABLE_BAR_WIDTH; i++) {
+        if (cells[i] > max)
+            max = cells[i];
+    }
+    if (!max)
+        return;
+
+    n_levels = profile_n_levels ();
+    for (i = 0; i < TABLE_BAR_WIDTH; i++) {
+        unsigned int level;
+        int          cell_color;
+
+        if (!cells[i])
+            continue;
+
+        level = (unsigned int) (((cells[i] * n_levels) + max - 1) / max);
+        cell_color = power_zone_color[profile->tables->row_zone[i]];
+
+        wattron (context.content_win, COLOR_PAIR (cell_color));
+        mvwprintw (context.content_win, y, x + i, "%s",
+                   (current_box_charset == BOX_CHARSET_UTF8) ? BLK[level - 1] : ASCII_LEVELS[level - 1]);
+        wattroff (context.content_win, COLOR_PAIR (cell_color));
+    }
+}
+
+/* Percentiles of one direction, returns the x after them */
+static int
+print_histogram_percentiles (int                   x,
+                             int                   y,
+                             const PowerHistogram *hist)
+{
+    unsigned int i;
+
+    for (i = 0; i < HISTOGRAM_N_PERCENTILES; i++) {
+        float power;
+
+        power = histogram_percentile (hist, histogram_percentiles[i]);
+        if (isnan (power))
+            mvwprintw (context.content_win, y, x, "%*s", TABLE_POWER_WIDTH - 1, "-");
+        else
+            mvwprintw (context.content_win, y, x, "%*.2f", TABLE_POWER_WIDTH - 1, power);
+        x += TABLE_POWER_WIDTH;
+    }
+    return x + 1;
+}
+
+static void
+print_histogram_header (bool show_bars)
+{
+    const char   *directions[] = { "TX", "RX" };
+    unsigned int  i;
+    unsigned int  j;
+    int           x;
+
+    x = 1;
+    mvwprintw (context.content_win, 0, x, "%-*s", context.name_width, "INTERFACE");
+    x += context.name_width + 2;
+    for (i = 0; i < HISTOGRAM_N_DIRECTIONS; i++) {
+        for (j = 0; j < HISTOGRAM_N_PERCENTILES; j++) {
+            char label[16];
+
+            snprintf (label, sizeof (label), "%s%sp%.0f", j ? "" : directions[i], j ? "" : " ", histogram_percentiles[j]);
+            mvwprintw (context.content_win, 0, x, "%*s", TABLE_POWER_WIDTH - 1, label);
+            x += TABLE_POWER_WIDTH;
+        }
+        x++;
+        if (show_bars) {
+            mvwprintw (context.content_win, 0, x, "%s time at level", directions[i]);
+            x += TABLE_BAR_WIDTH + 2;
+        }
+    }
+    mvwprintw (context.content_win, 0, x, "%*s", HISTOGRAM_TIME_WIDTH - 1, "TIME");
+}
+
+static void
+print_histogram_row (InterfaceInfo *iface,
+                     int            y,
+                     bool           show_bars)
+{
+    const PowerHistogram *tx = NULL;
+    const PowerHistogram *rx = NULL;
+    char                  duration[16];
+    double                hours;
+    int                   x;
+
+    if (iface->histograms) {
+        tx = &iface->histograms[HISTOGRAM_TX];
+        rx = &iface->histograms[HISTOGRAM_RX];
+    }
+
+    x = 1;
+    mvwprintw (context.content_win, y, x, "%-*.*s", context.name_width, context.name_width, iface->name);
+    x += context.name_width + 2;
+
+    x = print_histogram_percentiles (x, y, tx);
+    if (show_bars) {
+        print_histogram_bar (x, y, iface->profile, tx);
+        x += TABLE_BAR_WIDTH + 2;
+    }
+
+    x = print_histogram_percentiles (x, y, rx);
+    if (show_bars) {
+        print_histogram_bar (x, y, iface->profile, rx);
+        x += TABLE_BAR_WIDTH + 2;
+    }
+
+    hours = (tx && rx) ? (((tx->total > rx->total) ? tx->total : rx->total) / 3600e6) : 0;
+    if (hours < 1)
+        snprintf (duration, sizeof (duration), "%.0fm", hours * 60);
+    else if (hours < 48)
+        snprintf (duration, sizeof (duration), "%.1fh", hours);
+    else
+        snprintf (duration, sizeof (duration), "%.1fd", hours / 24);
+    mvwprintw (context.content_win, y, x, "%*s", HISTOGRAM_TIME_WIDTH - 1, duration);
+}
+
+/******************************************************************************/
+/* Core application logic */
+
+/* Returns the x after the part, or -1 if it doesn't fit before max_x */
+static int
+print_health_part (int         x,
+                   int         max_x,
+                   const char *part,
+                   int         attrs)
+{
+    if (x < 0 || x + (int) strlen (part) >= max_x)
+        return -1;
+
+    wattron (context.header_win, attrs);
+    mvwprintw (context.header_win, 0, x, "%s", part);
+    wattroff (context.header_win, attrs);
+    return x + strlen (part) + 1;
+}
+
+/* Shows as many parts of the summary as fit, e.g.
+ *   R:2 Y:4 G:194 up:150/200 stale:0
+ */
+static void
+print_health_summary (int max_x)
+{
+    static const char *zone_format[] = {
+        [POWER_ZONE_BAD]  = "R:%u",
+        [POWER_ZONE_LOW]  = "Y:%u",
+        [POWER_ZONE_GOOD] = "G:%u",
+    };
+    char         part[32];
+    unsigned int i;
+    int          x = 1;
+
+    for (i = 0; i < POWER_N_ZONES; i++) {
+        int attrs;
+
+        attrs = COLOR_PAIR (power_zone_color[i]);
+        if (i == POWER_ZONE_BAD && health.n_zone[i])
+            attrs |= A_BOLD;
+        snprintf (part, sizeof (part), zone_format[i], health.n_zone[i]);
+        x = print_health_part (x, max_x, part, attrs);
+    }
+
+    snprintf (part, sizeof (part), "up:%u/%u", health.n_operstate[FIBERSTAT_OPERSTATE_UP], health.n_ifaces);
+    x = print_health_part (x, max_x, part, 0);
+
+    snprintf (part, sizeof (part), "stale:%u", health.n_stale);
+    print_health_part (x, max_x, part, health.n_stale ? (A_BOLD | COLOR_PAIR (COLOR_PAIR_BOX_TEXT_RED)) : 0);
+}
+
+static void
+refresh_title (void)
+{
+    char title[64];
+    int  title_x;
+
+    werase (context.header_win);
+
+    snprintf (title, sizeof (title), "%s %s", PROGRAM_NAME, PACKAGE_VERSION);
+    title_x = (context.max_x / 2) - (strlen (title) / 2);
+    wattron(context.header_win, A_BOLD | A_UNDERLINE | COLOR_PAIR (COLOR_PAIR_TITLE_TEXT));
+    mvwprintw (context.header_win, 0, title_x, "%s", title);
+    wattroff(context.header_win, A_BOLD | A_UNDERLINE | COLOR_PAIR (COLOR_PAIR_TITLE_TEXT));
+
+    /* health summary at the left of the title */
+    if (health.n_ifaces)
+        print_health_summary (title_x - 1);
+
+    /* discovery progress at the right of the title, or the group drilled
+     * down into once discovered */
+    if (context.discovering) {
+        wattron (context.header_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+        mvwprintw (context.header_win, 0, context.max_x - 1 - strlen (context.discovery_progress),
+                   "%s", context.discovery_progress);
+        wattroff (context.header_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+    } else if (context.group) {
+        char group[64];
+
+        snprintf (group, sizeof (group), "group %.*s", MAX_NAME_WIDTH, context.group->name);
+        wattron (context.header_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+        mvwprintw (context.header_win, 0, context.max_x - 1 - strlen (group), "%s", group);
+        wattroff (context.header_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+    }
+
+    wrefresh (context.header_win);
+}
+
+static void
+refresh_log (void)
+{
+    if (!context.log_win)
+        return;
+
+    werase (context.log_win);
+    mvwprintw (context.log_win, 0, 1, "%.*s", context.max_x - 2, context.alarm_event);
+    wrefresh (context.log_win);
+}
+
+/* The margin at left and right allows to place the scrolling
+ * arrows inside the margin (in the middle, at 2) */
+#define MARGIN_HORIZONTAL 5
+
+#define INTERFACE_SEPARATION_HORIZONTAL  3
+#define INTERFACE_SEPARATION_VERTICAL    3
+
+static void
+print_no_interfaces (void)
+{
+    const char *message;
+
+    message = context.discovering ? "Discovering interfaces..." : "No interfaces found";
+    mvwprintw (context.content_win,
+               (context.max_y - 1 - LOG_HEIGHT) / 2,
+               (context.max_x / 2) - (strlen (message) / 2),
+               "%s", message);
+}
+
+static void
+refresh_table (void)
+{
+    static const char *sort_mark[] = {
+        [SORT_MODE_NAME]     = "",
+        [SORT_MODE_RX_MARGIN] = "RX margin",
+        [SORT_MODE_TX_MARGIN] = "TX margin",
+    };
+    int          n_rows;
+    unsigned int i;
+    unsigned int last_iface_index;
+    unsigned int table_width;
+    bool         show_bars;
+    int          y;
+    char         position[32];
+    SortMode     sort_mode;
+
+    werase (context.content_win);
+
+    /* only the rows that fit in the window are ever printed */
+    n_rows = context.max_y - 1 - LOG_HEIGHT - TABLE_HEADER_HEIGHT;
+    if (n_rows <= 0)
+        n_rows = 1;
+    context.n_ifaces_per_window = n_rows;
+
+    last_iface_index = context.first_iface_index + n_rows;
+    if (last_iface_index > shown_n_ifaces ())
+        last_iface_index = shown_n_ifaces ();
+
+    /* level bars are only printed if they fit */
+    if (context.view == VIEW_HISTOGRAM)
+        table_width = 1 + context.name_width + 2 + (2 * ((HISTOGRAM_N_PERCENTILES * TABLE_POWER_WIDTH) + 1)) + HISTOGRAM_TIME_WIDTH;
+    else
+        table_width = 1 + context.name_width + 2 + TABLE_LINK_WIDTH + 2 + (2 * (TABLE_POWER_WIDTH + 1)) + (n_channels * TABLE_CHANNEL_WIDTH);
+    show_bars = ((table_width + (2 * TABLE_BAR_WIDTH) + 2) < context.max_x);
+
+    /* header */
+    wattron (context.content_win, A_BOLD);
+    if (context.view == VIEW_HISTOGRAM)
+        print_histogram_header (show_bars);
+    else
+        print_table_header (show_bars);
+    wattroff (context.content_win, A_BOLD);
+
+    /* position and sorting info at the right of the header; the members of
+     * a group are always sorted by name */
+    sort_mode = context.group ? SORT_MODE_NAME : context.sort_mode;
+    snprintf (position, sizeof (position), "%s%s%u-%u/%u",
+              sort_mark[sort_mode],
+              (sort_mode != SORT_MODE_NAME) ? " sort  " : "",
+              shown_n_ifaces () ? context.first_iface_index + 1 : 0,
+              last_iface_index, shown_n_ifaces ());
+    wattron (context.content_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+    mvwprintw (context.content_win, 0, context.max_x - 1 - strlen (position), "%s", position);
+    wattroff (context.content_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+
+    if (!shown_n_ifaces ())
+        print_no_interfaces ();
+
+    for (y = TABLE_HEADER_HEIGHT, i = context.first_iface_index; i < last_iface_index; i++, y++) {
+        if (context.view == VIEW_HISTOGRAM)
+            print_histogram_row (shown_nth (i), y, show_bars);
+        else
+            print_table_row (shown_nth (i), y, show_bars);
+    }
+
+    wrefresh (context.content_win);
+}
+
+/*
+ * The group view shows one group per row, with how many members are in each
+ * zone and the worst and median RX power of the members:
+ *
+ *   GROUP         IFACES   BAD   LOW  GOOD  worst RX worst        median RX median
+ *   eth_fc_1000      200     1     0   199 -25.12                 -12.12 ██████████▊
+ *
+ * The selected group is highlighted, and may be drilled down into.
+ */
+
+#define GROUP_COUNT_WIDTH 6
+
+static const char *group_zone_label[] = {
+    [POWER_ZONE_BAD]  = "BAD",
+    [POWER_ZONE_LOW]  = "LOW",
+    [POWER_ZONE_GOOD] = "GOOD",
+};
+
+static void
+print_group_header (bool show_bars)
+{
+    unsigned int i;
+    int          x;
+
+    x = 1;
+    mvwprintw (context.content_win, 0, x, "%-*s", grouping.name_width, "GROUP");
+    x += grouping.name_width + 2;
+    mvwprintw (context.content_win, 0, x, "%*s", GROUP_COUNT_WIDTH, "IFACES");
+    x += GROUP_COUNT_WIDTH;
+    for (i = 0; i < POWER_N_ZONES; i++) {
+        mvwprintw (context.content_win, 0, x, "%*s", GROUP_COUNT_WIDTH, group_zone_label[i]);
+        x += GROUP_COUNT_WIDTH;
+    }
+    x += 1;
+    mvwprintw (context.content_win, 0, x, "%*s", TABLE_POWER_WIDTH - 1, "worst");
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars) {
+        mvwprintw (context.content_win, 0, x, "RX worst");
+        x += TABLE_BAR_WIDTH + 2;
+    }
+    mvwprintw (context.content_win, 0, x, "%*s", TABLE_POWER_WIDTH - 1, "median");
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars)
+        mvwprintw (context.content_win, 0, x, "RX median");
+}
+
+static void
+print_group_row (const Group *group,
+                 int          y,
+                 bool         selected,
+                 bool         show_bars)
+{
+    unsigned int i;
+    float        worst;
+    float        median;
+    int          x;
+
+    x = 1;
+    if (selected)
+        wattron (context.content_win, A_REVERSE);
+    mvwprintw (context.content_win, y, x, "%-*.*s", grouping.name_width, grouping.name_width, group->name);
+    if (selected)
+        wattroff (context.content_win, A_REVERSE);
+    x += grouping.name_width + 2;
+
+    mvwprintw (context.content_win, y, x, "%*u", GROUP_COUNT_WIDTH, group->n_members);
+    x += GROUP_COUNT_WIDTH;
+    for (i = 0; i < POWER_N_ZONES; i++) {
+        int attrs;
+
+        attrs = group->n_zone[i] ? COLOR_PAIR (power_zone_color[i]) : 0;
+        if (i == POWER_ZONE_BAD && group->n_zone[i])
+            attrs |= A_BOLD;
+        wattron (context.content_win, attrs);
+        mvwprintw (context.content_win, y, x, "%*u", GROUP_COUNT_WIDTH, group->n_zone[i]);
+        wattroff (context.content_win, attrs);
+        x += GROUP_COUNT_WIDTH;
+    }
+    x += 1;
+
+    worst = group_rx_percentile (group, 0.0);
+    median = group_rx_percentile (group, 50.0);
+
+    mvwprintw (context.content_win, y, x, "%*.2f", TABLE_POWER_WIDTH - 1, worst);
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars) {
+        print_table_bar (x, y, group->profile, worst);
+        x += TABLE_BAR_WIDTH + 2;
+    }
+    mvwprintw (context.content_win, y, x, "%*.2f", TABLE_POWER_WIDTH - 1, median);
+    x += TABLE_POWER_WIDTH + 1;
+    if (show_bars)
+        print_table_bar (x, y, group->profile, median);
+}
+
+static void
+refresh_groups (void)
+{
+    int          n_rows;
+    unsigned int i;
+    unsigned int last_group_index;
+    unsigned int table_width;
+    bool         show_bars;
+    int          y;
+    char         position[32];
+
+    werase (context.content_win);
+
+    n_rows = context.max_y - 1 - LOG_HEIGHT - TABLE_HEADER_HEIGHT;
+    if (n_rows <= 0)
+        n_rows = 1;
+    context.n_groups_per_window = n_rows;
+
+    /* keep the selected group in the window */
+    if (context.selected_group >= grouping.n_groups)
+        context.selected_group = grouping.n_groups ? grouping.n_groups - 1 : 0;
+    if (context.selected_group < context.first_group_index)
+        context.first_group_index = context.selected_group;
+    else if (context.selected_group >= context.first_group_index + n_rows)
+        context.first_group_index = context.selected_group - n_rows + 1;
+
+    last_group_index = context.first_group_index + n_rows;
+    if (last_group_index > grouping.n_groups)
+        last_group_index = grouping.n_groups;
+
+    table_width = 1 + grouping.name_width + 2 + ((POWER_N_ZONES + 1) * GROUP_COUNT_WIDTH) + 1 + (2 * (TABLE_POWER_WIDTH + 1));
+    show_bars = ((table_width + (2 * TABLE_BAR_WIDTH) + 2) < context.max_x);
+
+    wattron (context.content_win, A_BOLD);
+    print_group_header (show_bars);
+    wattroff (context.content_win, A_BOLD);
+
+    snprintf (position, sizeof (position), "%u/%u",
+              grouping.n_groups ? context.selected_group + 1 : 0, grouping.n_groups);
+    wattron (context.content_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+    mvwprintw (context.content_win, 0, context.max_x - 1 - strlen (position), "%s", position);
+    wattroff (context.content_win, COLOR_PAIR (COLOR_PAIR_SHORTCUT_TEXT));
+
+    if (!grouping.n_groups)
+        print_no_interfaces ();
+
+    for (y = TABLE_HEADER_HEIGHT, i = context.first_group_index; i < last_group_index; i++, y++)
+        print_group_row (grouping.groups[i], y, (i == context.selected_group), show_bars);
+
+    wrefresh (context.content_win);
+}
+
+static void
+refresh_contents (void)
+{
+    unsigned int i, n, x, y;
+    unsigned int total_width;
+    unsigned int total_height;
+    unsigned int x_initial;
+    unsigned int n_ifaces_per_row;
+    unsigned int n_ifaces_per_column;
+    unsigned int n_ifaces_per_window;
+    unsigned int n_rows;
+    unsigned int n_columns;
+    unsigned int content_max_width;
+    unsigned int content_max_height;
+    unsigned int last_iface_index;
+    unsigned int visible_ifaces;
+
+    if (context.groups_view) {
+        refresh_groups ();
+        return;
+    }
+
+    if (context.view != VIEW_BOXES) {
+        refresh_table ();
+        return;
+    }
+
+    if (!shown_n_ifaces ()) {
+        werase (context.content_win);
+        print_no_interfaces ();
+        wrefresh (context.content_win);
+        return;
+    }
+
+    content_max_width = (context.max_x - (MARGIN_HORIZONTAL * 2));
+    log_debug ("width: window %u, interface %u, content max %u",
+               context.max_x, INTERFACE_WIDTH, content_max_width);
+
+    content_max_height = context.max_y - LOG_HEIGHT;
+    log_debug ("height: window %u, interface %u, content max %u",
+               context.max_y, INTERFACE_HEIGHT, content_max_height);
+
+    werase (context.content_win);
+
+    /* compute how many interfaces we can print in the window */
+
+    /* rows... */
+    n_ifaces_per_row = 0;
+    while (1) {
+        unsigned int next = ((n_ifaces_per_row + 1) * INTERFACE_WIDTH) + ((n_ifaces_per_row) * INTERFACE_SEPARATION_HORIZONTAL);
+        if (next >= content_max_width)
+            break;
+        n_ifaces_per_row++;
+    }
+    log_debug ("number of interfaces per row: %u", n_ifaces_per_row);
+
+    if (n_ifaces_per_row == 0) {
+        log_warning ("window doesn't allow one full interface per row: forcing it anyway");
+        n_ifaces_per_row = 1;
+    }
+
+    /* columns... */
+    n_ifaces_per_column = 0;
+    while (1) {
+        unsigned int next = ((n_ifaces_per_column + 1) * INTERFACE_HEIGHT) + ((n_ifaces_per_column) * INTERFACE_SEPARATION_VERTICAL);
+        if (next >= content_max_height)
+            break;
+        n_ifaces_per_column++;
+    }
+    log_debug ("number of interfaces per column: %u", n_ifaces_per_column);
+
+    if (n_ifaces_per_column == 0) {
+        log_warning ("window doesn't allow one full interface per column: forcing it anyway");
+        n_ifaces_per_column = 1;
+    }
+
+    /* totals... */
+    n_ifaces_per_window = n_ifaces_per_row * n_ifaces_per_column;
+    context.n_ifaces_per_window = n_ifaces_per_window;
+    log_debug ("window allows up to %u interfaces (%u per rows and %u per column)",
+               n_ifaces_per_window, n_ifaces_per_row, n_ifaces_per_column);
+
+    /* we skip all interfaces that have been scrolled */
+    visible_ifaces = (shown_n_ifaces () - context.first_iface_index);
+
+    /* compute amount of rows and columns we're printing */
+    n_rows = visible_ifaces / n_ifaces_per_row;
+    if (n_rows > 0) {
+        if (visible_ifaces % n_ifaces_per_row > 0)
+            n_rows++;
+        if (n_rows > n_ifaces_per_column)
+            n_rows = n_ifaces_per_column;
+    } else
+        n_rows = 1;
+    n_columns = (visible_ifaces > n_ifaces_per_row) ? n_ifaces_per_row : visible_ifaces;
+    log_debug ("printing %u rows with up to %u interfaces per row",
+               n_rows, n_columns);
+
+    /* compute total width and height in order to center elements in the interface */
+    total_width = (n_columns * INTERFACE_WIDTH) + ((n_columns - 1) * INTERFACE_SEPARATION_HORIZONTAL);
+    total_height = (n_rows * INTERFACE_HEIGHT) + ((n_rows - 1) * INTERFACE_SEPARATION_VERTICAL);
+    log_debug ("total width %u, total height %u", total_width, total_height);
+
+    /* check if we need scrolling support */
+    context.left_scroll_arrow = false;
+    context.right_scroll_arrow = false;
+    if ((context.first_iface_index > 0) || (visible_ifaces > n_ifaces_per_window)) {
+        last_iface_index = context.first_iface_index + n_ifaces_per_window;
+        if (last_iface_index >= shown_n_ifaces ())
+            last_iface_index = shown_n_ifaces ();
+        else
+            context.right_scroll_arrow = true;
+        if (context.first_iface_index > 0)
+            context.left_scroll_arrow = true;
+    } else
+        last_iface_index = shown_n_ifaces ();
+
+    /* print scrolling arrows if needed */
+    if (context.left_scroll_arrow) {
+        wattron(context.content_win, A_BOLD);
+        mvwprintw (context.content_win,
+                   total_height / 2,
+                   (context.max_x / 2) - (total_width / 2) - MARGIN_HORIZONTAL + 2,
+                   "<");
+        wattroff(context.content_win, A_BOLD);
+    }
+
+    if (context.right_scroll_arrow) {
+        wattron(context.content_win, A_BOLD);
+        mvwprintw (context.content_win,
+                   total_height / 2,
+                   (context.max_x / 2) + (total_width / 2) + MARGIN_HORIZONTAL - 2,
+                   ">");
+        wattroff(context.content_win, A_BOLD);
+    }
+
+    x_initial = x = (context.max_x / 2) - (total_width / 2);
+    y = 0;
+
+    for (n = 0, i = context.first_iface_index; i < last_iface_index; i++, n++) {
+        print_interface (shown_nth (i), x, y);
+        if (((n + 1) % n_ifaces_per_row) == 0) {
+            x = x_initial;
+            y += (INTERFACE_HEIGHT + INTERFACE_SEPARATION_VERTICAL);
+        } else {
+            x += (INTERFACE_WIDTH + INTERFACE_SEPARATION_HORIZONTAL);
+        }
+    }
+
+    wrefresh (context.content_win);
+}
+
+/******************************************************************************/
+
+static float
+reload_power_from_file (int fd)
+{
+    float power;
+
+    if (fiberstat_read_power (fd, &power) < 0)
+        return POWER_UNK;
+    return power;
+}
+
+/* Interfaces not shown in the window only need to be reloaded at the
+ * background rate, unless they feed the alarm engine. Until the first
+ * layout has been computed, all interfaces are considered visible. */
+static void
+mark_visible_interfaces (void)
+{
+    unsigned int i;
+    unsigned int last_iface_index;
+
+    context.reload_id++;
+    last_iface_index = context.first_iface_index + context.n_ifaces_per_window;
+    if (last_iface_index > shown_n_ifaces ())
+        last_iface_index = shown_n_ifaces ();
+    for (i = context.first_iface_index; i < last_iface_index; i++)
+        shown_nth (i)->visible_reload_id = context.reload_id;
+}
+
+static bool
+interface_is_visible (const InterfaceInfo *iface)
+{
+    if (!context.n_ifaces_per_window)
+        return true;
+    return (iface->visible_reload_id == context.reload_id);
+}
+
+/******************************************************************************/
+/* File descriptor budget
+ *
+ * Every interface needs three files open to be reloaded, plus one per channel
+ * given with --channels. With a fd budget,
+ * only as many interfaces as fit in the budget keep their files open, in a
+ * least recently used list: any other interface gets its files opened again
+ * when it needs to be reloaded, closing the ones of the interface reloaded
+ * least recently. Interfaces shown in the window or with raised alarms are
+ * pinned, and never closed.
+ */
+
+#define INTERFACE_N_FILES (3 + n_channels)
+
+static struct {
+    InterfaceInfo *head; /* most recently used */
+    InterfaceInfo *tail;
+    unsigned int   n_open;
+    unsigned int   n_hits;
+    unsigned int   n_misses;
+    unsigned int   n_evictions;
+} files_lru;
+
+static void
+files_lru_unlink (InterfaceInfo *iface)
+{
+    if (iface->lru_prev)
+        iface->lru_prev->lru_next = iface->lru_next;
+    else
+        files_lru.head = iface->lru_next;
+    if (iface->lru_next)
+        iface->lru_next->lru_prev = iface->lru_prev;
+    else
+        files_lru.tail = iface->lru_prev;
+    iface->lru_prev = NULL;
+    iface->lru_next = NULL;
+}
+
+static void
+files_lru_push (InterfaceInfo *iface)
+{
+    iface->lru_prev = NULL;
+    iface->lru_next = files_lru.head;
+    if (files_lru.head)
+        files_lru.head->lru_prev = iface;
+    else
+        files_lru.tail = iface;
+    files_lru.head = iface;
+}
+
+static bool
+interface_is_pinned (const InterfaceInfo *iface)
+{
+    /* before the first layout, all interfaces are considered visible */
+    return ((context.n_ifaces_per_window && interface_is_visible (iface)) ||
+            alarm_is_raised (&iface->tx_alarm) ||
+            alarm_is_raised (&iface->rx_alarm));
+}
+
+/* Close files of the least recently used interfaces until there is room
+ * for one more interface, if possible */
+static void
+files_lru_evict (void)
+{
+    InterfaceInfo *iface;
+    unsigned int   max_open;
+
+    max_open = fd_budget / INTERFACE_N_FILES;
+    for (iface = files_lru.tail; iface && (files_lru.n_open >= max_open); ) {
+        InterfaceInfo *prev = iface->lru_prev;
+
+        if (!interface_is_pinned (iface)) {
+            files_lru_unlink (iface);
+            interface_close_files (iface);
+            iface->files_open = false;
+            files_lru.n_open--;
+            files_lru.n_evictions++;
+        }
+        iface = prev;
+    }
+}
+
+/* Reopen attempts of failing files in the current reload cycle */
+static FiberstatFileCycle reload_files_cycle;
+
+/* Make sure the files of the interface are open before reloading it, also
+ * retrying the ones failing */
+static void
+acquire_interface_files (InterfaceInfo *iface)
+{
+    unsigned int n_failed;
+
+    /* interfaces without hwmon (e.g. test ones) have no files */
+    if (!iface->hwmon)
+        return;
+
+    if (!fd_budget) {
+        interface_open_files (iface, &reload_files_cycle, -1);
+        return;
+    }
+
+    if (iface->files_open) {
+        files_lru.n_hits++;
+        files_lru_unlink (iface);
+        files_lru_push (iface);
+        interface_open_files (iface, &reload_files_cycle, -1);
+        return;
+    }
+
+    files_lru.n_misses++;
+    files_lru_evict ();
+    n_failed = interface_open_files (iface, &reload_files_cycle, -1);
+    if (n_failed)
+        log_debug ("couldn't open %u files for interface '%s'", n_failed, iface->name);
+    iface->files_open = true;
+    files_lru.n_open++;
+    files_lru_push (iface);
+}
+
+static void
+check_fd_limit (void)
+{
+    struct rlimit limit;
+
+    if (fd_budget || getrlimit (RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY)
+        return;
+
+    if ((rlim_t) context.n_ifaces * INTERFACE_N_FILES >= limit.rlim_cur)
+        log_warning ("%u interfaces need more files open than allowed (%lu): use a fd budget",
+                     context.n_ifaces, (unsigned long) limit.rlim_cur);
+}
+
+static void
+teardown_fd_budget (void)
+{
+    unsigned int n_total;
+
+    if (!fd_budget)
+        return;
+
+    n_total = files_lru.n_hits + files_lru.n_misses;
+    log_info ("fd budget of %u: %u hits, %u misses (%.1f%% hit rate), %u evictions",
+              fd_budget, files_lru.n_hits, files_lru.n_misses,
+              n_total ? (100.0 * files_lru.n_hits / n_total) : 0.0,
+              files_lru.n_evictions);
+}
+
+/******************************************************************************/
+/* Real-time sampling
+ *
+ * The sampling threads (the main thread running the reload loop, the sampler
+ * threads and the capture sampler thread) may be pinned to a set of CPUs and
+ * run with SCHED_FIFO priority, so that the sampling period doesn't wander
+ * under system load. Threads inherit both settings from the thread creating
+ * them, so the ones not sampling (discovery and capture writer) go back to
+ * the defaults when they start. Memory may also be locked, so that sampling
+ * never waits for page faults.
+ *
+ * Every sampling loop keeps a histogram of how much each actual period
+ * deviates from the requested one.
+ */
+
+#define PREFAULT_STACK_SIZE (256 * 1024)
+
+/* With locked memory, the whole stack of every thread is locked, so threads
+ * are created with small stacks instead of the default ones (usually 8 MB) */
+#define THREAD_STACK_SIZE (2 * PREFAULT_STACK_SIZE)
+static pthread_attr_t  thread_attr_small_stack;
+static pthread_attr_t *thread_attr;
+
+static cpu_set_t default_cpus;
+
+static const double jitter_bucket_limits_ms[] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0 };
+
+#define JITTER_N_BUCKETS (sizeof (jitter_bucket_limits_ms) / sizeof (jitter_bucket_limits_ms[0]) + 1)
+
+typedef struct {
+    struct timespec last;
+    unsigned long   n_periods;
+    unsigned long   buckets[JITTER_N_BUCKETS];
+    double          total_ms;
+    double          max_ms;
+} JitterHistogram;
+
+static void
+jitter_record (JitterHistogram       *jitter,
+               const struct timespec *now,
+               int                    period_ms)
+{
+    double       deviation_ms;
+    unsigned int i;
+
+    if (jitter->last.tv_sec || jitter->last.tv_nsec) {
+        deviation_ms = fabs (timespec_diff_ms (now, &jitter->last) - period_ms);
+        for (i = 0; i < JITTER_N_BUCKETS - 1; i++) {
+            if (deviation_ms < jitter_bucket_limits_ms[i])
+                break;
+        }
+        jitter->buckets[i]++;
+        jitter->n_periods++;
+        jitter->total_ms += deviation_ms;
+        if (deviation_ms > jitter->max_ms)
+            jitter->max_ms = deviation_ms;
+    }
+    jitter->last = *now;
+}
+
+/* The next period isn't recorded, e.g. when the requested period changes */
+static void
+jitter_restart (JitterHistogram *jitter)
+{
+    jitter->last.tv_sec = 0;
+    jitter->last.tv_nsec = 0;
+}
+
+static JitterHistogram reload_jitter;
+
+/* Besides the whole run, the reload jitter is also kept for a window at the
+ * start and for the last complete window, so that a drift along long runs
+ * can be seen. The start window skips the first window, which includes the
+ * startup. */
+#define JITTER_WINDOW_PERIODS 6000
+
+static JitterHistogram reload_jitter_start;
+static JitterHistogram reload_jitter_current;
+static JitterHistogram reload_jitter_end;
+static unsigned long   reload_jitter_n_windows;
+
+static void
+reload_jitter_record (const struct timespec *now,
+                      int                    period_ms)
+{
+    jitter_record (&reload_jitter, now, period_ms);
+    jitter_record (&reload_jitter_current, now, period_ms);
+    if (reload_jitter_current.n_periods < JITTER_WINDOW_PERIODS)
+        return;
+
+    if (++reload_jitter_n_windows == 2)
+        reload_jitter_start = reload_jitter_current;
+    reload_jitter_end = reload_jitter_current;
+    memset (&reload_jitter_current, 0, sizeof (reload_jitter_current));
+    reload_jitter_current.last = *now;
+}
+
+static void
+reload_jitter_restart (void)
+{
+    jitter_restart (&reload_jitter);
+    jitter_restart (&reload_jitter_current);
+}
+
+static void
+print_jitter (const char            *name,
+              const char            *window,
+              const JitterHistogram *jitter)
+{
+    unsigned int i;
+
+    if (!jitter->n_periods)
+        return;
+
+    printf ("%s period jitter%s%s:\n"
+            "  periods:              %lu\n"
+            "  deviation:            %.3f ms average, %.3f ms max\n",
+            name, window ? ", " : "", window ? window : "", jitter->n_periods,
+            jitter->total_ms / jitter->n_periods, jitter->max_ms);
+    for (i = 0; i < JITTER_N_BUCKETS; i++) {
+        char bucket[32];
+
+        if (i < JITTER_N_BUCKETS - 1)
+            snprintf (bucket, sizeof (bucket), "< %.2f ms", jitter_bucket_limits_ms[i]);
+        else
+            snprintf (bucket, sizeof (bucket), ">= %.2f ms", jitter_bucket_limits_ms[i - 1]);
+        printf ("  %-21s %10lu (%5.1f%%)\n",
+                bucket, jitter->buckets[i], (100.0 * jitter->buckets[i]) / jitter->n_periods);
+    }
+}
+
+/* Touch the stack that may be used, so that it's already mapped and locked */
+static void
+prefault_stack (void)
+{
+    volatile char buffer[PREFAULT_STACK_SIZE];
+    size_t        i;
+
+    for (i = 0; i < sizeof (buffer); i += 4096)
+        buffer[i] = 0;
+}
+
+/* Called by threads not sampling, created from a sampling thread */
+static void
+realtime_reset_thread (void)
+{
+    struct sched_param param = { 0 };
+
+    if (cpu_list)
+        pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &default_cpus);
+    if (rt_priority)
+        pthread_setschedparam (pthread_self (), SCHED_OTHER, &param);
+}
+
+static int
+create_thread (pthread_t   *thread,
+               const char  *name,
+               void      *(*func) (void *),
+               void        *user_data)
+{
+    int error;
+
+    error = pthread_create (thread, thread_attr, func, user_data);
+    if (error) {
+        log_error ("couldn't create %s thread: %s%s", name, strerror (error),
+                   lock_memory ? " (locked memory limit too low?)" : "");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+setup_realtime (void)
+{
+    if (cpu_list) {
+        int error;
+
+        pthread_getaffinity_np (pthread_self (), sizeof (cpu_set_t), &default_cpus);
+        error = pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &sampling_cpus);
+        if (error) {
+            log_error ("couldn't set CPU affinity: %s", strerror (error));
+            return -1;
+        }
+        log_info ("sampling threads running in CPUs %s", cpu_list);
+    }
+
+    if (rt_priority) {
+        struct sched_param param = { 0 };
+        int                error;
+
+        param.sched_priority = rt_priority;
+        error = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+        if (error) {
+            log_error ("couldn't set SCHED_FIFO priority %d: %s", rt_priority, strerror (error));
+            return -1;
+        }
+        log_info ("sampling threads running with SCHED_FIFO priority %d", rt_priority);
+    }
+
+    if (lock_memory) {
+        pthread_attr_init (&thread_attr_small_stack);
+        if (pthread_attr_setstacksize (&thread_attr_small_stack, THREAD_STACK_SIZE) != 0) {
+            log_error ("couldn't set thread stack size");
+            return -1;
+        }
+        thread_attr = &thread_attr_small_stack;
+        /* the malloc arenas of each thread would be locked as well */
+        mallopt (M_ARENA_MAX, 1);
+
+        /* memory allocated from now on (interfaces, rings, thread stacks) is
+         * locked and faulted in right away as well */
+        if (mlockall (MCL_CURRENT | MCL_FUTURE) < 0) {
+            log_error ("couldn't lock memory: %s", strerror (errno));
+            return -1;
+        }
+        prefault_stack ();
+        log_info ("memory locked");
+    }
+
+    return 0;
+}
+
+/******************************************************************************/
+/* Parallel sampling
+ *
+ * Each reload cycle is split in three phases. First, the interfaces to reload
+ * are selected and their files made available, in the main thread. Then, the
+ * values are read by a pool of sampler threads: each thread has its own shard
+ * of the interfaces, processed in chunks, and once done it steals chunks from
+ * the shards of the other threads, so that one slow hwmon driver doesn't hold
+ * up the whole cycle. Once all threads reach the end of the cycle, the new
+ * values are applied (alarms, ordering and redraws) in the main thread.
+ *
+ * Every cycle is a numbered snapshot. Each value read is tagged with the
+ * CLOCK_MONOTONIC time the read finished, and the snapshot keeps the times of
+ * the first and last power values read, so that the skew between the values
+ * of the first and last interfaces of the cycle is known. In coherent mode,
+ * the sampler threads only read the power files, back to back; operational
+ * states and other channels are read and values parsed once all power files
+ * have been read.
+ *
+ * The files, the reopen limit per cycle and the snapshot bookkeeping are the
+ * ones of libfiberstat, but this is not fiberstat_poll(): the program keeps
+ * its own interface list (hot-plug, renames, view state), an fd budget, the
+ * sampler threads and the coherent mode, none of which the library has, so
+ * the library isn't installed until they're moved into it. The values are
+ * parsed in parse_interface_sample() with the same helpers as the library,
+ * into the fields of InterfaceInfo instead of a FiberstatSample.
+ */
+
+#define SAMPLER_CHUNK_SIZE 32
+
+typedef struct {
+    /* written by the owner and the thieves, so keep one per cache line */
+    unsigned int next __attribute__ ((aligned (64)));
+    unsigned int end;
+    /* statistics, only written by the owner */
+    double       busy_ms;
+    unsigned int n_chunks;
+    unsigned int n_stolen;
+} SamplerShard;
+
+static struct {
+    pthread_t            threads[MAX_SAMPLER_THREADS];
+    unsigned int         n_threads;
+    bool                 stop;
+    /* threads don't join the barriers until all of them are created */
+    pthread_mutex_t      launch_lock;
+    pthread_cond_t       launch_cond;
+    bool                 launched;
+    pthread_barrier_t    start;
+    pthread_barrier_t    done;
+    SamplerShard         shards[MAX_SAMPLER_THREADS];
+    InterfaceInfo      **work;
+    unsigned int         n_work;
+    unsigned int         work_size;
+    /* statistics */
+    unsigned int         n_cycles;
+    unsigned long        n_sampled;
+    double               total_cycle_ms;
+    double               max_cycle_ms;
+} sampler;
+
+#define SNAPSHOT_SKEW_HISTORY 4096
+
+static struct {
+    FiberstatSnapshot  current;
+    struct timespec    start;
+    /* skews of the last cycles, for the statistics */
+    double             skews_ms[SNAPSHOT_SKEW_HISTORY];
+    unsigned long      n_skews;
+} snapshot;
+
+static void
+parse_interface_sample (InterfaceInfo *iface)
+{
+    unsigned int i;
+
+    iface->sample_updates = 0;
+    if (fiberstat_file_update_power (&iface->tx_power_file, &iface->tx_power) == 0)
+        iface->sample_updates |= SAMPLE_UPDATE_TX_POWER;
+    if (fiberstat_file_update_power (&iface->rx_power_file, &iface->rx_power) == 0)
+        iface->sample_updates |= SAMPLE_UPDATE_RX_POWER;
+    if (fiberstat_file_update_operstate (&iface->operstate_file, &iface->operstate) == 0)
+        iface->sample_updates |= SAMPLE_UPDATE_OPERSTATE;
+    for (i = 0; iface->channel_files && (i < n_channels); i++) {
+        if (fiberstat_file_update_channel (&iface->channel_files[i], channels[i], &iface->channel_values[i]) == 0)
+            iface->sample_updates |= SAMPLE_UPDATE_CHANNELS;
+    }
+}
+
+/* Everything but the power files */
+static void
+sample_interface_state (InterfaceInfo *iface)
+{
+    unsigned int i;
+
+    fiberstat_file_read (&iface->operstate_file);
+    for (i = 0; iface->channel_files && (i < n_channels); i++)
+        fiberstat_file_read (&iface->channel_files[i]);
+}
+
+/* Read phase, only touching the given interface */
+static void
+sample_interface (InterfaceInfo *iface)
+{
+    fiberstat_file_read (&iface->tx_power_file);
+    fiberstat_file_read (&iface->rx_power_file);
+    if (coherent)
+        return;
+    sample_interface_state (iface);
+    parse_interface_sample (iface);
+}
+
+static void
+snapshot_begin (const struct timespec *start)
+{
+    fiberstat_snapshot_begin (&snapshot.current);
+    snapshot.start = *start;
+}
+
+static void
+snapshot_end (void)
+{
+    double skew_ms;
+
+    if (!snapshot.current.n_reads)
+        return;
+
+    skew_ms = timespec_diff_ms (&snapshot.current.last_read, &snapshot.current.first_read);
+    snapshot.skews_ms[snapshot.n_skews++ % SNAPSHOT_SKEW_HISTORY] = skew_ms;
+    log_debug ("snapshot %lu: %u power values read within %.3f ms, starting %.3f ms after the cycle",
+               snapshot.current.id, snapshot.current.n_reads, skew_ms,
+               timespec_diff_ms (&snapshot.current.first_read, &snapshot.start));
+}
+
+static void
+sampler_run (unsigned int index)
+{
+    SamplerShard    *own = &sampler.shards[index];
+    struct timespec  start;
+    struct timespec  end;
+    unsigned int     i;
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+
+    /* own shard first, then the ones of the other threads */
+    for (i = 0; i < sampler.n_threads; i++) {
+        SamplerShard *shard = &sampler.shards[(index + i) % sampler.n_threads];
+
+        while (1) {
+            unsigned int first;
+            unsigned int last;
+            unsigned int j;
+
+            first = __atomic_fetch_add (&shard->next, SAMPLER_CHUNK_SIZE, __ATOMIC_RELAXED);
+            if (first >= shard->end)
+                break;
+            last = (first + SAMPLER_CHUNK_SIZE < shard->end) ? (first + SAMPLER_CHUNK_SIZE) : shard->end;
+            for (j = first; j < last; j++)
+                sample_interface (sampler.work[j]);
+
+            own->n_chunks++;
+            if (i > 0)
+                own->n_stolen++;
+        }
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    own->busy_ms += timespec_diff_ms (&end, &start);
+}
+
+static void *
+sampler_thread (void *user_data)
+{
+    unsigned int index = (unsigned int) (uintptr_t) user_data;
+    bool         launched;
+
+    pthread_mutex_lock (&sampler.launch_lock);
+    while (!sampler.launched && !sampler.stop)
+        pthread_cond_wait (&sampler.launch_cond, &sampler.launch_lock);
+    launched = sampler.launched;
+    pthread_mutex_unlock (&sampler.launch_lock);
+    if (!launched)
+        return NULL;
+
+    while (1) {
+        pthread_barrier_wait (&sampler.start);
+        if (__atomic_load_n (&sampler.stop, __ATOMIC_ACQUIRE))
+            break;
+        sampler_run (index);
+        pthread_barrier_wait (&sampler.done);
+    }
+    return NULL;
+}
+
+static int
+sampler_add_work (InterfaceInfo *iface)
+{
+    if (sampler.n_work == sampler.work_size) {
+        InterfaceInfo **work;
+        unsigned int    work_size;
+
+        work_size = sampler.work_size ? (sampler.work_size * 2) : 64;
+        work = realloc (sampler.work, sizeof (InterfaceInfo *) * work_size);
+        if (!work)
+            return -1;
+        sampler.work = work;
+        sampler.work_size = work_size;
+    }
+    sampler.work[sampler.n_work++] = iface;
+    return 0;
+}
+
+/* Read all the interfaces in the work list, in all the sampler threads */
+static void
+sampler_run_cycle (void)
+{
+    struct timespec start;
+    struct timespec end;
+    unsigned int    i;
+    double          cycle_ms;
+
+    for (i = 0; i < sampler.n_threads; i++) {
+        sampler.shards[i].next = (unsigned int) (((unsigned long) sampler.n_work * i) / sampler.n_threads);
+        sampler.shards[i].end = (unsigned int) (((unsigned long) sampler.n_work * (i + 1)) / sampler.n_threads);
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    if (sampler.n_threads > 1) {
+        pthread_barrier_wait (&sampler.start);
+        sampler_run (0);
+        pthread_barrier_wait (&sampler.done);
+    } else
+        sampler_run (0);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    cycle_ms = timespec_diff_ms (&end, &start);
+    sampler.n_cycles++;
+    sampler.n_sampled += sampler.n_work;
+    sampler.total_cycle_ms += cycle_ms;
+    if (cycle_ms > sampler.max_cycle_ms)
+        sampler.max_cycle_ms = cycle_ms;
+}
+
+static int
+compare_double (const void *a,
+                const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+static void
+print_snapshot_stats (void)
+{
+    double       *skews;
+    unsigned int  n_skews;
+
+    if (!snapshot.n_skews)
+        return;
+
+    n_skews = (snapshot.n_skews < SNAPSHOT_SKEW_HISTORY) ? snapshot.n_skews : SNAPSHOT_SKEW_HISTORY;
+    skews = malloc (sizeof (double) * n_skews);
+    if (!skews)
+        return;
+    memcpy (skews, snapshot.skews_ms, sizeof (double) * n_skews);
+    qsort (skews, n_skews, sizeof (double), compare_double);
+
+    printf ("  snapshots:            %lu (%s)\n"
+            "  skew per snapshot:    %.3f ms p50, %.3f ms p90, %.3f ms p99, %.3f ms max (last %u)\n",
+            snapshot.current.id, coherent ? "coherent" : "not coherent",
+            skews[n_skews / 2], skews[(n_skews * 9) / 10], skews[(n_skews * 99) / 100],
+            skews[n_skews - 1], n_skews);
+    free (skews);
+}
+
+static void
+print_sampler_stats (void)
+{
+    unsigned int i;
+
+    if (!stats || !sampler.n_cycles)
+        return;
+
+    printf ("sampling statistics:\n"
+            "  threads:              %u\n"
+            "  cycles:               %u\n"
+            "  interfaces per cycle: %.1f\n"
+            "  read time per cycle:  %.3f ms average, %.3f ms max\n",
+            sampler.n_threads, sampler.n_cycles,
+            (double) sampler.n_sampled / sampler.n_cycles,
+            sampler.total_cycle_ms / sampler.n_cycles, sampler.max_cycle_ms);
+    for (i = 0; i < sampler.n_threads; i++)
+        printf ("  thread %-2u             %5.1f%% busy, %u chunks (%u stolen)\n",
+                i,
+                (sampler.total_cycle_ms > 0.0) ? (100.0 * sampler.shards[i].busy_ms / sampler.total_cycle_ms) : 0.0,
+                sampler.shards[i].n_chunks, sampler.shards[i].n_stolen);
+    print_snapshot_stats ();
+}
+
+static void
+teardown_sampler (void)
+{
+    unsigned int i;
+
+    if (sampler.n_threads > 1) {
+        __atomic_store_n (&sampler.stop, true, __ATOMIC_RELEASE);
+        pthread_barrier_wait (&sampler.start);
+        for (i = 1; i < sampler.n_threads; i++)
+            pthread_join (sampler.threads[i], NULL);
+        pthread_barrier_destroy (&sampler.start);
+        pthread_barrier_destroy (&sampler.done);
+        pthread_cond_destroy (&sampler.launch_cond);
+        pthread_mutex_destroy (&sampler.launch_lock);
+    }
+
+    free (sampler.work);
+    sampler.work = NULL;
+    sampler.n_work = 0;
+    sampler.work_size = 0;
+}
+
+static int
+setup_sampler (void)
+{
+    unsigned int i;
+
+    /* the main thread is one of the sampler threads */
+    sampler.n_threads = sampler_threads;
+    if (sampler.n_threads == 1)
+        return 0;
+
+    if (pthread_barrier_init (&sampler.start, NULL, sampler.n_threads) != 0)
+        goto out_single;
+    if (pthread_barrier_init (&sampler.done, NULL, sampler.n_threads) != 0)
+        goto out_destroy_start;
+    pthread_mutex_init (&sampler.launch_lock, NULL);
+    pthread_cond_init (&sampler.launch_cond, NULL);
+
+    for (i = 1; i < sampler.n_threads; i++) {
+        if (create_thread (&sampler.threads[i], "sampler", sampler_thread, (void *) (uintptr_t) i) < 0)
+            break;
+    }
+
+    pthread_mutex_lock (&sampler.launch_lock);
+    if (i == sampler.n_threads)
+        sampler.launched = true;
+    else
+        sampler.stop = true;
+    pthread_cond_broadcast (&sampler.launch_cond);
+    pthread_mutex_unlock (&sampler.launch_lock);
+
+    /* barriers need the full number of threads, so give up; the threads
+     * created exit without joining them */
+    if (!sampler.launched) {
+        unsigned int n_created = i;
+
+        for (i = 1; i < n_created; i++)
+            pthread_join (sampler.threads[i], NULL);
+        pthread_cond_destroy (&sampler.launch_cond);
+        pthread_mutex_destroy (&sampler.launch_lock);
+        pthread_barrier_destroy (&sampler.done);
+        goto out_destroy_start;
+    }
+
+    log_info ("reloading values with %u sampler threads", sampler.n_threads);
+    return 0;
+
+out_destroy_start:
+    pthread_barrier_destroy (&sampler.start);
+out_single:
+    /* so that teardown_sampler() doesn't wait for any thread */
+    sampler.n_threads = 1;
+    return -1;
+}
+
+/******************************************************************************/
+/* Change detection
+ *
+ * Sensor noise changes the power values read in almost every cycle, so each
+ * output (render, record, log and alarm) is only given the TX/RX power of an
+ * interface once it moves more than the deadband of the output away from
+ * the value last given to it; moving to or from unknown power is always a
+ * change. Other updates, e.g. of the operational state, are given right
+ * away to the outputs interested in them.
+ *
+ * Updates to an output may also be limited to one every min interval, and
+ * forced every max interval even if nothing changed. Updates held back by the
+ * min interval aren't lost: the power is compared with the value last given,
+ * and other updates are kept pending.
+ */
+
+static bool
+deadband_exceeded (float reported,
+                   float power,
+                   float deadband_db)
+{
+    if ((reported <= POWER_UNK) || (power <= POWER_UNK))
+        return ((reported <= POWER_UNK) != (power <= POWER_UNK));
+    return (fabs (power - reported) > deadband_db);
+}
+
+/* Returns the updates the given output must see */
+static unsigned int
+interface_report (InterfaceInfo         *iface,
+                  Output                 output,
+                  unsigned int           updates,
+                  const struct timespec *now)
+{
+    Deadband     *deadband = &deadbands[output];
+    Report       *report = &iface->reports[output];
+    unsigned int  reported;
+
+    if (!report->started)
+        reported = SAMPLE_UPDATE_POWER | updates;
+    else {
+        double elapsed_ms;
+
+        elapsed_ms = timespec_diff_ms (now, &report->time);
+        if (deadband->max_interval_ms && (elapsed_ms >= deadband->max_interval_ms))
+            reported = SAMPLE_UPDATE_POWER | updates | report->pending;
+        else if (deadband->min_interval_ms && (elapsed_ms < deadband->min_interval_ms)) {
+            report->pending |= (updates & ~SAMPLE_UPDATE_POWER);
+            reported = 0;
+        } else {
+            reported = (updates | report->pending) & ~SAMPLE_UPDATE_POWER;
+            if (deadband_exceeded (report->tx_power, iface->tx_power, deadband->deadband_db))
+                reported |= SAMPLE_UPDATE_TX_POWER;
+            if (deadband_exceeded (report->rx_power, iface->rx_power, deadband->deadband_db))
+                reported |= SAMPLE_UPDATE_RX_POWER;
+        }
+    }
+
+    if (updates) {
+        deadband->n_changes++;
+        if (!reported)
+            deadband->n_suppressed++;
+    }
+    if (!reported)
+        return 0;
+
+    if (reported & SAMPLE_UPDATE_TX_POWER)
+        report->tx_power = iface->tx_power;
+    if (reported & SAMPLE_UPDATE_RX_POWER)
+        report->rx_power = iface->rx_power;
+    report->time = *now;
+    report->pending = 0;
+    report->started = true;
+    deadband->n_reports++;
+    return reported;
+}
+
+static void
+print_deadband_stats (void)
+{
+    unsigned int i;
+
+    printf ("change detection:\n");
+    for (i = 0; i < OUTPUT_LAST; i++) {
+        const Deadband *deadband = &deadbands[i];
+
+        printf ("  %-8s %.2f dB deadband, %lu changes, %lu suppressed (%.1f%%), %lu updates\n",
+                output_str[i], deadband->deadband_db, deadband->n_changes, deadband->n_suppressed,
+                deadband->n_changes ? (100.0 * deadband->n_suppressed / deadband->n_changes) : 0.0,
+                deadband->n_reports);
+    }
+}
+
+/******************************************************************************/
 
-        /*
-         * The fill_height_n value specifies how many FULL blocks need to be printed.
-         * The fill_height_partial value specifies the partial height (0-7) of the top block, if any
-         */
-        mvwprintw (context.content_win, y+1+i, x, "%s", VRT[current_box_charset]);
+/* Returns the number of values changed beyond the render deadband, shown or
+ * not */
+static unsigned int
+reload_values (void)
+{
+    unsigned int    i;
+    unsigned int    n_updates = 0;
+    unsigned int    n_changes = 0;
+    unsigned int    n_skipped = 0;
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    mark_visible_interfaces ();
+    fiberstat_file_begin_cycle (&reload_files_cycle);
+
+    /* select the interfaces to reload */
+    sampler.n_work = 0;
+    for (i = 0; i < context.n_ifaces; i++) {
+        InterfaceInfo *iface = context.ifaces[i];
 
-        if ((row_height == fill_height_n) && (fill_height_partial > 0)) {
-            /* can't have partial on low resolution */
-            assert (resolution > 1);
-            print = true;
-            fill = BLK[fill_height_partial - 1];
-        } else if (row_height < fill_height_n) {
-            print = true;
-            if (resolution == 1)
-                fill = " ";
-            else
-                fill= BLK[7];
+        if (!interface_is_visible (iface) && background_timeout_ms && !alarms &&
+            (timespec_diff_ms (&now, &iface->last_reload) < background_timeout_ms)) {
+            n_skipped++;
+            continue;
         }
+        iface->last_reload = now;
 
-        if (print) {
-            int row_color;
+        acquire_interface_files (iface);
+        iface->sample_error = interface_error (iface);
+        if (sampler_add_work (iface) < 0) {
+            log_warning ("couldn't reload all interfaces");
+            break;
+        }
+    }
 
-            if (1/* apply_thresholds */) {
-                if (row_height < bad_level_fill_height_n)
-                    row_color = row_color_red;
-                else if (row_height < good_level_fill_height_n)
-                    row_color = row_color_yellow;
-                else
-                    row_color = row_color_green;
-            } else
-                row_color = row_color_white;
+    snapshot_begin (&now);
+    sampler_run_cycle ();
 
-            wattron (context.content_win, row_color);
-            for (j = 0; j < BOX_CONTENT_WIDTH; j++)
-                mvwprintw (context.content_win, y+1+i, x+1+j, fill);
-            wattroff (context.content_win, row_color);
+    /* apply the new values, each output only seeing the updates beyond its
+     * deadband */
+    for (i = 0; i < sampler.n_work; i++) {
+        InterfaceInfo *iface = sampler.work[i];
+        unsigned int   updates;
+        unsigned int   n_iface_updates = 0;
+
+        if (coherent) {
+            sample_interface_state (iface);
+            parse_interface_sample (iface);
         }
-        mvwprintw (context.content_win, y+1+i, x+1+BOX_CONTENT_WIDTH, "%s", VRT[current_box_charset]);
+        fiberstat_snapshot_add_read (&snapshot.current, &iface->tx_power_file);
+        fiberstat_snapshot_add_read (&snapshot.current, &iface->rx_power_file);
+        iface->snapshot_id = snapshot.current.id;
+
+        if (interface_error (iface) != iface->sample_error)
+            iface->sample_updates |= SAMPLE_UPDATE_ERROR;
+
+        updates = interface_report (iface, OUTPUT_LOG, iface->sample_updates, &now);
+        if (updates & SAMPLE_UPDATE_TX_POWER)
+            log_debug ("'%s' interface TX power updated: %.2lf",
+                       iface->name, iface->tx_power);
+        if (updates & SAMPLE_UPDATE_RX_POWER)
+            log_debug ("'%s' interface RX power updated: %.2lf",
+                       iface->name, iface->rx_power);
+        if (updates & SAMPLE_UPDATE_OPERSTATE)
+            log_debug ("'%s' interface operational state updated: %s",
+                       iface->name, fiberstat_operstate_to_string (iface->operstate));
+        if (updates & SAMPLE_UPDATE_CHANNELS)
+            log_debug ("'%s' interface DDM channels updated", iface->name);
+
+        /* failing files still feed alarms, as unknown power read at the
+         * start of the cycle; hold times run even if the power doesn't
+         * move beyond the deadband */
+        if (alarms) {
+            updates = interface_report (iface, OUTPUT_ALARM, iface->sample_updates & SAMPLE_UPDATE_POWER, &now);
+            if (((updates & SAMPLE_UPDATE_TX_POWER) || alarm_is_holding (&iface->tx_alarm)) &&
+                (!(iface->tx_power_file.fd < 0) || fiberstat_file_is_failed (&iface->tx_power_file)))
+                alarm_update (&iface->tx_alarm, iface->name, "tx", iface->reports[OUTPUT_ALARM].tx_power,
+                              alarm_threshold (alarm_tx_threshold, iface->profile),
+                              (iface->tx_power_file.n_read < 0) ? &now : &iface->tx_power_file.read_time,
+                              snapshot.current.id);
+            if (((updates & SAMPLE_UPDATE_RX_POWER) || alarm_is_holding (&iface->rx_alarm)) &&
+                (!(iface->rx_power_file.fd < 0) || fiberstat_file_is_failed (&iface->rx_power_file)))
+                alarm_update (&iface->rx_alarm, iface->name, "rx", iface->reports[OUTPUT_ALARM].rx_power,
+                              alarm_threshold (alarm_rx_threshold, iface->profile),
+                              (iface->rx_power_file.n_read < 0) ? &now : &iface->rx_power_file.read_time,
+                              snapshot.current.id);
+        }
+
+        updates = interface_report (iface, OUTPUT_RECORD, iface->sample_updates & SAMPLE_UPDATE_POWER, &now);
+        if (updates)
+            interface_update_histograms (iface, updates, &now);
+
+        updates = interface_report (iface, OUTPUT_RENDER, iface->sample_updates, &now);
+        if (updates & SAMPLE_UPDATE_TX_POWER)
+            n_iface_updates++;
+        if (updates & SAMPLE_UPDATE_RX_POWER) {
+            group_update_interface (iface);
+            n_iface_updates++;
+        }
+        if (updates & SAMPLE_UPDATE_OPERSTATE)
+            n_iface_updates++;
+        if (updates & SAMPLE_UPDATE_CHANNELS)
+            n_iface_updates++;
+        if (updates & SAMPLE_UPDATE_ERROR)
+            n_iface_updates++;
+
+        /* scrolling sparklines need a redraw, but aren't changes */
+        if (sparkline_ms && interface_update_sparklines (iface, &now) && interface_is_visible (iface))
+            n_updates++;
+
+        if (n_iface_updates && health_update_interface (iface))
+            context.refresh_title = true;
+
+        n_changes += n_iface_updates;
+
+        /* updates in interfaces not shown don't need a redraw, unless
+         * they change the order */
+        if ((updates & SAMPLE_UPDATE_POWER) && context.sort_mode != SORT_MODE_NAME) {
+            order_update (iface);
+            n_updates += n_iface_updates;
+        } else if (interface_is_visible (iface))
+            n_updates += n_iface_updates;
     }
-    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT, x, "%s", BL[current_box_charset]);
-    for (i = 0; i < BOX_CONTENT_WIDTH; i++)
-        mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT, x+1+i, "%s", HRZ[current_box_charset]);
-    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT, x+1+BOX_CONTENT_WIDTH, "%s", BR[current_box_charset]);
 
-    /* box info */
+    snapshot_end ();
 
-    x_center = x + (BOX_WIDTH / 2) - (strlen (label) / 2);
-    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT+2, x_center, "%s", label);
+    if (n_skipped)
+        log_debug ("%u interfaces not shown skipped until next background reload", n_skipped);
 
-    snprintf (buf, sizeof (buf), "%.2f", power);
-    x_center = x + (BOX_WIDTH / 2) - (strlen (buf) / 2);
-    mvwprintw (context.content_win, y+1+BOX_CONTENT_HEIGHT+1, x_center, "%s", buf);
+    if (reload_files_cycle.n_reopens)
+        log_debug ("%u failing files opened again", reload_files_cycle.n_reopens);
+
+    if (n_updates) {
+        log_debug ("need to refresh contents: %u values updated", n_updates);
+        context.refresh_contents = true;
+    }
+
+    return n_changes;
 }
 
+/******************************************************************************/
+/* Pre-trigger capture
+ *
+ * A dedicated thread samples the RX power of every interface at the capture
+ * period and stores it in a per-interface ring which holds both the
+ * pre-trigger and post-trigger windows. Each ring is only ever accessed by
+ * the capture sampler thread, so no locking is needed for it.
+ *
+ * Once the post-trigger window of an event has been filled, the samples are
+ * copied into a preallocated event slot and handed over to the writer thread
+ * through a lock-free single-producer single-consumer queue, so that disk I/O
+ * never delays sampling. If the writer is too slow and the queue is full, the
+ * event is dropped instead of blocking the sampler.
+ */
+
+#define CAPTURE_QUEUE_SIZE 16
+
+/* The operational state is the last one reloaded, packed in what would
+ * otherwise be padding */
+typedef struct {
+    struct timespec ts;
+    float           rx_power;
+    uint8_t         operstate;
+} CaptureSample;
+
+typedef struct {
+    InterfaceInfo   *iface;
+    int              fd;
+    CaptureSample   *samples;
+    uint64_t         head;
+    uint64_t         trigger;
+    unsigned int     post_remaining;
+    const char      *reason;
+    struct timespec  trigger_time;
+} CaptureRing;
+
+typedef struct {
+    InterfaceInfo   *iface;
+    const char      *reason;
+    struct timespec  trigger_time;
+    struct timespec  trigger_ts;
+    unsigned int     n_samples;
+    CaptureSample   *samples;
+} CaptureEvent;
+
+static struct {
+    bool          running;
+    bool          stop;
+    pthread_t     sampler;
+    pthread_t     writer;
+    sem_t         sem;
+    CaptureRing  *rings;
+    unsigned int  n_rings;
+    unsigned int  n_pre;
+    unsigned int  n_post;
+    unsigned int  n_drop;
+    unsigned int  ring_size;
+    char          drop_reason[64];
+    CaptureEvent  queue[CAPTURE_QUEUE_SIZE];
+    unsigned int  queue_head; /* only updated by the sampler thread */
+    unsigned int  queue_tail; /* only updated by the writer thread */
+    unsigned int  n_saved;
+    unsigned int  n_dropped;
+    JitterHistogram jitter;
+} capture;
+
 static void
-print_iface_info (int         x,
-                  int         y,
-                  const char *name,
-                  const char *operstate)
+capture_emit_event (CaptureRing *ring)
 {
-    char buffer[100];
-    int  x_center;
+    CaptureEvent *event;
+    unsigned int  head;
+    uint64_t      first;
+    uint64_t      i;
+
+    head = capture.queue_head;
+    if (head - __atomic_load_n (&capture.queue_tail, __ATOMIC_ACQUIRE) == CAPTURE_QUEUE_SIZE) {
+        capture.n_dropped++;
+        return;
+    }
 
-    x_center = x + (INTERFACE_WIDTH / 2) - (strlen (name) / 2);
-    mvwprintw (context.content_win, y, x_center, "%s", name);
+    /* the ring is sized so that the whole window is still available */
+    first = (ring->trigger > capture.n_pre) ? (ring->trigger - capture.n_pre) : 0;
 
-    /* lowerlayerdown is too long and messes up the UI, so limit it a bit */
-    if (strcmp (operstate, "lowerlayerdown") == 0)
-        snprintf (buffer, sizeof (buffer), "link lowerdown");
-    else
-        snprintf (buffer, sizeof (buffer), "link %s", operstate);
-    x_center = x + (INTERFACE_WIDTH / 2) - (strlen (buffer) / 2);
-    mvwprintw (context.content_win, y + 1, x_center, "%s", buffer);
+    event = &capture.queue[head % CAPTURE_QUEUE_SIZE];
+    event->iface        = ring->iface;
+    event->reason       = ring->reason;
+    event->trigger_time = ring->trigger_time;
+    event->trigger_ts   = ring->samples[ring->trigger % capture.ring_size].ts;
+    event->n_samples    = 0;
+    for (i = first; i < ring->head; i++)
+        event->samples[event->n_samples++] = ring->samples[i % capture.ring_size];
+
+    __atomic_store_n (&capture.queue_head, head + 1, __ATOMIC_RELEASE);
+    sem_post (&capture.sem);
 }
 
 static void
-print_interface (InterfaceInfo *iface, int x, int y)
+capture_ring_sample (CaptureRing *ring)
 {
-    float tx_power;
-    float rx_power;
+    CaptureSample *sample;
+    const char    *reason = NULL;
 
-    tx_power = iface->tx_power;
-    rx_power = iface->rx_power;
+    sample = &ring->samples[ring->head % capture.ring_size];
+    clock_gettime (CLOCK_MONOTONIC, &sample->ts);
+    sample->rx_power = reload_power_from_file (ring->fd);
+    sample->operstate = (uint8_t) __atomic_load_n (&ring->iface->operstate, __ATOMIC_RELAXED);
 
-#if defined FORCE_TEST_LEVELS
-    {
-        static float fill = POWER_MIN;
-        float extra = (current_box_charset == BOX_CHARSET_ASCII) ? 1 : 0.2;
+    if (ring->head > 0) {
+        const CaptureSample *previous;
 
-        tx_power = fill;
-        fill += extra;
-        if (fill > POWER_MAX)
-            fill = POWER_MIN;
+        previous = &ring->samples[(ring->head - 1) % capture.ring_size];
+        if ((previous->rx_power >= ring->iface->profile->bad) && (sample->rx_power < ring->iface->profile->bad))
+            reason = "rx power below bad level";
+    }
 
-        rx_power = fill;
-        fill += extra;
-        if (fill > POWER_MAX)
-            fill = POWER_MIN;
+    if (!reason && capture.n_drop && (ring->head >= capture.n_drop)) {
+        const CaptureSample *reference;
 
-        log_debug ("forced test levels: TX %.2f dBm, RX %.2f dBm", tx_power, rx_power);
+        reference = &ring->samples[(ring->head - capture.n_drop) % capture.ring_size];
+        if ((reference->rx_power - sample->rx_power) >= capture_drop_db)
+            reason = capture.drop_reason;
     }
-#endif /* FORCE_TEST_LEVELS */
 
-    /* Print TX/RX boxes and common interface info */
-    print_box (x, y, tx_power, false, "TX dBm");
-    print_box (x + BOX_WIDTH + BOX_SEPARATION, y, rx_power, true, "RX dBm");
-    print_iface_info (x, y + BOX_HEIGHT, iface->name, iface->operstate);
+    /* new triggers while the post-trigger window is being filled are
+     * already covered by the ongoing event */
+    if (reason && !ring->post_remaining) {
+        ring->trigger = ring->head;
+        ring->reason = reason;
+        ring->post_remaining = capture.n_post + 1;
+        clock_gettime (CLOCK_REALTIME, &ring->trigger_time);
+    }
 
-    /* force moving cursor to next line to make app running through minicom happy */
-    mvwprintw (context.content_win, y + INTERFACE_HEIGHT, 0, "");
+    ring->head++;
+
+    if (ring->post_remaining && (--ring->post_remaining == 0))
+        capture_emit_event (ring);
+}
+
+static void *
+capture_sampler_thread (void *user_data)
+{
+    struct timespec next;
+    struct timespec now;
+    unsigned int    i;
+
+    /* the capture period must be kept even in power save mode */
+    if (power_save)
+        prctl (PR_SET_TIMERSLACK, POWER_SAVE_DEFAULT_SLACK_NS, 0, 0, 0);
+
+    clock_gettime (CLOCK_MONOTONIC, &next);
+    while (!__atomic_load_n (&capture.stop, __ATOMIC_ACQUIRE)) {
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        jitter_record (&capture.jitter, &now, capture_period_ms);
+
+        for (i = 0; i < capture.n_rings; i++)
+            capture_ring_sample (&capture.rings[i]);
+
+        /* if we're late, don't try to catch up with a burst of samples */
+        timespec_add_ms (&next, capture_period_ms);
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        if (timespec_diff_ms (&next, &now) < 0)
+            next = now;
+        clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+static void
+capture_write_event (const CaptureEvent *event)
+{
+    char         path[PATH_MAX];
+    char         stamp[32];
+    struct tm    tm;
+    FILE        *f;
+    unsigned int i;
+
+    localtime_r (&event->trigger_time.tv_sec, &tm);
+    strftime (stamp, sizeof (stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf (path, sizeof (path), "%s/%s-%s.%03ld.csv",
+              capture_dir, event->iface->name, stamp, event->trigger_time.tv_nsec / 1000000L);
+
+    f = fopen (path, "w");
+    if (!f) {
+        log_warning ("couldn't create capture file %s: %s", path, strerror (errno));
+        return;
+    }
+
+    fprintf (f,
+             "# interface: %s\n"
+             "# trigger: %s\n"
+             "# period: %d ms\n"
+             "offset_ms,rx_dbm,link\n",
+             event->iface->name, event->reason, capture_period_ms);
+    for (i = 0; i < event->n_samples; i++)
+        fprintf (f, "%.3f,%.3f,%s\n",
+                 timespec_diff_ms (&event->samples[i].ts, &event->trigger_ts),
+                 event->samples[i].rx_power,
+                 fiberstat_operstate_to_string (event->samples[i].operstate));
+    fclose (f);
+
+    log_info ("interface '%s' capture saved (%s): %s", event->iface->name, event->reason, path);
+}
+
+static void *
+capture_writer_thread (void *user_data)
+{
+    unsigned int tail;
+
+    realtime_reset_thread ();
+    while (1) {
+        if (sem_wait (&capture.sem) < 0)
+            continue;
+
+        tail = capture.queue_tail;
+        while (tail != __atomic_load_n (&capture.queue_head, __ATOMIC_ACQUIRE)) {
+            capture_write_event (&capture.queue[tail % CAPTURE_QUEUE_SIZE]);
+            capture.n_saved++;
+            __atomic_store_n (&capture.queue_tail, ++tail, __ATOMIC_RELEASE);
+        }
+
+        if (__atomic_load_n (&capture.stop, __ATOMIC_ACQUIRE))
+            break;
+    }
+    return NULL;
+}
+
+static void
+teardown_capture (void)
+{
+    unsigned int i;
+
+    if (capture.running) {
+        __atomic_store_n (&capture.stop, true, __ATOMIC_RELEASE);
+        pthread_join (capture.sampler, NULL);
+        /* the writer flushes all pending events before exiting */
+        sem_post (&capture.sem);
+        pthread_join (capture.writer, NULL);
+        sem_destroy (&capture.sem);
+        log_info ("capture finished: %u events saved, %u events dropped",
+                  capture.n_saved, capture.n_dropped);
+    }
+
+    for (i = 0; i < capture.n_rings; i++) {
+        if (!(capture.rings[i].fd < 0))
+            close (capture.rings[i].fd);
+        free (capture.rings[i].samples);
+    }
+    free (capture.rings);
+
+    for (i = 0; i < CAPTURE_QUEUE_SIZE; i++)
+        free (capture.queue[i].samples);
+}
+
+static int
+setup_capture (void)
+{
+    unsigned int i;
+
+    if (!capture_dir)
+        return 0;
+
+    if (access (capture_dir, W_OK) < 0) {
+        log_error ("capture directory %s isn't writable: %s", capture_dir, strerror (errno));
+        return -1;
+    }
+
+    capture.n_pre = capture_window_ms / capture_period_ms;
+    if (capture.n_pre == 0)
+        capture.n_pre = 1;
+    capture.n_post = capture.n_pre;
+    capture.ring_size = capture.n_pre + 1 + capture.n_post;
+    capture.n_drop = capture_drop_ms / capture_period_ms;
+    snprintf (capture.drop_reason, sizeof (capture.drop_reason),
+              "rx power drop of %.2f dB within %d ms", capture_drop_db, capture_drop_ms);
+
+    capture.rings = calloc (context.n_ifaces, sizeof (CaptureRing));
+    if (!capture.rings)
+        return -2;
+
+    for (i = 0; i < context.n_ifaces; i++) {
+        CaptureRing *ring;
+
+        /* interfaces without hwmon (e.g. test ones) can't be captured */
+        if (!context.ifaces[i]->hwmon)
+            continue;
+
+        ring = &capture.rings[capture.n_rings];
+        ring->iface = context.ifaces[i];
+        ring->fd = open (ring->iface->hwmon->paths[FIBERSTAT_CHANNEL_RX_POWER], O_RDONLY);
+        if (ring->fd < 0) {
+            log_warning ("couldn't open RX power file for interface '%s' capture at %s",
+                         ring->iface->name, ring->iface->hwmon->paths[FIBERSTAT_CHANNEL_RX_POWER]);
+            continue;
+        }
+        capture.n_rings++;
+
+        ring->samples = calloc (capture.ring_size, sizeof (CaptureSample));
+        if (!ring->samples)
+            return -2;
+    }
+
+    for (i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+        capture.queue[i].samples = calloc (capture.ring_size, sizeof (CaptureSample));
+        if (!capture.queue[i].samples)
+            return -2;
+    }
+
+    if (sem_init (&capture.sem, 0, 0) < 0)
+        return -3;
+
+    if (create_thread (&capture.writer, "capture writer", capture_writer_thread, NULL) < 0) {
+        sem_destroy (&capture.sem);
+        return -3;
+    }
+
+    if (create_thread (&capture.sampler, "capture sampler", capture_sampler_thread, NULL) < 0) {
+        __atomic_store_n (&capture.stop, true, __ATOMIC_RELEASE);
+        sem_post (&capture.sem);
+        pthread_join (capture.writer, NULL);
+        sem_destroy (&capture.sem);
+        return -3;
+    }
+
+    capture.running = true;
+    log_info ("capturing %u interfaces every %d ms (window: %u samples) in %s",
+              capture.n_rings, capture_period_ms, capture.ring_size, capture_dir);
+    return 0;
 }
 
 /******************************************************************************/
-/* Core application logic */
+/* Background discovery
+ *
+ * Scanning sysfs may be slow, so discovery runs in a separate thread while
+ * the main loop already shows the UI. The hwmon entries are processed first,
+ * and then the net entries, as every interface needs its hwmon entry to be
+ * known. In each phase, the directory entries are shared among a pool of
+ * worker threads, each one taking the next unprocessed entry. Interfaces are
+ * queued as soon as they are resolved, and the main loop is woken up through
+ * a pipe to merge them in sorted order into the interface list.
+ */
+
+typedef enum {
+    DISCOVERY_PHASE_HWMON,
+    DISCOVERY_PHASE_NET,
+    DISCOVERY_PHASE_DONE,
+} DiscoveryPhase;
+
+static struct {
+    pthread_t         thread;
+    bool              running;
+    bool              stop;
+    int               status;
+    int               pipe[2];
+    DiscoveryPhase    phase;
+
+    /* entries of the directory being processed in the current phase, which
+     * is kept open to access the entries relative to it */
+    DIR              *dir;
+    char            **entries;
+    unsigned int      n_entries;
+    unsigned int      next_entry;
+    unsigned int      n_entries_done;
+
+    /* interfaces resolved but not yet merged, protected by the mutex */
+    pthread_mutex_t   mutex;
+    InterfaceInfo   **pending;
+    unsigned int      n_pending;
+} discovery = {
+    .pipe  = { -1, -1 },
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
 
 static void
-refresh_title (void)
+discovery_notify (void)
 {
-    char title[64];
+    /* if the pipe is full, the main loop is already going to wake up */
+    if (write (discovery.pipe[1], "", 1) < 0 && errno != EAGAIN)
+        log_warning ("couldn't notify discovery progress: %s", strerror (errno));
+}
 
-    werase (context.header_win);
+static int
+discovery_queue_interface (InterfaceInfo *iface)
+{
+    InterfaceInfo **pending;
 
-    snprintf (title, sizeof (title), "%s %s", PROGRAM_NAME, PACKAGE_VERSION);
-    wattron(context.header_win, A_BOLD | A_UNDERLINE | COLOR_PAIR (COLOR_PAIR_TITLE_TEXT));
-    mvwprintw (context.header_win, 0, (context.max_x / 2) - (strlen (title) / 2), "%s", title);
-    wattroff(context.header_win, A_BOLD | A_UNDERLINE | COLOR_PAIR (COLOR_PAIR_TITLE_TEXT));
+    pthread_mutex_lock (&discovery.mutex);
+    pending = realloc (discovery.pending, sizeof (InterfaceInfo *) * (discovery.n_pending + 1));
+    if (pending) {
+        discovery.pending = pending;
+        discovery.pending[discovery.n_pending++] = iface;
+    }
+    pthread_mutex_unlock (&discovery.mutex);
 
-    wrefresh (context.header_win);
+    if (!pending) {
+        interface_info_free (iface);
+        return -3;
+    }
+
+    discovery_notify ();
+    return 0;
 }
 
-/* The margin at left and right allows to place the scrolling
- * arrows inside the margin (in the middle, at 2) */
-#define MARGIN_HORIZONTAL 5
+static void *
+discovery_worker_thread (void *user_data)
+{
+    DiscoveryPhase phase;
 
-#define INTERFACE_SEPARATION_HORIZONTAL  3
-#define INTERFACE_SEPARATION_VERTICAL    3
+    phase = __atomic_load_n (&discovery.phase, __ATOMIC_ACQUIRE);
+
+    while (!__atomic_load_n (&discovery.stop, __ATOMIC_ACQUIRE)) {
+        InterfaceInfo *iface = NULL;
+        unsigned int   i;
+        int            entry_fd;
+        int            status = 0;
+
+        i = __atomic_fetch_add (&discovery.next_entry, 1, __ATOMIC_RELAXED);
+        if (i >= discovery.n_entries)
+            break;
+
+        entry_fd = fiberstat_sysfs_openat (dirfd (discovery.dir), discovery.entries[i], O_RDONLY | O_DIRECTORY);
+        if (entry_fd < 0)
+            log_debug ("couldn't open '%s': %s", discovery.entries[i], strerror (errno));
+        else if (phase == DISCOVERY_PHASE_HWMON) {
+            status = discover_hwmon (discovery.entries[i], entry_fd);
+            close (entry_fd);
+        } else {
+            status = discover_interface (discovery.entries[i], entry_fd, &iface);
+            close (entry_fd);
+            if (iface)
+                status = discovery_queue_interface (iface);
+        }
+
+        if (status < 0) {
+            log_error ("couldn't discover '%s'", discovery.entries[i]);
+            __atomic_store_n (&discovery.status, status, __ATOMIC_RELAXED);
+            __atomic_store_n (&discovery.stop, true, __ATOMIC_RELEASE);
+            break;
+        }
+
+        __atomic_add_fetch (&discovery.n_entries_done, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
 
 static void
-refresh_contents (void)
+discovery_free_entries (void)
 {
-    unsigned int i, n, x, y;
-    unsigned int total_width;
-    unsigned int total_height;
-    unsigned int x_initial;
-    unsigned int n_ifaces_per_row;
-    unsigned int n_ifaces_per_column;
-    unsigned int n_ifaces_per_window;
-    unsigned int n_rows;
-    unsigned int n_columns;
-    unsigned int content_max_width;
-    unsigned int content_max_height;
-    unsigned int last_iface_index;
-    unsigned int visible_ifaces;
+    unsigned int i;
 
-    content_max_width = (context.max_x - (MARGIN_HORIZONTAL * 2));
-    log_debug ("width: window %u, interface %u, content max %u",
-               context.max_x, INTERFACE_WIDTH, content_max_width);
+    for (i = 0; i < discovery.n_entries; i++)
+        free (discovery.entries[i]);
+    free (discovery.entries);
+    discovery.entries = NULL;
+    __atomic_store_n (&discovery.n_entries, 0, __ATOMIC_RELAXED);
 
-    content_max_height = context.max_y;
-    log_debug ("height: window %u, interface %u, content max %u",
-               context.max_y, INTERFACE_HEIGHT, content_max_height);
+    if (discovery.dir)
+        closedir (discovery.dir);
+    discovery.dir = NULL;
+}
+
+static int
+discovery_load_entries (const char *dir_path)
+{
+    DIR           *d;
+    struct dirent *dir;
+    unsigned int   n_entries = 0;
+    int            fd;
+
+    fd = fiberstat_sysfs_openat (AT_FDCWD, dir_path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return -1;
+
+    d = fdopendir (fd);
+    if (!d) {
+        close (fd);
+        return -1;
+    }
+    discovery.dir = d;
+
+    while ((dir = readdir(d)) != NULL) {
+        char **entries;
+
+        if ((strcmp (dir->d_name, ".") == 0) || (strcmp (dir->d_name, "..") == 0))
+            continue;
+
+        entries = realloc (discovery.entries, sizeof (char *) * (n_entries + 1));
+        if (!entries)
+            break;
+        discovery.entries = entries;
+        discovery.entries[n_entries] = strdup (dir->d_name);
+        if (!discovery.entries[n_entries])
+            break;
+        n_entries++;
+    }
+
+    __atomic_store_n (&discovery.n_entries, n_entries, __ATOMIC_RELAXED);
+    if (dir) {
+        discovery_free_entries ();
+        return -2;
+    }
+    return 0;
+}
+
+static int
+discovery_run_phase (DiscoveryPhase  phase,
+                     const char     *dir_path)
+{
+    pthread_t    workers[MAX_DISCOVERY_THREADS];
+    unsigned int n_workers;
 
-    werase (context.content_win);
+    if (discovery_load_entries (dir_path) < 0)
+        return -1;
 
-    /* compute how many interfaces we can print in the window */
+    discovery.next_entry = 0;
+    __atomic_store_n (&discovery.n_entries_done, 0, __ATOMIC_RELAXED);
+    __atomic_store_n (&discovery.phase, phase, __ATOMIC_RELEASE);
 
-    /* rows... */
-    n_ifaces_per_row = 0;
-    while (1) {
-        unsigned int next = ((n_ifaces_per_row + 1) * INTERFACE_WIDTH) + ((n_ifaces_per_row) * INTERFACE_SEPARATION_HORIZONTAL);
-        if (next >= content_max_width)
+    /* the discovery thread itself is one of the workers */
+    for (n_workers = 0; n_workers < (unsigned int) (discovery_threads - 1); n_workers++) {
+        if (create_thread (&workers[n_workers], "discovery worker", discovery_worker_thread, NULL) < 0)
             break;
-        n_ifaces_per_row++;
     }
-    log_debug ("number of interfaces per row: %u", n_ifaces_per_row);
+    discovery_worker_thread (NULL);
+    while (n_workers > 0)
+        pthread_join (workers[--n_workers], NULL);
 
-    if (n_ifaces_per_row == 0) {
-        log_warning ("window doesn't allow one full interface per row: forcing it anyway");
-        n_ifaces_per_row = 1;
+    discovery_free_entries ();
+    return 0;
+}
+
+static void *
+discovery_thread (void *user_data)
+{
+    /* the worker threads inherit the defaults from this one */
+    realtime_reset_thread ();
+
+    if (discovery_run_phase (DISCOVERY_PHASE_HWMON, fiberstat_get_hwmon_dir ()) < 0)
+        discovery.status = -2;
+    else {
+        if (context.hwmon_list.n_hwmon > 0)
+            log_info ("hwmon entries found: %u", context.hwmon_list.n_hwmon);
+        else
+            log_error ("no hwmon entries found");
+
+        if (!__atomic_load_n (&discovery.stop, __ATOMIC_ACQUIRE) &&
+            discovery_run_phase (DISCOVERY_PHASE_NET, fiberstat_get_net_dir ()) < 0)
+            discovery.status = -3;
     }
 
-    /* columns... */
-    n_ifaces_per_column = 0;
-    while (1) {
-        unsigned int next = ((n_ifaces_per_column + 1) * INTERFACE_HEIGHT) + ((n_ifaces_per_column) * INTERFACE_SEPARATION_VERTICAL);
-        if (next >= content_max_height)
-            break;
-        n_ifaces_per_column++;
+    __atomic_store_n (&discovery.phase, DISCOVERY_PHASE_DONE, __ATOMIC_RELEASE);
+    discovery_notify ();
+    return NULL;
+}
+
+/* Merge an interface keeping the list sorted by name */
+static int
+merge_interface (InterfaceInfo *iface)
+{
+    InterfaceInfo **ifaces;
+    unsigned int    low = 0;
+    unsigned int    high = context.n_ifaces;
+
+    while (low < high) {
+        unsigned int middle = low + ((high - low) / 2);
+
+        if (compare_interface (&context.ifaces[middle], &iface) < 0)
+            low = middle + 1;
+        else
+            high = middle;
     }
-    log_debug ("number of interfaces per column: %u", n_ifaces_per_column);
 
-    if (n_ifaces_per_column == 0) {
-        log_warning ("window doesn't allow one full interface per column: forcing it anyway");
-        n_ifaces_per_column = 1;
+    ifaces = realloc (context.ifaces, sizeof (InterfaceInfo *) * (context.n_ifaces + 1));
+    if (!ifaces)
+        return -3;
+    context.ifaces = ifaces;
+    memmove (&context.ifaces[low + 1], &context.ifaces[low], sizeof (InterfaceInfo *) * (context.n_ifaces - low));
+    context.ifaces[low] = iface;
+    context.n_ifaces++;
+
+    order_add_interface (iface);
+    if (group_add_interface (iface) < 0)
+        log_warning ("couldn't group interface '%s'", iface->name);
+    health_add_interface (iface);
+    return 0;
+}
+
+static void
+update_discovery_progress (void)
+{
+    DiscoveryPhase phase;
+    char           progress[sizeof (context.discovery_progress)];
+
+    phase = __atomic_load_n (&discovery.phase, __ATOMIC_ACQUIRE);
+    snprintf (progress, sizeof (progress), "discovering %s %u/%u",
+              (phase == DISCOVERY_PHASE_HWMON) ? "hwmon" : "interfaces",
+              __atomic_load_n (&discovery.n_entries_done, __ATOMIC_RELAXED),
+              __atomic_load_n (&discovery.n_entries, __ATOMIC_RELAXED));
+
+    if (strcmp (progress, context.discovery_progress) != 0) {
+        strcpy (context.discovery_progress, progress);
+        context.refresh_title = true;
     }
+}
 
-    /* totals... */
-    n_ifaces_per_window = n_ifaces_per_row * n_ifaces_per_column;
-    log_debug ("window allows up to %u interfaces (%u per rows and %u per column)",
-               n_ifaces_per_window, n_ifaces_per_row, n_ifaces_per_column);
+static int
+complete_discovery (void)
+{
+    struct timespec     now;
+    FiberstatSysfsStats sysfs_stats;
+    int                 status;
 
-    /* we skip all interfaces that have been scrolled */
-    visible_ifaces = (context.n_ifaces - context.first_iface_index);
+    pthread_join (discovery.thread, NULL);
+    discovery.running = false;
 
-    /* compute amount of rows and columns we're printing */
-    n_rows = visible_ifaces / n_ifaces_per_row;
-    if (n_rows > 0) {
-        if (visible_ifaces % n_ifaces_per_row > 0)
-            n_rows++;
-        if (n_rows > n_ifaces_per_column)
-            n_rows = n_ifaces_per_column;
-    } else
-        n_rows = 1;
-    n_columns = (visible_ifaces > n_ifaces_per_row) ? n_ifaces_per_row : visible_ifaces;
-    log_debug ("printing %u rows with up to %u interfaces per row",
-               n_rows, n_columns);
+    context.discovering = false;
+    context.refresh_title = true;
+    context.refresh_contents = true;
 
-    /* compute total width and height in order to center elements in the interface */
-    total_width = (n_columns * INTERFACE_WIDTH) + ((n_columns - 1) * INTERFACE_SEPARATION_HORIZONTAL);
-    total_height = (n_rows * INTERFACE_HEIGHT) + ((n_rows - 1) * INTERFACE_SEPARATION_VERTICAL);
-    log_debug ("total width %u, total height %u", total_width, total_height);
+    if (discovery.status < 0)
+        return discovery.status;
+
+    /* explicit interfaces are checked, and the order set up again in case
+     * some interfaces were added */
+    status = finish_interfaces ();
+    if (status < 0)
+        return -3;
+    setup_order ();
+    setup_groups ();
+    setup_health ();
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    log_info ("discovery completed: %u hwmon entries, %u interfaces, %.1f ms since start",
+              context.hwmon_list.n_hwmon, context.n_ifaces, timespec_diff_ms (&now, &context.start_time));
+    fiberstat_get_sysfs_stats (&sysfs_stats);
+    log_info ("discovery sysfs access: %u opens, %u path components walked",
+              sysfs_stats.n_opens, sysfs_stats.n_path_components);
+
+    check_fd_limit ();
+
+    if (cache_path)
+        save_discovery_cache ();
+    return 0;
+}
 
-    /* check if we need scrolling support */
-    context.left_scroll_arrow = false;
-    context.right_scroll_arrow = false;
-    if ((context.first_iface_index > 0) || (visible_ifaces > n_ifaces_per_window)) {
-        last_iface_index = context.first_iface_index + n_ifaces_per_window;
-        if (last_iface_index >= context.n_ifaces)
-            last_iface_index = context.n_ifaces;
-        else
-            context.right_scroll_arrow = true;
-        if (context.first_iface_index > 0)
-            context.left_scroll_arrow = true;
-    } else
-        last_iface_index = context.n_ifaces;
+/* Returns 1 once discovery has completed, 0 while it's still running */
+static int
+process_discovery (void)
+{
+    InterfaceInfo **pending;
+    unsigned int    n_pending;
+    unsigned int    i;
+    char            buffer[64];
+    int             status = 0;
 
-    /* print scrolling arrows if needed */
-    if (context.left_scroll_arrow) {
-        wattron(context.content_win, A_BOLD);
-        mvwprintw (context.content_win,
-                   total_height / 2,
-                   (context.max_x / 2) - (total_width / 2) - MARGIN_HORIZONTAL + 2,
-                   "<");
-        wattroff(context.content_win, A_BOLD);
-    }
+    if (!discovery.running)
+        return 0;
 
-    if (context.right_scroll_arrow) {
-        wattron(context.content_win, A_BOLD);
-        mvwprintw (context.content_win,
-                   total_height / 2,
-                   (context.max_x / 2) + (total_width / 2) + MARGIN_HORIZONTAL - 2,
-                   ">");
-        wattroff(context.content_win, A_BOLD);
+    while (read (discovery.pipe[0], buffer, sizeof (buffer)) > 0);
+
+    pthread_mutex_lock (&discovery.mutex);
+    pending = discovery.pending;
+    n_pending = discovery.n_pending;
+    discovery.pending = NULL;
+    discovery.n_pending = 0;
+    pthread_mutex_unlock (&discovery.mutex);
+
+    for (i = 0; i < n_pending; i++) {
+        if (status == 0)
+            status = merge_interface (pending[i]);
+        if (status < 0)
+            interface_info_free (pending[i]);
     }
+    free (pending);
+    if (status < 0)
+        return status;
 
-    x_initial = x = (context.max_x / 2) - (total_width / 2);
-    y = 0;
+    if (n_pending) {
+        log_debug ("%u interfaces discovered", n_pending);
+        context.refresh_contents = true;
+    }
 
-    for (n = 0, i = context.first_iface_index; i < last_iface_index; i++, n++) {
-        print_interface (context.ifaces[i], x, y);
-        if (((n + 1) % n_ifaces_per_row) == 0) {
-            x = x_initial;
-            y += (INTERFACE_HEIGHT + INTERFACE_SEPARATION_VERTICAL);
-        } else {
-            x += (INTERFACE_WIDTH + INTERFACE_SEPARATION_HORIZONTAL);
-        }
+    if (__atomic_load_n (&discovery.phase, __ATOMIC_ACQUIRE) != DISCOVERY_PHASE_DONE) {
+        update_discovery_progress ();
+        return 0;
     }
 
-    wrefresh (context.content_win);
+    status = complete_discovery ();
+    return (status < 0 ? status : 1);
 }
 
-/******************************************************************************/
-
-static float
-reload_power_from_file (int fd)
+static void
+teardown_discovery (void)
 {
-    float   value;
-    char    buffer[255] = { 0 };
-    ssize_t n_read;
+    unsigned int i;
 
-    lseek (fd, 0, SEEK_SET);
-    n_read = read (fd, buffer, sizeof (buffer));
-    if (n_read <= 0)
-        return POWER_UNK;
+    if (discovery.running) {
+        __atomic_store_n (&discovery.stop, true, __ATOMIC_RELEASE);
+        pthread_join (discovery.thread, NULL);
+        discovery.running = false;
+    }
 
-    value = strtof (buffer, NULL);
-    if (value < 0.1)
-        return POWER_UNK;
+    for (i = 0; i < discovery.n_pending; i++)
+        interface_info_free (discovery.pending[i]);
+    free (discovery.pending);
+    discovery.pending = NULL;
+    discovery.n_pending = 0;
 
-    /* power given in uW by the kernel, we use dBm instead */
-    return (10 * log10 (value / 1000.0));
+    for (i = 0; i < 2; i++) {
+        if (!(discovery.pipe[i] < 0))
+            close (discovery.pipe[i]);
+        discovery.pipe[i] = -1;
+    }
 }
 
 static int
-update_value (int fd, float *value)
+setup_discovery (void)
 {
-    float power;
+    if (pipe2 (discovery.pipe, O_NONBLOCK | O_CLOEXEC) < 0)
+        return -1;
 
-    power = reload_power_from_file (fd);
-    if (fabs (power - *value) < 0.001)
+    if (create_thread (&discovery.thread, "discovery", discovery_thread, NULL) < 0) {
+        teardown_discovery ();
         return -1;
+    }
 
-    *value = power;
+    discovery.running = true;
+    context.discovering = true;
+    update_discovery_progress ();
+    log_info ("discovering interfaces with %d threads...", discovery_threads);
     return 0;
 }
 
-static int
-update_string (int fd, char **str)
+/******************************************************************************/
+/* Power saving
+ *
+ * In power save mode, the main loop wakes up less often while idle: timer
+ * slack is allowed on its wakeups so that the kernel may coalesce them with
+ * other timers, reload deadlines are aligned to multiples of the period, the
+ * period is stretched up to the max timeout while all values are stable, and
+ * nothing is rendered while the terminal is in the background or its output
+ * is blocked (e.g. by flow control on a serial link). Any change in the values
+ * or any input brings the period back to the requested timeout.
+ */
+
+#define POWER_SAVE_STABLE_CYCLES     10
+#define POWER_SAVE_SLACK_DIVIDER     10
+
+static struct {
+    int             period_ms;
+    unsigned int    n_stable_cycles;
+    bool            output_blocked;
+    /* statistics */
+    unsigned long   n_wakeups;
+    unsigned long   n_skipped_renders;
+    unsigned int    n_stretches;
+} power = {
+    .period_ms = -1,
+};
+
+static void
+power_save_set_period (int                    period_ms,
+                       const struct timespec *now,
+                       struct timespec       *next_reload)
 {
-    char    buffer[255] = { 0 };
-    ssize_t n_read;
+    power.period_ms = period_ms;
+    power.n_stable_cycles = 0;
+    prctl (PR_SET_TIMERSLACK, (unsigned long) period_ms * 1000000UL / POWER_SAVE_SLACK_DIVIDER, 0, 0, 0);
+
+    *next_reload = *now;
+    timespec_add_ms (next_reload, period_ms);
+    timespec_align_ms (next_reload, period_ms);
+    reload_jitter_restart ();
+    log_debug ("reload period set to %d ms", period_ms);
+}
 
-    lseek (fd, 0, SEEK_SET);
-    n_read = read (fd, buffer, sizeof (buffer));
-    if (n_read <= 0)
-        return -1;
+/* Called after each scheduled reload */
+static void
+power_save_reloaded (unsigned int           n_changes,
+                     const struct timespec *now,
+                     struct timespec       *next_reload)
+{
+    if (!power_save)
+        return;
 
-    if (buffer[n_read - 1] == '\n')
-        buffer[n_read - 1] = '\0';
+    if (n_changes) {
+        if (power.period_ms != timeout_ms)
+            power_save_set_period (timeout_ms, now, next_reload);
+        power.n_stable_cycles = 0;
+        return;
+    }
 
-    if (*str && strcmp (*str, buffer) == 0)
-        return -1;
+    if (++power.n_stable_cycles < POWER_SAVE_STABLE_CYCLES || power.period_ms >= max_timeout_ms)
+        return;
 
-    free (*str);
-    *str = strdup (buffer);
-    return 0;
+    power.n_stretches++;
+    power_save_set_period ((power.period_ms * 2 < max_timeout_ms) ? (power.period_ms * 2) : max_timeout_ms,
+                           now, next_reload);
 }
 
 static void
-reload_values (void)
+power_save_input (const struct timespec *now,
+                  struct timespec       *next_reload)
 {
-    unsigned int i;
-    unsigned int n_updates = 0;
+    if (power_save && power.period_ms != timeout_ms)
+        power_save_set_period (timeout_ms, now, next_reload);
+}
 
-    for (i = 0; i < context.n_ifaces; i++) {
-        if ((!(context.ifaces[i]->tx_power_fd < 0)) &&
-            update_value (context.ifaces[i]->tx_power_fd, &context.ifaces[i]->tx_power) == 0) {
-            log_debug ("'%s' interface TX power updated: %.2lf",
-                       context.ifaces[i]->name, context.ifaces[i]->tx_power);
-            n_updates++;
-        }
-        if ((!(context.ifaces[i]->rx_power_fd < 0)) &&
-            update_value (context.ifaces[i]->rx_power_fd, &context.ifaces[i]->rx_power) == 0) {
-            log_debug ("'%s' interface RX power updated: %.2lf",
-                       context.ifaces[i]->name, context.ifaces[i]->rx_power);
-            n_updates++;
-        }
-        if ((!(context.ifaces[i]->operstate_fd < 0)) &&
-            update_string (context.ifaces[i]->operstate_fd, &context.ifaces[i]->operstate) == 0) {
-            log_debug ("'%s' interface operational state updated: %s",
-                       context.ifaces[i]->name, context.ifaces[i]->operstate);
-            n_updates++;
+/* Rendering is delayed while the terminal is in the background or can't take
+ * more output; everything is redrawn once it can */
+static bool
+power_save_skip_render (void)
+{
+    struct pollfd pfd;
+    pid_t         foreground;
+    bool          blocked;
+
+    if (!power_save)
+        return false;
+
+    pfd.fd = STDOUT_FILENO;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    foreground = tcgetpgrp (STDOUT_FILENO);
+    blocked = ((foreground >= 0 && foreground != getpgrp ()) ||
+               poll (&pfd, 1, 0) <= 0 || !(pfd.revents & POLLOUT));
+
+    if (blocked != power.output_blocked) {
+        power.output_blocked = blocked;
+        log_debug ("terminal output %s", blocked ? "blocked, rendering skipped" : "available again");
+        if (!blocked) {
+            context.refresh_title = true;
+            context.refresh_contents = true;
+            context.refresh_log = true;
         }
     }
 
-    if (n_updates) {
-        log_debug ("need to refresh contents: %u values updated", n_updates);
-        context.refresh_contents = true;
-    }
+    if (blocked && (context.refresh_title || context.refresh_contents || context.refresh_log))
+        power.n_skipped_renders++;
+    return blocked;
+}
+
+static void
+setup_power_save (const struct timespec *now,
+                  struct timespec       *next_reload)
+{
+    power.period_ms = timeout_ms;
+    *next_reload = *now;
+    if (!power_save)
+        return;
+
+    power_save_set_period (timeout_ms, now, next_reload);
+    log_info ("power save mode: reload period between %d and %d ms", timeout_ms, max_timeout_ms);
+}
+
+static void
+print_power_stats (void)
+{
+    struct timespec now;
+    double          elapsed_s;
+    unsigned long   n_sampler_wakeups;
+    unsigned long   n_capture_wakeups;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    elapsed_s = timespec_diff_ms (&now, &context.start_time) / 1000.0;
+    if (elapsed_s <= 0.0)
+        return;
+
+    n_sampler_wakeups = (unsigned long) sampler.n_cycles * (sampler.n_threads - 1);
+    n_capture_wakeups = capture.jitter.n_periods;
+
+    printf ("wakeups:\n"
+            "  main loop:            %.2f per second\n"
+            "  sampler threads:      %.2f per second\n"
+            "  capture sampler:      %.2f per second\n",
+            power.n_wakeups / elapsed_s, n_sampler_wakeups / elapsed_s, n_capture_wakeups / elapsed_s);
+    if (power_save)
+        printf ("  period stretches:     %u\n"
+                "  renders skipped:      %lu\n",
+                power.n_stretches, power.n_skipped_renders);
 }
 
 /******************************************************************************/
 /* Main */
 
 #define QUIT_SHORTCUT 'q'
+#define VIEW_SHORTCUT 'v'
+#define SORT_SHORTCUT 's'
+#define GROUP_SHORTCUT 'g'
+
+static const char *view_str[] = {
+    [VIEW_BOXES]     = "box",
+    [VIEW_TABLE]     = "table",
+    [VIEW_HISTOGRAM] = "histogram",
+};
+
+static void
+scroll_to (long index)
+{
+    long max_index;
+
+    max_index = (long) shown_n_ifaces () - (context.n_ifaces_per_window ? context.n_ifaces_per_window : 1);
+    if (index > max_index)
+        index = max_index;
+    if (index < 0)
+        index = 0;
+    if ((unsigned long) index == context.first_iface_index)
+        return;
+
+    context.first_iface_index = index;
+    context.refresh_contents = true;
+    log_debug ("scroll, first interface index %u", context.first_iface_index);
+}
+
+static void
+select_group (long index)
+{
+    if (index >= (long) grouping.n_groups)
+        index = (long) grouping.n_groups - 1;
+    if (index < 0)
+        index = 0;
+    if ((unsigned long) index == context.selected_group)
+        return;
+
+    context.selected_group = index;
+    context.refresh_contents = true;
+    log_debug ("selected group index %u", context.selected_group);
+}
+
+/* Either the group view, or the per-interface views with all interfaces or
+ * only the members of the given group */
+static void
+show_groups (bool   groups_view,
+             Group *group)
+{
+    context.groups_view = groups_view;
+    context.group = group;
+    context.first_iface_index = 0;
+    /* reload all until the new layout is known */
+    context.n_ifaces_per_window = 0;
+    context.refresh_title = true;
+    context.refresh_contents = true;
+    log_debug ("switched to %s", groups_view ? "group view" : (group ? group->name : "all interfaces"));
+}
 
 static void
 setup_locale (void)
@@ -1381,19 +6908,30 @@ setup_locale (void)
         current_box_charset = BOX_CHARSET_UTF8;
 }
 
+/* Input doesn't delay the next reload, which is due at the given deadline */
 static int
-wait_for_input (void)
+wait_for_input (const struct timespec *deadline)
 {
-    fd_set         input_set;
-    struct timeval menu_timeout;
-
-    menu_timeout.tv_sec = timeout_ms / 1000;
-    menu_timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    fd_set          input_set;
+    struct timeval  menu_timeout;
+    struct timespec now;
+    long            remaining_us;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    remaining_us = (long) (timespec_diff_ms (deadline, &now) * 1000.0);
+    if (remaining_us < 0)
+        remaining_us = 0;
+    menu_timeout.tv_sec = remaining_us / 1000000L;
+    menu_timeout.tv_usec = remaining_us % 1000000L;
 
     FD_ZERO (&input_set);
     FD_SET (0, &input_set);
 
-    if (select (1, &input_set, NULL, NULL, &menu_timeout) < 0)
+    /* wake up as soon as new interfaces are discovered */
+    if (discovery.running)
+        FD_SET (discovery.pipe[0], &input_set);
+
+    if (select (discovery.running ? discovery.pipe[0] + 1 : 1, &input_set, NULL, NULL, &menu_timeout) < 0)
         return -1;
 
     return getch ();
@@ -1401,86 +6939,263 @@ wait_for_input (void)
 
 int main (int argc, char *const *argv)
 {
-    int status = 0;
+    int             status = 0;
+    bool            first_frame = false;
+    struct timespec now;
+    struct timespec next_reload;
+    bool            reload_due;
+    unsigned int    n_changes;
+    int             key;
+
+    clock_gettime (CLOCK_MONOTONIC, &context.start_time);
 
     setup_context (argc, argv);
     setup_log ();
     setup_locale ();
+    fiberstat_set_sysfs_prefix (SYSFS_PREFIX);
+
+    if (n_histogram_merge_paths) {
+        status = merge_histogram_files ();
+        goto out_cleanup_log;
+    }
 
     log_info ("-----------------------------------------------------------");
     log_info ("starting program " PROGRAM_NAME " (v" PROGRAM_VERSION ")...");
 
+    /* before any other thread is created, so that they inherit the settings */
+    if (setup_realtime () < 0) {
+        fprintf (stderr, "error: couldn't setup real-time sampling\n");
+        status = -7;
+        goto out_cleanup_log;
+    }
+
     if (setup_curses () < 0) {
         fprintf (stderr, "error: couldn't setup curses\n");
         status = -1;
         goto out_cleanup_log;
     }
 
-    if (setup_hwmon_list () < 0) {
-        fprintf (stderr, "error: couldn't setup hwmon list\n");
-        status = -2;
-        goto out_cleanup_curses;
+    if (table_view)
+        context.view = VIEW_TABLE;
+
+    /* before any interface is created */
+    if (load_profiles () < 0 || setup_profile_tables () < 0) {
+        fprintf (stderr, "error: couldn't load threshold profiles\n");
+        status = -9;
+        goto out_cleanup_interfaces;
     }
 
-    if (setup_interfaces () < 0) {
-        fprintf (stderr, "error: couldn't setup interfaces\n");
-        status = -3;
-        goto out_cleanup_hwmon;
+    if (setup_alarms () < 0) {
+        fprintf (stderr, "error: couldn't setup alarms\n");
+        status = -4;
+        goto out_cleanup_interfaces;
     }
 
-    do {
-        reload_values ();
+    if (setup_sampler () < 0) {
+        fprintf (stderr, "error: couldn't setup sampler threads\n");
+        status = -6;
+        goto out_cleanup_interfaces;
+    }
+
+    if (load_groups_file () < 0) {
+        fprintf (stderr, "error: couldn't load groups\n");
+        status = -8;
+        goto out_cleanup_interfaces;
+    }
+
+    /* without a valid cache, the UI is shown while discovering */
+    if (!cache_path || load_discovery_cache () < 0) {
+        if (setup_discovery () < 0) {
+            fprintf (stderr, "error: couldn't setup discovery\n");
+            status = -2;
+            goto out_cleanup_interfaces;
+        }
+    } else {
+        /* margins depend on the alarm thresholds */
+        setup_order ();
+        setup_groups ();
+        setup_health ();
+        check_fd_limit ();
+        setup_histograms ();
+
+        if (setup_capture () < 0) {
+            fprintf (stderr, "error: couldn't setup capture\n");
+            status = -5;
+            goto out_cleanup_interfaces;
+        }
+    }
 
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    setup_power_save (&now, &next_reload);
+    do {
         if (context.resize) {
             setup_windows ();
             context.resize = false;
         }
 
-        if (context.refresh_title) {
-            refresh_title ();
-            context.refresh_title = false;
+        /* reloads are scheduled every timeout, unaffected by how long each
+         * iteration takes; if we're late, don't try to catch up with a burst */
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        reload_due = (timespec_diff_ms (&now, &next_reload) >= 0);
+        if (reload_due) {
+            reload_jitter_record (&now, power.period_ms);
+            timespec_add_ms (&next_reload, power.period_ms);
+            if (timespec_diff_ms (&next_reload, &now) < 0)
+                next_reload = now;
+        }
+
+        status = process_discovery ();
+        if (status < 0) {
+            fprintf (stderr, "error: couldn't setup %s\n", (status == -2) ? "hwmon list" : "interfaces");
+            break;
+        }
+        if (status > 0) {
+            status = 0;
+            setup_histograms ();
+            /* capture needs the full list of interfaces */
+            if (setup_capture () < 0) {
+                fprintf (stderr, "error: couldn't setup capture\n");
+                status = -5;
+                break;
+            }
+        }
+
+        n_changes = reload_values ();
+        if (reload_due)
+            power_save_reloaded (n_changes, &now, &next_reload);
+        save_histograms (&now);
+
+        /* refresh flags are kept until rendering is possible */
+        if (!power_save_skip_render ()) {
+            if (context.refresh_title) {
+                refresh_title ();
+                context.refresh_title = false;
+            }
+
+            if (context.refresh_contents) {
+                refresh_contents ();
+                context.refresh_contents = false;
+            }
+
+            if (context.refresh_log) {
+                refresh_log ();
+                context.refresh_log = false;
+            }
+
+            if (!first_frame) {
+                clock_gettime (CLOCK_MONOTONIC, &now);
+                log_info ("first frame shown: %.1f ms since start", timespec_diff_ms (&now, &context.start_time));
+                first_frame = true;
+            }
         }
 
-        if (context.refresh_contents) {
-            refresh_contents ();
-            context.refresh_contents = false;
+        key = wait_for_input (&next_reload);
+        power.n_wakeups++;
+        if (key != ERR) {
+            clock_gettime (CLOCK_MONOTONIC, &now);
+            power_save_input (&now, &next_reload);
         }
 
-        switch (wait_for_input ()) {
+        switch (key) {
             case QUIT_SHORTCUT:
                 context.stop = true;
                 break;
             case KEY_LEFT:
+            case KEY_UP:
 #if defined FORCE_TEST_LEVELS
                 context.refresh_contents = true;
 #endif
-                if (context.left_scroll_arrow) {
-                    assert (context.first_iface_index > 0);
-                    context.first_iface_index--;
-                    context.refresh_contents = true;
-                    log_debug ("scroll left, first interface index %u", context.first_iface_index);
-                }
+                if (context.groups_view)
+                    select_group ((long) context.selected_group - 1);
+                else
+                    scroll_to ((long) context.first_iface_index - 1);
                 break;
             case KEY_RIGHT:
+            case KEY_DOWN:
 #if defined FORCE_TEST_LEVELS
                 context.refresh_contents = true;
 #endif
-                if (context.right_scroll_arrow) {
-                    context.first_iface_index++;
-                    context.refresh_contents = true;
-                    log_debug ("scroll right, first interface index %u", context.first_iface_index);
-                }
+                if (context.groups_view)
+                    select_group ((long) context.selected_group + 1);
+                else
+                    scroll_to ((long) context.first_iface_index + 1);
+                break;
+            case KEY_PPAGE:
+                if (context.groups_view)
+                    select_group ((long) context.selected_group - context.n_groups_per_window);
+                else
+                    scroll_to ((long) context.first_iface_index - context.n_ifaces_per_window);
+                break;
+            case KEY_NPAGE:
+                if (context.groups_view)
+                    select_group ((long) context.selected_group + context.n_groups_per_window);
+                else
+                    scroll_to ((long) context.first_iface_index + context.n_ifaces_per_window);
+                break;
+            case KEY_HOME:
+                if (context.groups_view)
+                    select_group (0);
+                else
+                    scroll_to (0);
+                break;
+            case KEY_END:
+                if (context.groups_view)
+                    select_group (grouping.n_groups);
+                else
+                    scroll_to (shown_n_ifaces ());
+                break;
+            case GROUP_SHORTCUT:
+                show_groups (!context.groups_view, NULL);
+                break;
+            case KEY_ENTER:
+            case '\n':
+            case '\r':
+                if (context.groups_view && grouping.n_groups)
+                    show_groups (false, grouping.groups[context.selected_group]);
+                break;
+            case VIEW_SHORTCUT:
+                context.groups_view = false;
+                context.view = (context.view + 1) % VIEW_LAST;
+                /* reload all until the new layout is known */
+                context.n_ifaces_per_window = 0;
+                context.refresh_contents = true;
+                log_debug ("switched to %s view", view_str[context.view]);
+                break;
+            case SORT_SHORTCUT:
+                set_sort_mode ((context.sort_mode + 1) % SORT_MODE_LAST);
+                context.first_iface_index = 0;
+                context.refresh_contents = true;
+                log_debug ("sort mode changed: %u", context.sort_mode);
                 break;
             default:
                 break;
         }
     } while (!context.stop);
 
+out_cleanup_interfaces:
+    teardown_discovery ();
+    teardown_capture ();
+    teardown_sampler ();
+    teardown_fd_budget ();
+    teardown_alarms ();
+    teardown_histograms ();
+    teardown_groups ();
     teardown_interfaces ();
-out_cleanup_hwmon:
-    teardown_hwmon_list ();
-out_cleanup_curses:
+    teardown_profiles ();
+    fiberstat_hwmon_list_clear (&context.hwmon_list);
     teardown_curses ();
+    print_sampler_stats ();
+    if (stats) {
+        print_power_stats ();
+        print_deadband_stats ();
+        print_jitter ("reload", NULL, &reload_jitter);
+        /* only if there's an end window other than the start one */
+        if (reload_jitter_n_windows > 2) {
+            print_jitter ("reload", "start window", &reload_jitter_start);
+            print_jitter ("reload", "end window", &reload_jitter_end);
+        }
+        print_jitter ("capture", NULL, &capture.jitter);
+    }
 out_cleanup_log:
     teardown_log();
     return status;
@@ -0,0 +1,268 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ * libfiberstat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2019 Zodiac Inflight Innovations
+ * Copyright (C) 2019 Aleksander Morgado <aleksander@aleksander.es>
+ */
+
+#ifndef LIBFIBERSTAT_PRIVATE_H
+#define LIBFIBERSTAT_PRIVATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "libfiberstat.h"
+
+/******************************************************************************/
+/* Internals of libfiberstat
+ *
+ * The building blocks of the monitor API, also used by the fiberstat program
+ * for its own scheduling: sysfs files with read error tracking, and the hwmon
+ * entry list used to match network interfaces with their hwmon entry through
+ * the sfp phandle. These may be used from several threads, as noted. Their
+ * layouts aren't part of the public API, and may change at any time.
+ */
+
+/******************************************************************************/
+/* sysfs access */
+
+/* Directories of the hwmon and net entries, with the prefix given, if any */
+const char *fiberstat_get_hwmon_dir    (void);
+const char *fiberstat_get_net_dir      (void);
+
+/* Like openat(), but counting the opens and path components walked, which
+ * are reported in the statistics. Thread-safe, as are the statistics. */
+int fiberstat_sysfs_openat (int         dir_fd,
+                            const char *path,
+                            int         flags);
+
+typedef struct {
+    unsigned int n_opens;
+    unsigned int n_path_components;
+    unsigned int n_reopens;
+} FiberstatSysfsStats;
+
+void fiberstat_get_sysfs_stats (FiberstatSysfsStats *stats);
+
+/******************************************************************************/
+/* Files read periodically
+ *
+ * Files are closed after too many consecutive read errors (e.g. when the
+ * module is pulled), and opened again with an exponential backoff. The number
+ * of reopen attempts per poll cycle is limited, so that lots of failing files
+ * don't cause a storm of syscalls; each poll cycle (e.g. of each monitor)
+ * keeps its own count.
+ *
+ * Opening files must be done from a single thread per poll cycle; reading
+ * different files may be done from several threads at the same time.
+ */
+
+/* Enough for power values in uW and operational states */
+#define FIBERSTAT_FILE_BUFFER_SIZE 32
+
+typedef struct {
+    int              fd;
+    const char      *path;
+    unsigned int     n_read_errors;
+    /* only set while failing */
+    unsigned int     backoff_ms;
+    struct timespec  next_reopen;
+    /* last read contents, n_read < 0 if not read or on read errors */
+    char             buffer[FIBERSTAT_FILE_BUFFER_SIZE];
+    ssize_t          n_read;
+    struct timespec  read_time;
+} FiberstatFile;
+
+/* The path is not copied, and must be valid as long as the file */
+void fiberstat_file_init      (FiberstatFile       *file,
+                               const char          *path);
+bool fiberstat_file_is_failed (const FiberstatFile *file);
+void fiberstat_file_close     (FiberstatFile       *file);
+
+/* Reopen attempts in the current poll cycle */
+typedef struct {
+    unsigned int n_reopens;
+} FiberstatFileCycle;
+
+/* Starts a new poll cycle, with a new limit of reopen attempts */
+void fiberstat_file_begin_cycle (FiberstatFileCycle *cycle);
+
+/* Opens the file relative to the given directory, or by path if none given,
+ * unless it's failing and not yet due for a reopen, or the poll cycle
+ * already reached its limit of reopen attempts. Without a poll cycle, e.g.
+ * for files just discovered, reopens aren't limited. */
+void fiberstat_file_open      (FiberstatFile       *file,
+                               FiberstatFileCycle  *cycle,
+                               int                  dir_fd,
+                               const char          *name);
+
+/* Reads the whole file into its buffer, tagging the contents with the
+ * CLOCK_MONOTONIC time the read finished. Returns -1 if the file isn't open
+ * or on read errors. */
+int  fiberstat_file_read      (FiberstatFile       *file);
+
+/* Unexpected contents are given as FIBERSTAT_OPERSTATE_UNKNOWN */
+FiberstatOperstate fiberstat_parse_operstate (const char *buffer,
+                                              size_t      len);
+
+/* Parse what was last read, returning 0 only if the value changed. Files
+ * with read errors give FIBERSTAT_POWER_UNKNOWN. */
+int  fiberstat_file_update_power     (FiberstatFile      *file,
+                                      float              *power);
+int  fiberstat_file_update_operstate (FiberstatFile      *file,
+                                      FiberstatOperstate *operstate);
+
+/* Power given in uW by the kernel, in dBm */
+float fiberstat_parse_power (const char *buffer);
+
+/******************************************************************************/
+/* DDM channels
+ *
+ * Besides the TX/RX power levels, the hwmon entries of SFP modules expose
+ * other digital diagnostics monitoring (DDM) channels, e.g. the temperature,
+ * which may predict failures before the power levels drop. Each channel is
+ * found by the contents of a label file of the hwmon entry, e.g. temp1_label,
+ * and read from the input file with the same prefix, e.g. temp1_input, whose
+ * value is converted to the unit of the channel.
+ */
+
+typedef struct {
+    /* short name, e.g. for command line options */
+    const char  *name;
+    /* contents of the label file */
+    const char  *label;
+    const char  *unit;
+    /* decimals worth showing */
+    unsigned int precision;
+    /* value given when it's unknown, e.g. on read errors */
+    float        unknown;
+    /* value given by the kernel, in the unit of the channel */
+    float      (* parse) (const char *buffer);
+} FiberstatChannelInfo;
+
+const FiberstatChannelInfo *fiberstat_channel_get_info  (FiberstatChannel  channel);
+
+/* FIBERSTAT_CHANNEL_LAST if there's no channel with the given name or label */
+FiberstatChannel            fiberstat_channel_from_name  (const char       *name);
+FiberstatChannel            fiberstat_channel_from_label (const char       *label);
+
+/* Like fiberstat_file_update_power(), for any channel */
+int  fiberstat_file_update_channel (FiberstatFile    *file,
+                                    FiberstatChannel  channel,
+                                    float            *value);
+
+/* Returns -1 only on read errors. Uses pread(), so it's safe to use on a
+ * file descriptor shared with other threads. */
+int   fiberstat_read_power  (int         fd,
+                             float      *power);
+
+/******************************************************************************/
+/* List of hwmon entries */
+
+#define FIBERSTAT_PHANDLE_SIZE 4
+
+/* File of the operational state, in each net entry directory */
+#define FIBERSTAT_OPERSTATE_FILE "operstate"
+
+typedef struct {
+    char    *name;
+    /* input file of each channel, NULL if not available */
+    char    *paths[FIBERSTAT_CHANNEL_LAST];
+    /* opened during discovery, until taken by the interface */
+    int      tx_power_fd;
+    int      rx_power_fd;
+    uint8_t  sfp_phandle[FIBERSTAT_PHANDLE_SIZE];
+} FiberstatHwmon;
+
+/* Entries may be added from several threads at the same time */
+typedef struct {
+    FiberstatHwmon  **hwmon;
+    unsigned int      n_hwmon;
+    pthread_mutex_t   mutex;
+} FiberstatHwmonList;
+
+void            fiberstat_hwmon_list_init   (FiberstatHwmonList *list);
+void            fiberstat_hwmon_list_clear  (FiberstatHwmonList *list);
+
+/* Takes ownership of the given paths of each channel, the TX/RX power ones
+ * required, and of the fds, if any */
+int             fiberstat_hwmon_list_add    (FiberstatHwmonList *list,
+                                             const char         *name,
+                                             char              **paths,
+                                             int                 tx_power_fd,
+                                             int                 rx_power_fd,
+                                             const uint8_t      *phandle);
+FiberstatHwmon *fiberstat_hwmon_list_lookup (FiberstatHwmonList *list,
+                                             const uint8_t      *phandle);
+
+/* Adds the hwmon entry with the given directory to the list if it's a valid
+ * one, scanning its label files once to find the channels, and keeping the
+ * power input files open if requested */
+int             fiberstat_hwmon_discover    (FiberstatHwmonList *list,
+                                             const char         *name,
+                                             int                 hwmon_fd,
+                                             bool                keep_files_open);
+
+/* The hwmon entry matching the net entry with the given directory, if any */
+FiberstatHwmon *fiberstat_net_lookup_hwmon  (FiberstatHwmonList *list,
+                                             const char         *name,
+                                             int                 iface_fd);
+
+/******************************************************************************/
+/* Monitor */
+
+struct _FiberstatSample {
+    const char          *name;
+    const char          *hwmon;
+    float                tx_power;
+    float                rx_power;
+    FiberstatOperstate   operstate;
+    /* value of every channel, including the TX/RX power ones given above;
+     * the unknown value of the channel if not available */
+    float                values[FIBERSTAT_CHANNEL_LAST];
+    /* CLOCK_MONOTONIC time each value was read */
+    struct timespec      tx_power_time;
+    struct timespec      rx_power_time;
+    struct timespec      operstate_time;
+    /* FIBERSTAT_SAMPLE flags of the values updated in the last poll cycle */
+    unsigned int         updates;
+    /* FIBERSTAT_SAMPLE flags of the files failing */
+    unsigned int         failures;
+};
+
+struct _FiberstatSnapshot {
+    unsigned long    id;
+    unsigned int     n_samples;
+    /* CLOCK_MONOTONIC times of the first and last power values read, if
+     * n_reads > 0 */
+    struct timespec  first_read;
+    struct timespec  last_read;
+    unsigned int     n_reads;
+};
+
+/* Snapshot bookkeeping of fiberstat_poll(), also for programs with their
+ * own poll cycle: starts a new numbered snapshot, and accounts the time each
+ * power file was read in it, if read */
+void fiberstat_snapshot_begin    (FiberstatSnapshot   *snapshot);
+void fiberstat_snapshot_add_read (FiberstatSnapshot   *snapshot,
+                                  const FiberstatFile *file);
+
+#endif /* LIBFIBERSTAT_PRIVATE_H */
@@ -0,0 +1,1310 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ * libfiberstat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2019 Zodiac Inflight Innovations
+ * Copyright (C) 2019 Aleksander Morgado <aleksander@aleksander.es>
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <dirent.h>
+
+/* natsort */
+#include <strnatcmp.h>
+
+#include "libfiberstat-private.h"
+
+/******************************************************************************/
+/* Logging */
+
+static FiberstatLogFunc  log_func;
+static void             *log_user_data;
+
+void
+fiberstat_set_log_func (FiberstatLogFunc  func,
+                        void             *user_data)
+{
+    log_func = func;
+    log_user_data = user_data;
+}
+
+static void
+log_message (FiberstatLogLevel  level,
+             const char        *fmt,
+             ...)
+{
+    char    *message;
+    va_list  args;
+
+    if (!log_func)
+        return;
+
+    va_start (args, fmt);
+    if (vasprintf (&message, fmt, args) == -1) {
+        va_end (args);
+        return;
+    }
+    va_end (args);
+
+    log_func (level, message, log_user_data);
+    free (message);
+}
+
+#define log_error(...)   log_message (FIBERSTAT_LOG_LEVEL_ERROR,   ## __VA_ARGS__ )
+#define log_warning(...) log_message (FIBERSTAT_LOG_LEVEL_WARNING, ## __VA_ARGS__ )
+#define log_info(...)    log_message (FIBERSTAT_LOG_LEVEL_INFO,    ## __VA_ARGS__ )
+#define log_debug(...)   log_message (FIBERSTAT_LOG_LEVEL_DEBUG,   ## __VA_ARGS__ )
+
+/******************************************************************************/
+/* Time helpers */
+
+static double
+timespec_diff_ms (const struct timespec *a,
+                  const struct timespec *b)
+{
+    return ((a->tv_sec - b->tv_sec) * 1000.0) + ((a->tv_nsec - b->tv_nsec) / 1000000.0);
+}
+
+static void
+timespec_add_ms (struct timespec *ts,
+                 unsigned int     ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/******************************************************************************/
+/* sysfs access
+ *
+ * During discovery, files are opened relative to the directory of each hwmon
+ * or net entry instead of by absolute path, so that the kernel doesn't need
+ * to walk the whole path from the root on every open. The number of opens and
+ * path components walked are counted, to be reported once discovery is done.
+ */
+
+#define HWMON_SYSFS_DIR "/sys/class/hwmon"
+#define NET_SYSFS_DIR   "/sys/class/net"
+
+static char hwmon_dir[PATH_MAX] = HWMON_SYSFS_DIR;
+static char net_dir[PATH_MAX]   = NET_SYSFS_DIR;
+
+static unsigned int sysfs_n_opens;
+static unsigned int sysfs_n_path_components;
+static unsigned int sysfs_n_reopens;
+
+void
+fiberstat_set_sysfs_prefix (const char *prefix)
+{
+    snprintf (hwmon_dir, sizeof (hwmon_dir), "%s" HWMON_SYSFS_DIR, prefix ? prefix : "");
+    snprintf (net_dir, sizeof (net_dir), "%s" NET_SYSFS_DIR, prefix ? prefix : "");
+}
+
+const char *
+fiberstat_get_hwmon_dir (void)
+{
+    return hwmon_dir;
+}
+
+const char *
+fiberstat_get_net_dir (void)
+{
+    return net_dir;
+}
+
+int
+fiberstat_sysfs_openat (int         dir_fd,
+                        const char *path,
+                        int         flags)
+{
+    static bool   too_many_files;
+    const char   *p;
+    unsigned int  n_components = 0;
+    int           fd;
+
+    for (p = path; *p; p++) {
+        if ((*p != '/') && ((p == path) || (p[-1] == '/')))
+            n_components++;
+    }
+    __atomic_add_fetch (&sysfs_n_opens, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch (&sysfs_n_path_components, n_components, __ATOMIC_RELAXED);
+
+    fd = openat (dir_fd, path, flags | O_CLOEXEC);
+    if ((fd < 0) && (errno == EMFILE) && !__atomic_exchange_n (&too_many_files, true, __ATOMIC_RELAXED))
+        log_warning ("too many open files: a fd budget may be needed");
+    return fd;
+}
+
+void
+fiberstat_get_sysfs_stats (FiberstatSysfsStats *stats)
+{
+    stats->n_opens = __atomic_load_n (&sysfs_n_opens, __ATOMIC_RELAXED);
+    stats->n_path_components = __atomic_load_n (&sysfs_n_path_components, __ATOMIC_RELAXED);
+    stats->n_reopens = __atomic_load_n (&sysfs_n_reopens, __ATOMIC_RELAXED);
+}
+
+/******************************************************************************/
+/* Files read periodically */
+
+#define FILE_MAX_READ_ERRORS       3
+#define FILE_MIN_BACKOFF_MS     1000
+#define FILE_MAX_BACKOFF_MS    60000
+#define FILE_MAX_REOPENS_PER_CYCLE 16
+
+void
+fiberstat_file_init (FiberstatFile *file,
+                     const char    *path)
+{
+    memset (file, 0, sizeof (FiberstatFile));
+    file->fd = -1;
+    file->path = path;
+    file->n_read = -1;
+}
+
+bool
+fiberstat_file_is_failed (const FiberstatFile *file)
+{
+    return (file->backoff_ms > 0);
+}
+
+void
+fiberstat_file_close (FiberstatFile *file)
+{
+    if (!(file->fd < 0))
+        close (file->fd);
+    file->fd = -1;
+}
+
+static void
+file_fail (FiberstatFile *file)
+{
+    fiberstat_file_close (file);
+    file->n_read_errors = 0;
+    if (!file->backoff_ms)
+        file->backoff_ms = FILE_MIN_BACKOFF_MS;
+    else if (file->backoff_ms < FILE_MAX_BACKOFF_MS / 2)
+        file->backoff_ms *= 2;
+    else
+        file->backoff_ms = FILE_MAX_BACKOFF_MS;
+    clock_gettime (CLOCK_MONOTONIC, &file->next_reopen);
+    timespec_add_ms (&file->next_reopen, file->backoff_ms);
+}
+
+void
+fiberstat_file_begin_cycle (FiberstatFileCycle *cycle)
+{
+    cycle->n_reopens = 0;
+}
+
+void
+fiberstat_file_open (FiberstatFile      *file,
+                     FiberstatFileCycle *cycle,
+                     int                 dir_fd,
+                     const char         *name)
+{
+    if (!(file->fd < 0))
+        return;
+
+    if (fiberstat_file_is_failed (file)) {
+        struct timespec now;
+
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        if ((timespec_diff_ms (&now, &file->next_reopen) < 0) ||
+            (cycle && (cycle->n_reopens >= FILE_MAX_REOPENS_PER_CYCLE)))
+            return;
+        if (cycle)
+            cycle->n_reopens++;
+        __atomic_add_fetch (&sysfs_n_reopens, 1, __ATOMIC_RELAXED);
+    }
+
+    file->fd = fiberstat_sysfs_openat ((dir_fd < 0) ? AT_FDCWD : dir_fd, (dir_fd < 0) ? file->path : name, O_RDONLY);
+    if (file->fd < 0) {
+        file_fail (file);
+        log_debug ("couldn't open %s, next attempt in %u ms", file->path, file->backoff_ms);
+    }
+}
+
+/* Files are not considered healthy again until read successfully */
+static void
+file_read_ok (FiberstatFile *file)
+{
+    if (fiberstat_file_is_failed (file))
+        log_info ("%s recovered", file->path);
+    file->n_read_errors = 0;
+    file->backoff_ms = 0;
+}
+
+static void
+file_read_error (FiberstatFile *file)
+{
+    if (++file->n_read_errors < FILE_MAX_READ_ERRORS)
+        return;
+
+    file_fail (file);
+    log_warning ("%s closed after %u read errors, next attempt in %u ms",
+                 file->path, FILE_MAX_READ_ERRORS, file->backoff_ms);
+}
+
+int
+fiberstat_file_read (FiberstatFile *file)
+{
+    file->n_read = -1;
+    if (file->fd < 0)
+        return -1;
+
+    /* pread() doesn't touch the file offset, so this is safe to use
+     * from several threads as well */
+    file->n_read = pread (file->fd, file->buffer, sizeof (file->buffer) - 1, 0);
+    clock_gettime (CLOCK_MONOTONIC, &file->read_time);
+    if (file->n_read <= 0) {
+        file->n_read = -1;
+        file_read_error (file);
+        return -1;
+    }
+    file->buffer[file->n_read] = '\0';
+    file_read_ok (file);
+    return 0;
+}
+
+float
+fiberstat_parse_power (const char *buffer)
+{
+    float value;
+
+    value = strtof (buffer, NULL);
+    if (value < 0.1)
+        return FIBERSTAT_POWER_UNKNOWN;
+    /* power given in uW by the kernel, we use dBm instead */
+    return (10 * log10 (value / 1000.0));
+}
+
+int
+fiberstat_read_power (int    fd,
+                      float *power)
+{
+    char    buffer[255] = { 0 };
+    ssize_t n_read;
+
+    n_read = pread (fd, buffer, sizeof (buffer) - 1, 0);
+    if (n_read <= 0)
+        return -1;
+
+    *power = fiberstat_parse_power (buffer);
+    return 0;
+}
+
+int
+fiberstat_file_update_power (FiberstatFile *file,
+                             float         *power)
+{
+    return fiberstat_file_update_channel (file, FIBERSTAT_CHANNEL_TX_POWER, power);
+}
+
+/* Same order as FiberstatOperstate */
+static const char *operstate_strings[] = {
+    "unknown",
+    "notpresent",
+    "down",
+    "lowerlayerdown",
+    "testing",
+    "dormant",
+    "up",
+};
+
+FiberstatOperstate
+fiberstat_parse_operstate (const char *buffer,
+                           size_t      len)
+{
+    unsigned int i;
+
+    if (len && buffer[len - 1] == '\n')
+        len--;
+
+    for (i = FIBERSTAT_OPERSTATE_UNKNOWN + 1; i < FIBERSTAT_OPERSTATE_LAST; i++) {
+        if ((strlen (operstate_strings[i]) == len) && (memcmp (operstate_strings[i], buffer, len) == 0))
+            return (FiberstatOperstate) i;
+    }
+    return FIBERSTAT_OPERSTATE_UNKNOWN;
+}
+
+const char *
+fiberstat_operstate_to_string (FiberstatOperstate operstate)
+{
+    if (operstate >= FIBERSTAT_OPERSTATE_LAST)
+        return operstate_strings[FIBERSTAT_OPERSTATE_UNKNOWN];
+    return operstate_strings[operstate];
+}
+
+int
+fiberstat_file_update_operstate (FiberstatFile      *file,
+                                 FiberstatOperstate *operstate)
+{
+    FiberstatOperstate value;
+
+    if (file->n_read < 0)
+        return -1;
+
+    value = fiberstat_parse_operstate (file->buffer, file->n_read);
+    if (value == *operstate)
+        return -1;
+
+    *operstate = value;
+    return 0;
+}
+
+static bool
+read_file_contents (int      fd,
+                    uint8_t *contents,
+                    size_t   contents_size)
+{
+    ssize_t n_read;
+
+    n_read = read (fd, contents, contents_size);
+    close (fd);
+    return (n_read == (ssize_t) contents_size);
+}
+
+/******************************************************************************/
+/* DDM channels
+ *
+ * The kernel gives temperatures in millidegrees Celsius, voltages in mV,
+ * currents in mA and power in uW (see the sfp hwmon driver).
+ */
+
+static float
+parse_milli (const char *buffer)
+{
+    return strtof (buffer, NULL) / 1000.0;
+}
+
+static float
+parse_unit (const char *buffer)
+{
+    return strtof (buffer, NULL);
+}
+
+/* Same order as FiberstatChannel */
+static const FiberstatChannelInfo channel_info[] = {
+    { "tx",   "TX_power",    "dBm", 2, FIBERSTAT_POWER_UNKNOWN, fiberstat_parse_power },
+    { "rx",   "RX_power",    "dBm", 2, FIBERSTAT_POWER_UNKNOWN, fiberstat_parse_power },
+    { "temp", "temperature", "C",   1, NAN,                     parse_milli           },
+    { "vcc",  "VCC",         "V",   2, NAN,                     parse_milli           },
+    { "bias", "bias",        "mA",  1, NAN,                     parse_unit            },
+};
+
+const FiberstatChannelInfo *
+fiberstat_channel_get_info (FiberstatChannel channel)
+{
+    if (channel >= FIBERSTAT_CHANNEL_LAST)
+        return NULL;
+    return &channel_info[channel];
+}
+
+const char *
+fiberstat_channel_get_name (FiberstatChannel channel)
+{
+    if (channel >= FIBERSTAT_CHANNEL_LAST)
+        return NULL;
+    return channel_info[channel].name;
+}
+
+const char *
+fiberstat_channel_get_unit (FiberstatChannel channel)
+{
+    if (channel >= FIBERSTAT_CHANNEL_LAST)
+        return NULL;
+    return channel_info[channel].unit;
+}
+
+FiberstatChannel
+fiberstat_channel_from_name (const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < FIBERSTAT_CHANNEL_LAST; i++) {
+        if (strcmp (channel_info[i].name, name) == 0)
+            break;
+    }
+    return (FiberstatChannel) i;
+}
+
+FiberstatChannel
+fiberstat_channel_from_label (const char *label)
+{
+    unsigned int i;
+
+    for (i = 0; i < FIBERSTAT_CHANNEL_LAST; i++) {
+        if (strcmp (channel_info[i].label, label) == 0)
+            break;
+    }
+    return (FiberstatChannel) i;
+}
+
+int
+fiberstat_file_update_channel (FiberstatFile    *file,
+                               FiberstatChannel  channel,
+                               float            *value)
+{
+    float new_value;
+
+    if (file->n_read < 0) {
+        /* read errors and failing files are given as unknown values */
+        if ((file->fd < 0) && !fiberstat_file_is_failed (file))
+            return -1;
+        new_value = channel_info[channel].unknown;
+    } else
+        new_value = channel_info[channel].parse (file->buffer);
+
+    if (isnan (new_value) || isnan (*value)) {
+        if (isnan (new_value) && isnan (*value))
+            return -1;
+    } else if (fabs (new_value - *value) < 0.001)
+        return -1;
+
+    *value = new_value;
+    return 0;
+}
+
+/******************************************************************************/
+/* List of hwmon entries */
+
+#define HWMON_LABEL_SUFFIX "_label"
+#define HWMON_INPUT_SUFFIX "_input"
+#define HWMON_PHANDLE_FILE "of_node/phandle"
+
+#define NET_PHANDLE_FILE "of_node/sfp"
+
+static void
+free_paths (char **paths)
+{
+    unsigned int i;
+
+    for (i = 0; i < FIBERSTAT_CHANNEL_LAST; i++) {
+        free (paths[i]);
+        paths[i] = NULL;
+    }
+}
+
+static void
+hwmon_free (FiberstatHwmon *hwmon)
+{
+    if (!(hwmon->tx_power_fd < 0))
+        close (hwmon->tx_power_fd);
+    if (!(hwmon->rx_power_fd < 0))
+        close (hwmon->rx_power_fd);
+    free_paths (hwmon->paths);
+    free (hwmon->name);
+    free (hwmon);
+}
+
+void
+fiberstat_hwmon_list_init (FiberstatHwmonList *list)
+{
+    list->hwmon = NULL;
+    list->n_hwmon = 0;
+    pthread_mutex_init (&list->mutex, NULL);
+}
+
+void
+fiberstat_hwmon_list_clear (FiberstatHwmonList *list)
+{
+    unsigned int i;
+
+    for (i = 0; i < list->n_hwmon; i++)
+        hwmon_free (list->hwmon[i]);
+    free (list->hwmon);
+    list->hwmon = NULL;
+    list->n_hwmon = 0;
+}
+
+FiberstatHwmon *
+fiberstat_hwmon_list_lookup (FiberstatHwmonList *list,
+                             const uint8_t      *phandle)
+{
+    FiberstatHwmon *hwmon = NULL;
+    unsigned int    i;
+
+    pthread_mutex_lock (&list->mutex);
+    for (i = 0; !hwmon && (i < list->n_hwmon); i++) {
+        if (memcmp (list->hwmon[i]->sfp_phandle, phandle, FIBERSTAT_PHANDLE_SIZE) == 0)
+            hwmon = list->hwmon[i];
+    }
+    pthread_mutex_unlock (&list->mutex);
+    return hwmon;
+}
+
+int
+fiberstat_hwmon_list_add (FiberstatHwmonList *list,
+                          const char         *name,
+                          char              **paths,
+                          int                 tx_power_fd,
+                          int                 rx_power_fd,
+                          const uint8_t      *phandle)
+{
+    FiberstatHwmon  *hwmon;
+    FiberstatHwmon **aux;
+    unsigned int     i;
+
+    hwmon = calloc (sizeof (FiberstatHwmon), 1);
+    if (hwmon)
+        hwmon->name = strdup (name);
+    if (!hwmon || !hwmon->name || !paths[FIBERSTAT_CHANNEL_TX_POWER] || !paths[FIBERSTAT_CHANNEL_RX_POWER]) {
+        if (hwmon)
+            free (hwmon->name);
+        free (hwmon);
+        free_paths (paths);
+        if (!(tx_power_fd < 0))
+            close (tx_power_fd);
+        if (!(rx_power_fd < 0))
+            close (rx_power_fd);
+        return -2;
+    }
+
+    for (i = 0; i < FIBERSTAT_CHANNEL_LAST; i++) {
+        hwmon->paths[i] = paths[i];
+        paths[i] = NULL;
+    }
+    hwmon->tx_power_fd = tx_power_fd;
+    hwmon->rx_power_fd = rx_power_fd;
+    memcpy (hwmon->sfp_phandle, phandle, FIBERSTAT_PHANDLE_SIZE);
+
+    pthread_mutex_lock (&list->mutex);
+    aux = realloc (list->hwmon, sizeof (FiberstatHwmon *) * (list->n_hwmon + 1));
+    if (aux) {
+        list->hwmon = aux;
+        list->hwmon[list->n_hwmon++] = hwmon;
+    }
+    pthread_mutex_unlock (&list->mutex);
+    if (!aux) {
+        hwmon_free (hwmon);
+        return -3;
+    }
+
+    log_info ("hwmon '%s' is a valid monitor with sfp handle %02x:%02x:%02x:%02x",
+              name, phandle[0], phandle[1], phandle[2], phandle[3]);
+    return 0;
+}
+
+/* Label of the given file, without the trailing newline */
+static bool
+read_label (int         dir_fd,
+            const char *path,
+            char       *label,
+            size_t      label_size)
+{
+    int     fd;
+    ssize_t n_read;
+
+    fd = fiberstat_sysfs_openat (dir_fd, path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    n_read = read (fd, label, label_size - 1);
+    close (fd);
+    if (n_read <= 0)
+        return false;
+    label[n_read] = '\0';
+    label[strcspn (label, "\n")] = '\0';
+    return true;
+}
+
+/* The label files are scanned once, and the input files of the channels
+ * found are given by absolute path, still needed to open the files again */
+static void
+load_channel_paths (const char  *hwmon,
+                    int          hwmon_fd,
+                    char       **paths)
+{
+    DIR           *d;
+    struct dirent *dir;
+    int            fd;
+
+    fd = fiberstat_sysfs_openat (hwmon_fd, ".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return;
+
+    d = fdopendir (fd);
+    if (!d) {
+        close (fd);
+        return;
+    }
+
+    while ((dir = readdir (d)) != NULL) {
+        FiberstatChannel channel;
+        char             label[64];
+        char             path[PATH_MAX];
+        size_t           len;
+        size_t           prefix_len;
+
+        len = strlen (dir->d_name);
+        if ((len <= strlen (HWMON_LABEL_SUFFIX)) ||
+            (strcmp (&dir->d_name[len - strlen (HWMON_LABEL_SUFFIX)], HWMON_LABEL_SUFFIX) != 0))
+            continue;
+        if (!read_label (hwmon_fd, dir->d_name, label, sizeof (label)))
+            continue;
+
+        channel = fiberstat_channel_from_label (label);
+        if ((channel == FIBERSTAT_CHANNEL_LAST) || paths[channel])
+            continue;
+
+        prefix_len = len - strlen (HWMON_LABEL_SUFFIX);
+        if (snprintf (path, sizeof (path), "%s/%s/%.*s" HWMON_INPUT_SUFFIX,
+                      hwmon_dir, hwmon, (int) prefix_len, dir->d_name) >= (int) sizeof (path))
+            continue;
+        paths[channel] = strdup (path);
+        log_debug ("hwmon '%s' has %s channel at %s", hwmon, channel_info[channel].name, path);
+    }
+
+    closedir (d);
+}
+
+/* The power input files are left open, to be used by the interface */
+static bool
+load_channel_files (const char  *hwmon,
+                    int          hwmon_fd,
+                    char       **paths,
+                    int         *out_tx_fd,
+                    int         *out_rx_fd)
+{
+    int tx_fd = -1;
+    int rx_fd = -1;
+
+    load_channel_paths (hwmon, hwmon_fd, paths);
+
+    if (!paths[FIBERSTAT_CHANNEL_TX_POWER]) {
+        log_debug ("hwmon '%s' doesn't have expected tx power label file", hwmon);
+        goto out;
+    }
+
+    if (!paths[FIBERSTAT_CHANNEL_RX_POWER]) {
+        log_debug ("hwmon '%s' doesn't have expected rx power label file", hwmon);
+        goto out;
+    }
+
+    tx_fd = fiberstat_sysfs_openat (hwmon_fd, strrchr (paths[FIBERSTAT_CHANNEL_TX_POWER], '/') + 1, O_RDONLY);
+    if (tx_fd < 0) {
+        log_debug ("hwmon '%s' doesn't have tx power input file", hwmon);
+        goto out;
+    }
+
+    rx_fd = fiberstat_sysfs_openat (hwmon_fd, strrchr (paths[FIBERSTAT_CHANNEL_RX_POWER], '/') + 1, O_RDONLY);
+    if (rx_fd < 0) {
+        log_debug ("hwmon '%s' doesn't have rx power input file", hwmon);
+        goto out;
+    }
+
+    *out_tx_fd = tx_fd;
+    *out_rx_fd = rx_fd;
+    return true;
+
+out:
+    if (!(tx_fd < 0))
+        close (tx_fd);
+    free_paths (paths);
+    return false;
+}
+
+static bool
+load_phandle (const char *type,
+              const char *name,
+              int         dir_fd,
+              const char *path,
+              uint8_t    *phandle)
+{
+    int fd;
+
+    fd = fiberstat_sysfs_openat (dir_fd, path, O_RDONLY);
+    if (fd < 0) {
+        log_debug ("%s '%s' doesn't have sfp phandle file", type, name);
+        return false;
+    }
+
+    if (!read_file_contents (fd, phandle, FIBERSTAT_PHANDLE_SIZE)) {
+        log_warning ("couldn't read %s '%s' sfp phandle file", type, name);
+        return false;
+    }
+
+    return true;
+}
+
+int
+fiberstat_hwmon_discover (FiberstatHwmonList *list,
+                          const char         *name,
+                          int                 hwmon_fd,
+                          bool                keep_files_open)
+{
+    char    *paths[FIBERSTAT_CHANNEL_LAST] = { NULL };
+    int      tx_fd = -1;
+    int      rx_fd = -1;
+    uint8_t  phandle[FIBERSTAT_PHANDLE_SIZE];
+
+    if (!load_phandle ("hwmon", name, hwmon_fd, HWMON_PHANDLE_FILE, phandle))
+        return 0;
+
+    if (!load_channel_files (name, hwmon_fd, paths, &tx_fd, &rx_fd))
+        return 0;
+
+    if (!keep_files_open) {
+        close (tx_fd);
+        close (rx_fd);
+        tx_fd = rx_fd = -1;
+    }
+
+    /* valid hwmon entry */
+    return fiberstat_hwmon_list_add (list, name, paths, tx_fd, rx_fd, phandle);
+}
+
+FiberstatHwmon *
+fiberstat_net_lookup_hwmon (FiberstatHwmonList *list,
+                            const char         *name,
+                            int                 iface_fd)
+{
+    FiberstatHwmon *hwmon;
+    uint8_t         phandle[FIBERSTAT_PHANDLE_SIZE];
+
+    if (!load_phandle ("iface", name, iface_fd, NET_PHANDLE_FILE, phandle))
+        return NULL;
+
+    hwmon = fiberstat_hwmon_list_lookup (list, phandle);
+    if (!hwmon)
+        log_warning ("couldn't match hwmon entry for net iface '%s'", name);
+    return hwmon;
+}
+
+/******************************************************************************/
+/* Monitor
+ *
+ * The power values of all interfaces are read back to back, leaving the
+ * other channels, the operational states and parsing for afterwards, so that
+ * the power values of a snapshot are as close in time as possible. The
+ * samples are kept in an array owned by the monitor and updated in place, so
+ * that they can be given without copies.
+ */
+
+typedef struct {
+    FiberstatHwmon *hwmon;
+    char           *operstate_path;
+    /* files of the channels not available are never opened */
+    FiberstatFile   files[FIBERSTAT_CHANNEL_LAST];
+    FiberstatFile   operstate_file;
+} MonitorInterface;
+
+struct _Fiberstat {
+    FiberstatHwmonList  hwmon_list;
+    MonitorInterface   *ifaces;
+    FiberstatSample    *samples;
+    unsigned int        n_ifaces;
+    FiberstatSnapshot   snapshot;
+    FiberstatFileCycle  cycle;
+};
+
+Fiberstat *
+fiberstat_new (void)
+{
+    Fiberstat *self;
+
+    self = calloc (1, sizeof (Fiberstat));
+    if (!self)
+        return NULL;
+    fiberstat_hwmon_list_init (&self->hwmon_list);
+    return self;
+}
+
+static void
+monitor_clear_interfaces (Fiberstat *self)
+{
+    unsigned int i;
+
+    for (i = 0; i < self->n_ifaces; i++) {
+        MonitorInterface *iface = &self->ifaces[i];
+        unsigned int      j;
+
+        for (j = 0; j < FIBERSTAT_CHANNEL_LAST; j++)
+            fiberstat_file_close (&iface->files[j]);
+        fiberstat_file_close (&iface->operstate_file);
+        free (iface->operstate_path);
+        free ((char *) self->samples[i].name);
+    }
+    free (self->ifaces);
+    free (self->samples);
+    self->ifaces = NULL;
+    self->samples = NULL;
+    self->n_ifaces = 0;
+    fiberstat_hwmon_list_clear (&self->hwmon_list);
+}
+
+void
+fiberstat_free (Fiberstat *self)
+{
+    if (!self)
+        return;
+    monitor_clear_interfaces (self);
+    pthread_mutex_destroy (&self->hwmon_list.mutex);
+    free (self);
+}
+
+static bool
+monitor_is_requested (const char         *name,
+                      const char *const  *ifaces,
+                      unsigned int        n_ifaces)
+{
+    unsigned int i;
+
+    if (!n_ifaces)
+        return true;
+    for (i = 0; i < n_ifaces; i++) {
+        if (strcmp (ifaces[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* Sorted by name afterwards, the interfaces and samples are allocated in
+ * separate arrays once all are known */
+typedef struct {
+    char           *name;
+    char           *operstate_path;
+    FiberstatHwmon *hwmon;
+    int             operstate_fd;
+} MonitorEntry;
+
+static int
+compare_entry (const void *a, const void *b)
+{
+    return strnatcmp (((const MonitorEntry *) a)->name, ((const MonitorEntry *) b)->name);
+}
+
+static int
+monitor_scan_dir (Fiberstat          *self,
+                  const char         *dir_path,
+                  bool                hwmon_phase,
+                  const char *const  *ifaces,
+                  unsigned int        n_ifaces,
+                  MonitorEntry      **entries,
+                  unsigned int       *n_entries)
+{
+    DIR           *d;
+    struct dirent *dir;
+    int            fd;
+    int            status = 0;
+
+    fd = fiberstat_sysfs_openat (AT_FDCWD, dir_path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        log_error ("couldn't open %s: %s", dir_path, strerror (errno));
+        return -1;
+    }
+
+    d = fdopendir (fd);
+    if (!d) {
+        close (fd);
+        return -1;
+    }
+
+    while ((status == 0) && ((dir = readdir (d)) != NULL)) {
+        FiberstatHwmon *hwmon;
+        MonitorEntry   *aux;
+        char            path[PATH_MAX];
+        int             entry_fd;
+
+        if ((strcmp (dir->d_name, ".") == 0) || (strcmp (dir->d_name, "..") == 0))
+            continue;
+        if (!hwmon_phase && !monitor_is_requested (dir->d_name, ifaces, n_ifaces))
+            continue;
+
+        entry_fd = fiberstat_sysfs_openat (dirfd (d), dir->d_name, O_RDONLY | O_DIRECTORY);
+        if (entry_fd < 0) {
+            log_debug ("couldn't open '%s': %s", dir->d_name, strerror (errno));
+            continue;
+        }
+
+        if (hwmon_phase) {
+            status = fiberstat_hwmon_discover (&self->hwmon_list, dir->d_name, entry_fd, true);
+            close (entry_fd);
+            continue;
+        }
+
+        hwmon = fiberstat_net_lookup_hwmon (&self->hwmon_list, dir->d_name, entry_fd);
+        if (!hwmon) {
+            close (entry_fd);
+            continue;
+        }
+
+        aux = realloc (*entries, sizeof (MonitorEntry) * (*n_entries + 1));
+        if (!aux) {
+            close (entry_fd);
+            status = -3;
+            break;
+        }
+        *entries = aux;
+
+        snprintf (path, sizeof (path), "%s/%s/" FIBERSTAT_OPERSTATE_FILE, dir_path, dir->d_name);
+        aux[*n_entries].name = strdup (dir->d_name);
+        aux[*n_entries].operstate_path = strdup (path);
+        aux[*n_entries].hwmon = hwmon;
+        aux[*n_entries].operstate_fd = fiberstat_sysfs_openat (entry_fd, FIBERSTAT_OPERSTATE_FILE, O_RDONLY);
+        close (entry_fd);
+        (*n_entries)++;
+        if (!aux[*n_entries - 1].name || !aux[*n_entries - 1].operstate_path)
+            status = -2;
+    }
+
+    closedir (d);
+    return status;
+}
+
+int
+fiberstat_discover (Fiberstat          *self,
+                    const char *const  *ifaces,
+                    unsigned int        n_ifaces)
+{
+    MonitorEntry *entries = NULL;
+    unsigned int  n_entries = 0;
+    unsigned int  i;
+    int           status;
+
+    monitor_clear_interfaces (self);
+
+    status = monitor_scan_dir (self, hwmon_dir, true, NULL, 0, NULL, NULL);
+    if (status == 0)
+        status = monitor_scan_dir (self, net_dir, false, ifaces, n_ifaces, &entries, &n_entries);
+
+    if (status == 0 && n_entries) {
+        self->ifaces = calloc (n_entries, sizeof (MonitorInterface));
+        self->samples = calloc (n_entries, sizeof (FiberstatSample));
+        if (!self->ifaces || !self->samples)
+            status = -2;
+    }
+
+    if (status < 0) {
+        for (i = 0; i < n_entries; i++) {
+            if (!(entries[i].operstate_fd < 0))
+                close (entries[i].operstate_fd);
+            free (entries[i].operstate_path);
+            free (entries[i].name);
+        }
+        free (entries);
+        monitor_clear_interfaces (self);
+        return -1;
+    }
+
+    qsort (entries, n_entries, sizeof (MonitorEntry), compare_entry);
+
+    for (i = 0; i < n_entries; i++) {
+        MonitorInterface *iface = &self->ifaces[i];
+        FiberstatSample  *sample = &self->samples[i];
+        unsigned int      j;
+
+        iface->hwmon = entries[i].hwmon;
+        iface->operstate_path = entries[i].operstate_path;
+        for (j = 0; j < FIBERSTAT_CHANNEL_LAST; j++) {
+            fiberstat_file_init (&iface->files[j], iface->hwmon->paths[j]);
+            sample->values[j] = channel_info[j].unknown;
+        }
+        fiberstat_file_init (&iface->operstate_file, iface->operstate_path);
+
+        /* the files opened during discovery are taken by the interface, the
+         * ones that couldn't be opened are retried in the next poll cycle */
+        iface->files[FIBERSTAT_CHANNEL_TX_POWER].fd = iface->hwmon->tx_power_fd;
+        iface->files[FIBERSTAT_CHANNEL_RX_POWER].fd = iface->hwmon->rx_power_fd;
+        iface->operstate_file.fd = entries[i].operstate_fd;
+        iface->hwmon->tx_power_fd = iface->hwmon->rx_power_fd = -1;
+
+        sample->name = entries[i].name;
+        sample->hwmon = iface->hwmon->name;
+        sample->tx_power = FIBERSTAT_POWER_UNKNOWN;
+        sample->rx_power = FIBERSTAT_POWER_UNKNOWN;
+        log_info ("tracking interface '%s'...", sample->name);
+    }
+    self->n_ifaces = n_entries;
+    free (entries);
+
+    /* error if some of the interfaces requested were not found */
+    if (n_ifaces && (n_ifaces != self->n_ifaces)) {
+        for (i = 0; i < n_ifaces; i++) {
+            unsigned int j;
+            bool         found = false;
+
+            for (j = 0; !found && (j < self->n_ifaces); j++)
+                found = (strcmp (ifaces[i], self->samples[j].name) == 0);
+            if (!found)
+                log_error ("interface requested doesn't exist: %s", ifaces[i]);
+        }
+        return -1;
+    }
+
+    log_debug ("detected %u interfaces", self->n_ifaces);
+    return 0;
+}
+
+/* FIBERSTAT_SAMPLE flag of each channel */
+static unsigned int
+channel_sample_flag (FiberstatChannel channel)
+{
+    if (channel == FIBERSTAT_CHANNEL_TX_POWER)
+        return FIBERSTAT_SAMPLE_TX_POWER;
+    if (channel == FIBERSTAT_CHANNEL_RX_POWER)
+        return FIBERSTAT_SAMPLE_RX_POWER;
+    return FIBERSTAT_SAMPLE_CHANNELS;
+}
+
+static unsigned int
+monitor_failures (const MonitorInterface *iface)
+{
+    unsigned int failures = 0;
+    unsigned int i;
+
+    for (i = 0; i < FIBERSTAT_CHANNEL_LAST; i++) {
+        if (fiberstat_file_is_failed (&iface->files[i]))
+            failures |= channel_sample_flag ((FiberstatChannel) i);
+    }
+    if (fiberstat_file_is_failed (&iface->operstate_file))
+        failures |= FIBERSTAT_SAMPLE_OPERSTATE;
+    return failures;
+}
+
+void
+fiberstat_snapshot_begin (FiberstatSnapshot *snapshot)
+{
+    snapshot->id++;
+    snapshot->n_reads = 0;
+}
+
+void
+fiberstat_snapshot_add_read (FiberstatSnapshot   *snapshot,
+                             const FiberstatFile *file)
+{
+    if (file->n_read < 0)
+        return;
+
+    if (!snapshot->n_reads || timespec_diff_ms (&file->read_time, &snapshot->first_read) < 0)
+        snapshot->first_read = file->read_time;
+    if (!snapshot->n_reads || timespec_diff_ms (&file->read_time, &snapshot->last_read) > 0)
+        snapshot->last_read = file->read_time;
+    snapshot->n_reads++;
+}
+
+int
+fiberstat_poll (Fiberstat           *self,
+                FiberstatSampleFunc  func,
+                void                *user_data)
+{
+    unsigned int i;
+    int          n_updates = 0;
+
+    fiberstat_file_begin_cycle (&self->cycle);
+    fiberstat_snapshot_begin (&self->snapshot);
+    self->snapshot.n_samples = self->n_ifaces;
+
+    /* failing files are opened again with backoff */
+    for (i = 0; i < self->n_ifaces; i++) {
+        MonitorInterface *iface = &self->ifaces[i];
+        unsigned int      j;
+
+        for (j = 0; j < FIBERSTAT_CHANNEL_LAST; j++) {
+            if (iface->files[j].path)
+                fiberstat_file_open (&iface->files[j], &self->cycle, -1, NULL);
+        }
+        fiberstat_file_open (&iface->operstate_file, &self->cycle, -1, NULL);
+    }
+
+    /* power values back to back */
+    for (i = 0; i < self->n_ifaces; i++) {
+        fiberstat_file_read (&self->ifaces[i].files[FIBERSTAT_CHANNEL_TX_POWER]);
+        fiberstat_file_read (&self->ifaces[i].files[FIBERSTAT_CHANNEL_RX_POWER]);
+    }
+
+    for (i = 0; i < self->n_ifaces; i++) {
+        MonitorInterface *iface = &self->ifaces[i];
+        FiberstatSample  *sample = &self->samples[i];
+        unsigned int      j;
+
+        for (j = 0; j < FIBERSTAT_CHANNEL_LAST; j++) {
+            if (!FIBERSTAT_CHANNEL_IS_REQUIRED (j))
+                fiberstat_file_read (&iface->files[j]);
+        }
+        fiberstat_file_read (&iface->operstate_file);
+        fiberstat_snapshot_add_read (&self->snapshot, &iface->files[FIBERSTAT_CHANNEL_TX_POWER]);
+        fiberstat_snapshot_add_read (&self->snapshot, &iface->files[FIBERSTAT_CHANNEL_RX_POWER]);
+
+        sample->updates = 0;
+        for (j = 0; j < FIBERSTAT_CHANNEL_LAST; j++) {
+            if (fiberstat_file_update_channel (&iface->files[j], (FiberstatChannel) j, &sample->values[j]) == 0)
+                sample->updates |= channel_sample_flag ((FiberstatChannel) j);
+        }
+        sample->tx_power = sample->values[FIBERSTAT_CHANNEL_TX_POWER];
+        sample->rx_power = sample->values[FIBERSTAT_CHANNEL_RX_POWER];
+        if (fiberstat_file_update_operstate (&iface->operstate_file, &sample->operstate) == 0)
+            sample->updates |= FIBERSTAT_SAMPLE_OPERSTATE;
+        sample->failures = monitor_failures (iface);
+        if (iface->files[FIBERSTAT_CHANNEL_TX_POWER].n_read >= 0)
+            sample->tx_power_time = iface->files[FIBERSTAT_CHANNEL_TX_POWER].read_time;
+        if (iface->files[FIBERSTAT_CHANNEL_RX_POWER].n_read >= 0)
+            sample->rx_power_time = iface->files[FIBERSTAT_CHANNEL_RX_POWER].read_time;
+        if (iface->operstate_file.n_read >= 0)
+            sample->operstate_time = iface->operstate_file.read_time;
+
+        n_updates += ((sample->updates & FIBERSTAT_SAMPLE_TX_POWER) != 0) +
+                     ((sample->updates & FIBERSTAT_SAMPLE_RX_POWER) != 0) +
+                     ((sample->updates & FIBERSTAT_SAMPLE_OPERSTATE) != 0) +
+                     ((sample->updates & FIBERSTAT_SAMPLE_CHANNELS) != 0);
+    }
+
+    if (func) {
+        for (i = 0; i < self->n_ifaces; i++)
+            func (&self->snapshot, &self->samples[i], user_data);
+    }
+
+    return n_updates;
+}
+
+unsigned int
+fiberstat_get_n_samples (const Fiberstat *self)
+{
+    return self->n_ifaces;
+}
+
+const FiberstatSample *
+fiberstat_get_sample (const Fiberstat *self,
+                      unsigned int     i)
+{
+    if (i >= self->n_ifaces)
+        return NULL;
+    return &self->samples[i];
+}
+
+const FiberstatSnapshot *
+fiberstat_get_snapshot (const Fiberstat *self)
+{
+    return &self->snapshot;
+}
+
+unsigned long
+fiberstat_snapshot_get_id (const FiberstatSnapshot *snapshot)
+{
+    return snapshot->id;
+}
+
+unsigned int
+fiberstat_snapshot_get_n_samples (const FiberstatSnapshot *snapshot)
+{
+    return snapshot->n_samples;
+}
+
+unsigned int
+fiberstat_snapshot_get_n_reads (const FiberstatSnapshot *snapshot)
+{
+    return snapshot->n_reads;
+}
+
+bool
+fiberstat_snapshot_get_read_times (const FiberstatSnapshot *snapshot,
+                                   struct timespec         *first_read,
+                                   struct timespec         *last_read)
+{
+    if (!snapshot->n_reads)
+        return false;
+    if (first_read)
+        *first_read = snapshot->first_read;
+    if (last_read)
+        *last_read = snapshot->last_read;
+    return true;
+}
+
+const char *
+fiberstat_sample_get_name (const FiberstatSample *sample)
+{
+    return sample->name;
+}
+
+const char *
+fiberstat_sample_get_hwmon (const FiberstatSample *sample)
+{
+    return sample->hwmon;
+}
+
+float
+fiberstat_sample_get_tx_power (const FiberstatSample *sample)
+{
+    return sample->tx_power;
+}
+
+float
+fiberstat_sample_get_rx_power (const FiberstatSample *sample)
+{
+    return sample->rx_power;
+}
+
+FiberstatOperstate
+fiberstat_sample_get_operstate (const FiberstatSample *sample)
+{
+    return sample->operstate;
+}
+
+float
+fiberstat_sample_get_value (const FiberstatSample *sample,
+                            FiberstatChannel       channel)
+{
+    if (channel >= FIBERSTAT_CHANNEL_LAST)
+        return NAN;
+    return sample->values[channel];
+}
+
+const struct timespec *
+fiberstat_sample_get_tx_power_time (const FiberstatSample *sample)
+{
+    return &sample->tx_power_time;
+}
+
+const struct timespec *
+fiberstat_sample_get_rx_power_time (const FiberstatSample *sample)
+{
+    return &sample->rx_power_time;
+}
+
+const struct timespec *
+fiberstat_sample_get_operstate_time (const FiberstatSample *sample)
+{
+    return &sample->operstate_time;
+}
+
+unsigned int
+fiberstat_sample_get_updates (const FiberstatSample *sample)
+{
+    return sample->updates;
+}
+
+unsigned int
+fiberstat_sample_get_failures (const FiberstatSample *sample)
+{
+    return sample->failures;
+}
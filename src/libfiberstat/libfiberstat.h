@@ -0,0 +1,184 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ * libfiberstat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2019 Zodiac Inflight Innovations
+ * Copyright (C) 2019 Aleksander Morgado <aleksander@aleksander.es>
+ */
+
+#ifndef LIBFIBERSTAT_H
+#define LIBFIBERSTAT_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/******************************************************************************/
+/* Library of the fiberstat program
+ *
+ * The monitor API (Fiberstat) discovers the network interfaces with a hwmon
+ * entry exposing TX/RX power levels, and reads all of them in each poll
+ * cycle, giving the results as a numbered snapshot of samples which may be
+ * iterated without copies, or passed to a callback. Monitors, snapshots and
+ * samples are opaque, and only accessed through the functions below.
+ *
+ * The sysfs files and hwmon lists the monitor API is built on are internal
+ * (see libfiberstat-private.h). The fiberstat program has its own discovery
+ * and poll cycle on top of them (background discovery, a file descriptor
+ * budget, several sampler threads), so the library isn't installed until the
+ * program uses the monitor API as well.
+ *
+ * Power values are given in dBm; the other diagnostics channels of the SFP
+ * modules (see DDM channels) in the unit of each channel.
+ */
+
+/* Power value given when it's unknown, e.g. on read errors */
+#define FIBERSTAT_POWER_UNKNOWN -40.0
+
+/******************************************************************************/
+/* Logging */
+
+typedef enum {
+    FIBERSTAT_LOG_LEVEL_ERROR,
+    FIBERSTAT_LOG_LEVEL_WARNING,
+    FIBERSTAT_LOG_LEVEL_INFO,
+    FIBERSTAT_LOG_LEVEL_DEBUG,
+} FiberstatLogLevel;
+
+typedef void (* FiberstatLogFunc) (FiberstatLogLevel  level,
+                                   const char        *message,
+                                   void              *user_data);
+
+/* Nothing is logged unless a log function is given; it may be called from
+ * any of the threads using the library */
+void fiberstat_set_log_func (FiberstatLogFunc  func,
+                             void             *user_data);
+
+/* Prefix of the sysfs paths, e.g. to use a fake sysfs tree for testing. Must
+ * be set before anything else is done with the library. */
+void fiberstat_set_sysfs_prefix (const char *prefix);
+
+/******************************************************************************/
+/* Operational states, as defined in RFC 2863 and given by the kernel in the
+ * operstate file */
+
+typedef enum {
+    FIBERSTAT_OPERSTATE_UNKNOWN,
+    FIBERSTAT_OPERSTATE_NOTPRESENT,
+    FIBERSTAT_OPERSTATE_DOWN,
+    FIBERSTAT_OPERSTATE_LOWERLAYERDOWN,
+    FIBERSTAT_OPERSTATE_TESTING,
+    FIBERSTAT_OPERSTATE_DORMANT,
+    FIBERSTAT_OPERSTATE_UP,
+    FIBERSTAT_OPERSTATE_LAST
+} FiberstatOperstate;
+
+const char *fiberstat_operstate_to_string (FiberstatOperstate operstate);
+
+/******************************************************************************/
+/* DDM channels
+ *
+ * Besides the TX/RX power levels, the hwmon entries of SFP modules expose
+ * other digital diagnostics monitoring (DDM) channels, e.g. the temperature.
+ * The TX/RX power channels are required for a hwmon entry to be valid, the
+ * others are optional.
+ */
+
+typedef enum {
+    FIBERSTAT_CHANNEL_TX_POWER,
+    FIBERSTAT_CHANNEL_RX_POWER,
+    FIBERSTAT_CHANNEL_TEMPERATURE,
+    FIBERSTAT_CHANNEL_VOLTAGE,
+    FIBERSTAT_CHANNEL_BIAS,
+    FIBERSTAT_CHANNEL_LAST
+} FiberstatChannel;
+
+#define FIBERSTAT_CHANNEL_IS_REQUIRED(channel) ((channel) <= FIBERSTAT_CHANNEL_RX_POWER)
+
+/* Short name, e.g. "temp", and unit, e.g. "C" */
+const char *fiberstat_channel_get_name (FiberstatChannel channel);
+const char *fiberstat_channel_get_unit (FiberstatChannel channel);
+
+/******************************************************************************/
+/* Monitor
+ *
+ * Not thread-safe: a monitor must only be used from one thread at a time.
+ */
+
+typedef struct _Fiberstat         Fiberstat;
+typedef struct _FiberstatSnapshot FiberstatSnapshot;
+typedef struct _FiberstatSample   FiberstatSample;
+
+#define FIBERSTAT_SAMPLE_TX_POWER  (1 << 0)
+#define FIBERSTAT_SAMPLE_RX_POWER  (1 << 1)
+#define FIBERSTAT_SAMPLE_OPERSTATE (1 << 2)
+/* any channel other than the TX/RX power ones */
+#define FIBERSTAT_SAMPLE_CHANNELS  (1 << 3)
+
+typedef void (* FiberstatSampleFunc) (const FiberstatSnapshot *snapshot,
+                                      const FiberstatSample   *sample,
+                                      void                    *user_data);
+
+Fiberstat               *fiberstat_new            (void);
+void                     fiberstat_free           (Fiberstat       *self);
+
+/* Only the given interfaces are monitored, if any given. Returns -1 if some
+ * of them weren't found, or on errors. */
+int                      fiberstat_discover       (Fiberstat         *self,
+                                                   const char *const *ifaces,
+                                                   unsigned int       n_ifaces);
+
+/* Reads all interfaces and calls the given function, if any, for each
+ * sample. Returns the number of values updated. */
+int                      fiberstat_poll           (Fiberstat           *self,
+                                                   FiberstatSampleFunc  func,
+                                                   void                *user_data);
+
+/* Samples of the last poll cycle, sorted by interface name, without copies;
+ * valid until the next poll cycle or until the monitor is freed */
+unsigned int             fiberstat_get_n_samples  (const Fiberstat *self);
+const FiberstatSample   *fiberstat_get_sample     (const Fiberstat *self,
+                                                   unsigned int     i);
+const FiberstatSnapshot *fiberstat_get_snapshot   (const Fiberstat *self);
+
+unsigned long            fiberstat_snapshot_get_id         (const FiberstatSnapshot *snapshot);
+unsigned int             fiberstat_snapshot_get_n_samples  (const FiberstatSnapshot *snapshot);
+/* Number of power values read, and the CLOCK_MONOTONIC times of the first
+ * and last ones; false if none was read */
+unsigned int             fiberstat_snapshot_get_n_reads    (const FiberstatSnapshot *snapshot);
+bool                     fiberstat_snapshot_get_read_times (const FiberstatSnapshot *snapshot,
+                                                            struct timespec         *first_read,
+                                                            struct timespec         *last_read);
+
+const char              *fiberstat_sample_get_name      (const FiberstatSample *sample);
+const char              *fiberstat_sample_get_hwmon     (const FiberstatSample *sample);
+float                    fiberstat_sample_get_tx_power  (const FiberstatSample *sample);
+float                    fiberstat_sample_get_rx_power  (const FiberstatSample *sample);
+FiberstatOperstate       fiberstat_sample_get_operstate (const FiberstatSample *sample);
+/* Value of any channel, including the TX/RX power ones; NAN if the channel
+ * isn't available, or FIBERSTAT_POWER_UNKNOWN for the power ones */
+float                    fiberstat_sample_get_value     (const FiberstatSample *sample,
+                                                         FiberstatChannel       channel);
+/* CLOCK_MONOTONIC time each value was last read */
+const struct timespec   *fiberstat_sample_get_tx_power_time  (const FiberstatSample *sample);
+const struct timespec   *fiberstat_sample_get_rx_power_time  (const FiberstatSample *sample);
+const struct timespec   *fiberstat_sample_get_operstate_time (const FiberstatSample *sample);
+/* FIBERSTAT_SAMPLE flags of the values updated in the last poll cycle, and
+ * of the files failing */
+unsigned int             fiberstat_sample_get_updates   (const FiberstatSample *sample);
+unsigned int             fiberstat_sample_get_failures  (const FiberstatSample *sample);
+
+#endif /* LIBFIBERSTAT_H */
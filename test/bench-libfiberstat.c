@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ * fiberstat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2019 Zodiac Inflight Innovations
+ * Copyright (C) 2019 Aleksander Morgado <aleksander@aleksander.es>
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libfiberstat.h"
+
+/******************************************************************************/
+/* Monitor API benchmark
+ *
+ * Polls all interfaces found in the sysfs tree with the given prefix, e.g.
+ * the test sysfs created by test-sysfs-setup, the given number of times, and
+ * reports the time each poll cycle took and the skew between the first and
+ * last power values read in it:
+ *
+ *   $ ./bench-libfiberstat [PREFIX [N_POLLS]]
+ *
+ * The default prefix is /tmp, as in test-sysfs-setup; an empty prefix polls
+ * the real sysfs.
+ */
+
+#define DEFAULT_PREFIX  "/tmp"
+#define DEFAULT_N_POLLS 1000
+
+static double
+timespec_diff_ms (const struct timespec *a,
+                  const struct timespec *b)
+{
+    return ((a->tv_sec - b->tv_sec) * 1000.0) + ((a->tv_nsec - b->tv_nsec) / 1000000.0);
+}
+
+static int
+compare_double (const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+static void
+print_distribution (const char   *name,
+                    double       *values,
+                    unsigned int  n_values)
+{
+    qsort (values, n_values, sizeof (double), compare_double);
+    printf ("  %-10s %.3f ms p50, %.3f ms p90, %.3f ms p99, %.3f ms max\n",
+            name, values[n_values / 2], values[(n_values * 9) / 10],
+            values[(n_values * 99) / 100], values[n_values - 1]);
+}
+
+int
+main (int argc, char **argv)
+{
+    const char              *prefix = DEFAULT_PREFIX;
+    unsigned long            n_polls = DEFAULT_N_POLLS;
+    Fiberstat               *monitor;
+    const FiberstatSnapshot *snapshot;
+    unsigned long            i;
+    double                  *poll_ms;
+    double                  *skew_ms;
+    int                      status = EXIT_FAILURE;
+
+    if (argc > 1)
+        prefix = argv[1];
+    if (argc > 2) {
+        char *end;
+
+        n_polls = strtoul (argv[2], &end, 10);
+        if (*end || !n_polls) {
+            fprintf (stderr, "error: invalid number of polls: %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fiberstat_set_sysfs_prefix (prefix);
+
+    poll_ms = calloc (n_polls, sizeof (double));
+    skew_ms = calloc (n_polls, sizeof (double));
+    monitor = fiberstat_new ();
+    if (!poll_ms || !skew_ms || !monitor) {
+        fprintf (stderr, "error: out of memory\n");
+        goto out;
+    }
+
+    if (fiberstat_discover (monitor, NULL, 0) < 0) {
+        fprintf (stderr, "error: couldn't discover interfaces in the sysfs at '%s'\n", prefix);
+        goto out;
+    }
+    if (!fiberstat_get_n_samples (monitor)) {
+        fprintf (stderr, "error: no interfaces found in the sysfs at '%s', run test-sysfs-setup first\n", prefix);
+        goto out;
+    }
+
+    snapshot = fiberstat_get_snapshot (monitor);
+    for (i = 0; i < n_polls; i++) {
+        struct timespec start;
+        struct timespec end;
+        struct timespec first_read;
+        struct timespec last_read;
+
+        clock_gettime (CLOCK_MONOTONIC, &start);
+        fiberstat_poll (monitor, NULL, NULL);
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        poll_ms[i] = timespec_diff_ms (&end, &start);
+        if (fiberstat_snapshot_get_read_times (snapshot, &first_read, &last_read))
+            skew_ms[i] = timespec_diff_ms (&last_read, &first_read);
+    }
+
+    printf ("%lu polls of %u interfaces in the sysfs at '%s':\n", n_polls, fiberstat_get_n_samples (monitor), prefix);
+    print_distribution ("poll time:", poll_ms, n_polls);
+    print_distribution ("skew:", skew_ms, n_polls);
+    status = EXIT_SUCCESS;
+
+out:
+    fiberstat_free (monitor);
+    free (poll_ms);
+    free (skew_ms);
+    return status;
+}
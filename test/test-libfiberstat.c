@@ -0,0 +1,325 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ * fiberstat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2019 Zodiac Inflight Innovations
+ * Copyright (C) 2019 Aleksander Morgado <aleksander@aleksander.es>
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include "libfiberstat.h"
+
+/******************************************************************************/
+/* Monitor API test
+ *
+ * Discovers and polls a fake sysfs tree, laid out like the one created by
+ * test-sysfs-setup, in a temporary directory:
+ *
+ *   eth0  -> hwmon0, with the temperature, VCC and bias channels
+ *   eth2  -> hwmon1, without the optional channels
+ *   eth10 -> hwmon2, with the temperature, VCC and bias channels
+ *   lo       no sfp phandle, so not monitored
+ *
+ * Power values are given in uW, as by the kernel.
+ */
+
+static char         sysfs_dir[] = "/tmp/test-libfiberstat-XXXXXX";
+static unsigned int n_failures;
+
+#define check(expr) do {                                                \
+        if (!(expr)) {                                                  \
+            fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            n_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+#define check_float(value, expected) check (fabsf ((value) - (expected)) < 0.01)
+
+static void
+write_file (const char *dir,
+            const char *name,
+            const char *contents)
+{
+    char  path[512];
+    FILE *f;
+
+    snprintf (path, sizeof (path), "%s%s/%s", sysfs_dir, dir, name);
+    f = fopen (path, "w");
+    if (!f) {
+        fprintf (stderr, "error: couldn't write %s: %s\n", path, strerror (errno));
+        exit (EXIT_FAILURE);
+    }
+    fputs (contents, f);
+    fclose (f);
+}
+
+static void
+make_dir (const char *dir)
+{
+    char path[512];
+
+    snprintf (path, sizeof (path), "%s%s", sysfs_dir, dir);
+    if (mkdir (path, 0755) < 0 && errno != EEXIST) {
+        fprintf (stderr, "error: couldn't create %s: %s\n", path, strerror (errno));
+        exit (EXIT_FAILURE);
+    }
+}
+
+static void
+create_interface (const char *iface,
+                  unsigned int idx,
+                  const char *tx_power,
+                  const char *rx_power,
+                  bool        channels)
+{
+    char net[64];
+    char hwmon[64];
+    char phandle[8];
+
+    snprintf (net, sizeof (net), "/sys/class/net/%s", iface);
+    snprintf (hwmon, sizeof (hwmon), "/sys/class/hwmon/hwmon%u", idx);
+    snprintf (phandle, sizeof (phandle), "%04u", idx);
+
+    make_dir (net);
+    make_dir (hwmon);
+    strcat (net, "/of_node");
+    strcat (hwmon, "/of_node");
+    make_dir (net);
+    make_dir (hwmon);
+    write_file (net, "sfp", phandle);
+    write_file (hwmon, "phandle", phandle);
+    net[strlen (net) - strlen ("/of_node")] = '\0';
+    hwmon[strlen (hwmon) - strlen ("/of_node")] = '\0';
+
+    write_file (net, "operstate", "up\n");
+    write_file (hwmon, "power1_label", "TX_power");
+    write_file (hwmon, "power1_input", tx_power);
+    write_file (hwmon, "power2_label", "RX_power");
+    write_file (hwmon, "power2_input", rx_power);
+    if (!channels)
+        return;
+    write_file (hwmon, "temp1_label", "temperature");
+    write_file (hwmon, "temp1_input", "35500");
+    write_file (hwmon, "in0_label", "VCC");
+    write_file (hwmon, "in0_input", "3300");
+    write_file (hwmon, "curr1_label", "bias");
+    write_file (hwmon, "curr1_input", "7");
+}
+
+static void
+create_sysfs (void)
+{
+    if (!mkdtemp (sysfs_dir)) {
+        fprintf (stderr, "error: couldn't create temporary directory: %s\n", strerror (errno));
+        exit (EXIT_FAILURE);
+    }
+    make_dir ("/sys");
+    make_dir ("/sys/class");
+    make_dir ("/sys/class/net");
+    make_dir ("/sys/class/hwmon");
+
+    create_interface ("eth0",  0, "1000", "100",  true);
+    create_interface ("eth2",  1, "2000", "200",  false);
+    create_interface ("eth10", 2, "500",  "1000", true);
+
+    make_dir ("/sys/class/net/lo");
+    write_file ("/sys/class/net/lo", "operstate", "unknown\n");
+}
+
+static int
+remove_entry (const char        *path,
+              const struct stat *st,
+              int                type,
+              struct FTW        *ftw)
+{
+    return remove (path);
+}
+
+static void
+remove_sysfs (void)
+{
+    nftw (sysfs_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/******************************************************************************/
+
+typedef struct {
+    unsigned int  n_calls;
+    unsigned long snapshot_id;
+} PollContext;
+
+static void
+poll_cb (const FiberstatSnapshot *snapshot,
+         const FiberstatSample   *sample,
+         void                    *user_data)
+{
+    PollContext *ctx = user_data;
+
+    ctx->n_calls++;
+    ctx->snapshot_id = fiberstat_snapshot_get_id (snapshot);
+}
+
+static void
+test_discover_requested (void)
+{
+    const char *const  found[] = { "eth2" };
+    const char *const  missing[] = { "eth2", "eth3" };
+    Fiberstat         *monitor;
+
+    monitor = fiberstat_new ();
+    check (monitor != NULL);
+
+    check (fiberstat_discover (monitor, found, 1) == 0);
+    check (fiberstat_get_n_samples (monitor) == 1);
+    check (fiberstat_get_n_samples (monitor) == 1 &&
+           strcmp (fiberstat_sample_get_name (fiberstat_get_sample (monitor, 0)), "eth2") == 0);
+
+    check (fiberstat_discover (monitor, missing, 2) < 0);
+
+    fiberstat_free (monitor);
+}
+
+/* Whether a is not later than b */
+static bool
+timespec_le (const struct timespec *a,
+             const struct timespec *b)
+{
+    return ((a->tv_sec < b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec <= b->tv_nsec)));
+}
+
+static void
+test_poll (void)
+{
+    Fiberstat               *monitor;
+    const FiberstatSample   *eth0;
+    const FiberstatSample   *eth2;
+    const FiberstatSample   *eth10;
+    const FiberstatSnapshot *snapshot;
+    struct timespec          first_read;
+    struct timespec          last_read;
+    unsigned int             i;
+    PollContext              ctx = { 0 };
+
+    monitor = fiberstat_new ();
+    check (monitor != NULL);
+    check (fiberstat_discover (monitor, NULL, 0) == 0);
+
+    /* natural order, lo skipped */
+    check (fiberstat_get_n_samples (monitor) == 3);
+    if (fiberstat_get_n_samples (monitor) != 3) {
+        fiberstat_free (monitor);
+        return;
+    }
+    eth0 = fiberstat_get_sample (monitor, 0);
+    eth2 = fiberstat_get_sample (monitor, 1);
+    eth10 = fiberstat_get_sample (monitor, 2);
+    check (fiberstat_get_sample (monitor, 3) == NULL);
+    check (strcmp (fiberstat_sample_get_name (eth0), "eth0") == 0);
+    check (strcmp (fiberstat_sample_get_name (eth2), "eth2") == 0);
+    check (strcmp (fiberstat_sample_get_name (eth10), "eth10") == 0);
+    check (strcmp (fiberstat_sample_get_hwmon (eth0), "hwmon0") == 0);
+    check (strcmp (fiberstat_sample_get_hwmon (eth10), "hwmon2") == 0);
+
+    /* first poll: every value available is updated */
+    check (fiberstat_poll (monitor, poll_cb, &ctx) == 11);
+    check (ctx.n_calls == 3);
+    check (ctx.snapshot_id == 1);
+    snapshot = fiberstat_get_snapshot (monitor);
+    check (fiberstat_snapshot_get_id (snapshot) == 1);
+    check (fiberstat_snapshot_get_n_samples (snapshot) == 3);
+    check (fiberstat_snapshot_get_n_reads (snapshot) == 6);
+
+    check_float (fiberstat_sample_get_tx_power (eth0), 0.0);
+    check_float (fiberstat_sample_get_rx_power (eth0), -10.0);
+    check_float (fiberstat_sample_get_tx_power (eth2), 3.01);
+    check_float (fiberstat_sample_get_rx_power (eth2), -6.99);
+    check_float (fiberstat_sample_get_tx_power (eth10), -3.01);
+    check_float (fiberstat_sample_get_rx_power (eth10), 0.0);
+    check_float (fiberstat_sample_get_value (eth0, FIBERSTAT_CHANNEL_TEMPERATURE), 35.5);
+    check_float (fiberstat_sample_get_value (eth0, FIBERSTAT_CHANNEL_VOLTAGE), 3.3);
+    check_float (fiberstat_sample_get_value (eth0, FIBERSTAT_CHANNEL_BIAS), 7.0);
+    check (isnan (fiberstat_sample_get_value (eth2, FIBERSTAT_CHANNEL_TEMPERATURE)));
+    for (i = 0; i < 3; i++) {
+        const FiberstatSample *sample = fiberstat_get_sample (monitor, i);
+
+        check (fiberstat_sample_get_operstate (sample) == FIBERSTAT_OPERSTATE_UP);
+        check (fiberstat_sample_get_failures (sample) == 0);
+    }
+    check (fiberstat_sample_get_updates (eth0) == (FIBERSTAT_SAMPLE_TX_POWER | FIBERSTAT_SAMPLE_RX_POWER |
+                                                   FIBERSTAT_SAMPLE_OPERSTATE | FIBERSTAT_SAMPLE_CHANNELS));
+    check (fiberstat_sample_get_updates (eth2) == (FIBERSTAT_SAMPLE_TX_POWER | FIBERSTAT_SAMPLE_RX_POWER |
+                                                   FIBERSTAT_SAMPLE_OPERSTATE));
+
+    /* second poll: nothing changed */
+    check (fiberstat_poll (monitor, NULL, NULL) == 0);
+    check (fiberstat_snapshot_get_id (snapshot) == 2);
+    for (i = 0; i < 3; i++)
+        check (fiberstat_sample_get_updates (fiberstat_get_sample (monitor, i)) == 0);
+
+    /* only the values changed are flagged */
+    write_file ("/sys/class/hwmon/hwmon0", "power2_input", "10");
+    write_file ("/sys/class/net/eth10", "operstate", "lowerlayerdown\n");
+    write_file ("/sys/class/hwmon/hwmon2", "temp1_input", "40000");
+    check (fiberstat_poll (monitor, NULL, NULL) == 3);
+    check (fiberstat_snapshot_get_id (snapshot) == 3);
+    check (fiberstat_sample_get_updates (eth0) == FIBERSTAT_SAMPLE_RX_POWER);
+    check_float (fiberstat_sample_get_rx_power (eth0), -20.0);
+    check (fiberstat_sample_get_updates (eth2) == 0);
+    check (fiberstat_sample_get_updates (eth10) == (FIBERSTAT_SAMPLE_OPERSTATE | FIBERSTAT_SAMPLE_CHANNELS));
+    check (fiberstat_sample_get_operstate (eth10) == FIBERSTAT_OPERSTATE_LOWERLAYERDOWN);
+    check_float (fiberstat_sample_get_value (eth10, FIBERSTAT_CHANNEL_TEMPERATURE), 40.0);
+
+    /* power values read back to back, before the other files */
+    check (fiberstat_snapshot_get_read_times (snapshot, &first_read, &last_read));
+    check (timespec_le (&first_read, &last_read));
+    check (timespec_le (fiberstat_sample_get_tx_power_time (eth0), &last_read));
+    check (timespec_le (&last_read, fiberstat_sample_get_operstate_time (eth10)));
+
+    fiberstat_free (monitor);
+}
+
+int
+main (int argc, char **argv)
+{
+    create_sysfs ();
+    fiberstat_set_sysfs_prefix (sysfs_dir);
+
+    test_poll ();
+    test_discover_requested ();
+
+    remove_sysfs ();
+
+    if (n_failures) {
+        fprintf (stderr, "%u checks failed\n", n_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}